@@ -1,5 +1,6 @@
 cd ../build \
     && cmake .. -DCMAKE_BUILD_TYPE=Release -DCMAKE_TOOLCHAIN_FILE=/vcpkg/scripts/buildsystems/vcpkg.cmake \
     && make exchange_main \
-    && make trading_main
+    && make trading_main \
+    && make matching_engine_benchmark
 
@@ -11,7 +11,7 @@
                           300 0.8 1500 3000 -100 \
                           50 0.7 150 300 -100 \
                           100 0.3 250 300 -100 &
-sleep 5
+sleep 1
 
 ../build/bin/trading_main  2 MAKER \
                           2100 0.4 2150 2300 -1100 \
@@ -22,7 +22,7 @@ sleep 5
                           2300 0.5 21500 23000 -1100 \
                           250 0.8 2150 2300 -1100 \
                           2100 0.3 2250 2300 -1100 &
-sleep 5
+sleep 1
 
 ../build/bin/trading_main  3 TAKER \
                           300 0.8 350 300 -300 \
@@ -33,7 +33,7 @@ sleep 5
                           300 0.7 3500 3000 -300 \
                           50 0.3 350 300 -300 \
                           300 0.8 350 300 -300 &
-sleep 5
+sleep 1
 
 ../build/bin/trading_main  4 TAKER \
                           4100 0.8 4150 4300 -1100 \
@@ -44,9 +44,9 @@ sleep 5
                           4300 0.6 41500 43000 -1100 \
                           450 0.6 4150 4300 -1100 \
                           4100 0.9 4450 4300 -1100 &
-sleep 5
+sleep 1
 
 ../build/bin/trading_main  5 RANDOM &
-sleep 5
+sleep 1
 
 wait
@@ -8,7 +8,7 @@ echo "--------------------------------------------------------------------------
 echo "Starting Exchange..."
 echo "---------------------------------------------------------------------------------------------------------------------------------------------------------"
 ../build/bin/exchange_main 2>&1 &
-sleep 10
+sleep 2
 
 bash ./run_clients.sh
 
@@ -19,7 +19,5 @@ echo "Stopping Exchange..."
 echo "---------------------------------------------------------------------------------------------------------------------------------------------------------"
 pkill -2 exchange
 
-sleep 10
-
 wait
 date
@@ -1,49 +1,91 @@
 #include <csignal>
 
+#include "common/latency_histogram.hpp"
 #include "market_data/market_data_publisher.hpp"
 #include "matching_engine/matching_engine.hpp"
 #include "order_gateway/order_server.hpp"
 
 common::Logger *logger = nullptr;
-exchange::MatchingEngine *matching_engine = nullptr;
+common::LatencyReporter *latency_reporter = nullptr;
+std::vector<exchange::MatchingEngine *> matching_engines;
 exchange::MarketDataPublisher *market_data_publisher = nullptr;
 exchange::OrderServer *order_server = nullptr;
 
 void SignalHandler(int /*unused*/) {
-    using namespace std::literals::chrono_literals;
-    std::this_thread::sleep_for(10s);
+    // Let the component threads wind down concurrently, each is joined when its component is deleted below. Their
+    // loggers keep running until then, so that nothing logged on the way out is lost.
+    common::ThreadRegistry::Instance().RequestStopAll("exchange/");
 
     delete logger;
     logger = nullptr;
-    delete matching_engine;
-    matching_engine = nullptr;
+    for (auto &matching_engine : matching_engines) {
+        delete matching_engine;
+        matching_engine = nullptr;
+    }
     delete market_data_publisher;
     market_data_publisher = nullptr;
     delete order_server;
     order_server = nullptr;
-
-    std::this_thread::sleep_for(10s);
+    delete latency_reporter;
+    latency_reporter = nullptr;
 
     exit(EXIT_SUCCESS);
 }
 
-auto main(int /*unused*/, char ** /*unused*/) -> int {
+// ./exchange_main [NUM_MATCHING_ENGINE_SHARDS [FIRST_MATCHING_ENGINE_CORE [REPLAY_JOURNAL [WAIT_POLICY]]]]
+// Shard i owns every ticker with ticker_id % NUM_MATCHING_ENGINE_SHARDS == i and is pinned to core
+// FIRST_MATCHING_ENGINE_CORE + i. Shards are not pinned if FIRST_MATCHING_ENGINE_CORE is not provided or is -1.
+// Every sequenced client request is journaled to exchange_requests.journal, and every shard periodically checkpoints
+// its order books. With REPLAY_JOURNAL=1 the order books are rebuilt at startup from the latest checkpoints and the
+// requests journaled after them, and new requests are appended to the journal. Otherwise the journal is started afresh
+// and the checkpoints are discarded. WAIT_POLICY is how the matching engine shards, the order server and the market
+// data publisher wait for work: BUSY_SPIN (the default), YIELD or PARK.
+// If the THREAD_LAYOUT environment variable names a thread layout file (see runtime/thread_layout.hpp), the threads it
+// lists get its cores, scheduling, NUMA nodes and wait policies, overriding FIRST_MATCHING_ENGINE_CORE and WAIT_POLICY.
+// Its thread names are exchange/MatchingEngine/<SHARD>, exchange/OrderServer, exchange/MarketDataPublisher,
+// exchange/SnapshotSynthesizer, exchange/CheckpointWriter/<SHARD>, common/LatencyReporter and common/Logger/<LOG_FILE>.
+// The latency percentiles of every START_MEASURE/END_MEASURE tag are written to exchange_latencies.txt every 10
+// seconds and at exit.
+// With the TRANSPORT environment variable set to SHM, clients co-located with the exchange can also connect over
+// shared memory and read the incremental market data from it (see network/shm_transport.hpp), next to the TCP and
+// multicast ones. It defaults to SOCKET, for TCP and multicast only.
+// With the LOG_FORMAT environment variable set to BINARY, every log is written as binary records to <LOG_FILE>.bin,
+// for log_decoder to turn into text later (see logging/log_record.hpp). It defaults to TEXT.
+auto main(int argc, char **argv) -> int {
+    const size_t num_shards = (argc > 1 ? std::atoi(argv[1]) : 1);
+    const int first_core = (argc > 2 ? std::atoi(argv[2]) : -1);
+    const bool replay_journal = (argc > 3 && std::atoi(argv[3]) != 0);
+    const auto wait_policy = (argc > 4 ? common::StringToWaitPolicy(argv[4]) : common::WaitPolicy::BUSY_SPIN);
+    const auto transport = common::GetTransport();
+    if (transport == common::Transport::INVALID) {
+        FATAL("TRANSPORT must be SOCKET or SHM.");
+    }
+    if (num_shards == 0 || num_shards > common::ME_MAX_TICKERS || wait_policy == common::WaitPolicy::INVALID) {
+        FATAL("USAGE exchange_main [NUM_MATCHING_ENGINE_SHARDS [FIRST_MATCHING_ENGINE_CORE [REPLAY_JOURNAL "
+              "[BUSY_SPIN|YIELD|PARK]]]] with 1 <= NUM_MATCHING_ENGINE_SHARDS <= " +
+              std::to_string(common::ME_MAX_TICKERS));
+    }
+
+    common::LoadThreadLayout();
+    common::CalibrateCycleClock();
+    latency_reporter = new common::LatencyReporter("exchange_latencies.txt");
+
     logger = new common::Logger("exchange_main.log");
 
     std::signal(SIGINT, SignalHandler);
 
     const int sleep_time = 100 * 1000;
 
-    exchange::ClientRequestLFQueue client_requests(common::ME_MAX_CLIENT_UPDATES);
-    exchange::ClientResponseLFQueue client_responses(common::ME_MAX_CLIENT_UPDATES);
-    exchange::MEMarketUpdateLFQueue market_updates(common::ME_MAX_MARKET_UPDATES);
+    exchange::ShardChannels shard_channels(num_shards);
 
     std::string time_str;
 
-    logger->Log("%:% %() % Starting Matching Engine...\n", __FILE__, __LINE__, __FUNCTION__,
-                common::GetCurrentTimeStr(&time_str));
-    matching_engine = new exchange::MatchingEngine(&client_requests, &client_responses, &market_updates);
-    matching_engine->Start();
+    for (size_t shard_id = 0; shard_id < num_shards; ++shard_id) {
+        const auto core_id = (first_core >= 0 ? first_core + static_cast<int>(shard_id) : -1);
+        logger->Log("%:% %() % Starting Matching Engine shard:% core:%...\n", __FILE__, __LINE__, __FUNCTION__,
+                    common::GetCurrentTimeStr(&time_str), shard_id, core_id);
+        matching_engines.push_back(new exchange::MatchingEngine(shard_id, core_id, &shard_channels, wait_policy));
+    }
 
     const std::string mkt_pub_iface = "lo";
     const std::string snap_pub_ip = "233.252.14.1";
@@ -53,16 +95,28 @@ auto main(int /*unused*/, char ** /*unused*/) -> int {
 
     logger->Log("%:% %() % Starting Market Data Publisher...\n", __FILE__, __LINE__, __FUNCTION__,
                 common::GetCurrentTimeStr(&time_str));
-    market_data_publisher = new exchange::MarketDataPublisher(&market_updates, mkt_pub_iface, snap_pub_ip,
-                                                              snap_pub_port, inc_pub_ip, inc_pub_port);
+    market_data_publisher = new exchange::MarketDataPublisher(
+        &shard_channels, mkt_pub_iface, snap_pub_ip, snap_pub_port, inc_pub_ip, inc_pub_port, wait_policy, transport);
     market_data_publisher->Start();
 
+    // The orders restored from the checkpoints are published as market updates, so the publisher has to be running.
+    for (auto matching_engine : matching_engines) {
+        if (replay_journal) {
+            matching_engine->RestoreCheckpoint();
+        } else {
+            matching_engine->DiscardCheckpoint();
+        }
+        matching_engine->Start();
+    }
+
     const std::string order_gw_iface = "lo";
     const int order_gw_port = 12345;
+    const std::string journal_file = "exchange_requests.journal";
 
     logger->Log("%:% %() % Starting Order Server...\n", __FILE__, __LINE__, __FUNCTION__,
                 common::GetCurrentTimeStr(&time_str));
-    order_server = new exchange::OrderServer(&client_requests, &client_responses, order_gw_iface, order_gw_port);
+    order_server = new exchange::OrderServer(&shard_channels, order_gw_iface, order_gw_port, journal_file,
+                                             replay_journal, wait_policy, transport);
     order_server->Start();
 
     while (true) {
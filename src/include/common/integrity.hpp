@@ -9,7 +9,17 @@
 #include <iostream>
 #include <string>
 
-inline auto ASSERT(bool cond, const std::string &msg) noexcept {
+inline auto ASSERT([[maybe_unused]] bool cond, [[maybe_unused]] const std::string &msg) noexcept {
+#if !defined(NDEBUG)
+    if (!cond) [[unlikely]] {
+        std::cerr << msg << '\n';
+        exit(EXIT_FAILURE);
+    }
+#endif
+}
+
+// Overload for constant messages, which unlike std::string ones cost nothing unless the check fails.
+inline auto ASSERT([[maybe_unused]] bool cond, [[maybe_unused]] const char *msg) noexcept {
 #if !defined(NDEBUG)
     if (!cond) [[unlikely]] {
         std::cerr << msg << '\n';
@@ -0,0 +1,269 @@
+/*
+ * latency_histogram.hpp
+ * Per-thread latency histograms registered by measurement tag, fed by START_MEASURE/END_MEASURE, and a reporter that
+ * periodically writes their percentiles to a file.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "common/integrity.hpp"
+#include "common/perf_utils.hpp"
+#include "runtime/threads.hpp"
+
+namespace common {
+
+/*
+ * Log-linear histogram of latencies in timestamp counter ticks, in the style of HdrHistogram. Values below SUB_BUCKETS
+ * have a bucket each, and every larger power of two range is split into SUB_BUCKETS / 2 equal buckets, so a recorded
+ * latency is off by less than 2 / SUB_BUCKETS, i.e. 6%, of its value, over the whole range of uint64_t.
+ *
+ * A histogram is written by a single thread only, so recording is a handful of instructions with relaxed loads and
+ * stores and no read-modify-write. Other threads read the counts while it is being written to, and may see a sample in
+ * one count but not yet in another.
+ */
+class LatencyHistogram final {
+   public:
+    static constexpr size_t SUB_BUCKET_BITS = 5;
+    static constexpr size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr size_t NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS / 2 + SUB_BUCKETS / 2;
+
+    explicit LatencyHistogram(std::string tag) : TAG(std::move(tag)) {}
+
+    auto Record(uint64_t ticks) noexcept {
+        auto &count = counts_[BucketIndex(ticks)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (ticks > max_.load(std::memory_order_relaxed)) {
+            max_.store(ticks, std::memory_order_relaxed);
+        }
+    }
+
+    auto Tag() const noexcept -> const std::string & { return TAG; }
+
+    auto Count(size_t bucket) const noexcept { return counts_[bucket].load(std::memory_order_relaxed); }
+
+    auto Max() const noexcept { return max_.load(std::memory_order_relaxed); }
+
+    static constexpr auto BucketIndex(uint64_t ticks) noexcept -> size_t {
+        if (ticks < SUB_BUCKETS) {
+            return ticks;
+        }
+        // The top SUB_BUCKET_BITS bits of the value, the leading 1 included, pick the bucket within its power of two.
+        const auto shift = static_cast<size_t>(std::bit_width(ticks)) - SUB_BUCKET_BITS;
+        return shift * (SUB_BUCKETS / 2) + static_cast<size_t>(ticks >> shift);
+    }
+
+    // Largest number of ticks recorded in the bucket.
+    static constexpr auto BucketMax(size_t bucket) noexcept -> uint64_t {
+        if (bucket < SUB_BUCKETS) {
+            return bucket;
+        }
+        const auto shift = bucket / (SUB_BUCKETS / 2) - 1;
+        const auto sub_bucket = bucket % (SUB_BUCKETS / 2) + SUB_BUCKETS / 2;
+        return (static_cast<uint64_t>(sub_bucket + 1) << shift) - 1;
+    }
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    LatencyHistogram() = delete;
+
+    LatencyHistogram(const LatencyHistogram &) = delete;
+
+    LatencyHistogram(const LatencyHistogram &&) = delete;
+
+    auto operator=(const LatencyHistogram &) -> LatencyHistogram & = delete;
+
+    auto operator=(const LatencyHistogram &&) -> LatencyHistogram & = delete;
+
+   private:
+    const std::string TAG;
+
+    std::array<std::atomic<uint64_t>, NUM_BUCKETS> counts_ = {};
+    std::atomic<uint64_t> max_ = {0};
+};
+
+/*
+ * LatencyRegistry owns the LatencyHistograms of the process, one per measurement tag and thread. Histograms are created
+ * on the first measurement of a tag on a thread, and outlive their thread, so that its measurements are still
+ * reported once it has exited.
+ */
+class LatencyRegistry final {
+   public:
+    static auto Instance() noexcept -> LatencyRegistry & {
+        static LatencyRegistry registry;
+        return registry;
+    }
+
+    // Histogram of the tag for the calling thread. Takes a lock, so measurement sites look it up once per thread.
+    auto ThreadHistogram(const char *tag) -> LatencyHistogram * {
+        const std::lock_guard lock(mutex_);
+        const auto thread_id = std::this_thread::get_id();
+        for (const auto &[owner, histogram] : histograms_) {
+            if (owner == thread_id && histogram->Tag() == tag) {
+                return histogram.get();
+            }
+        }
+        return histograms_.emplace_back(thread_id, std::make_unique<LatencyHistogram>(tag)).second.get();
+    }
+
+    // Count and percentiles in nanoseconds of every tag, over the histograms of all threads.
+    auto Report() const {
+        struct Merged {
+            std::vector<uint64_t> counts_ = std::vector<uint64_t>(LatencyHistogram::NUM_BUCKETS);
+            uint64_t total_ = 0;
+            uint64_t max_ = 0;
+        };
+        std::map<std::string, Merged> tags;
+        {
+            const std::lock_guard lock(mutex_);
+            for (const auto &[owner, histogram] : histograms_) {
+                auto &merged = tags[histogram->Tag()];
+                for (size_t bucket = 0; bucket < LatencyHistogram::NUM_BUCKETS; ++bucket) {
+                    merged.counts_[bucket] += histogram->Count(bucket);
+                    merged.total_ += histogram->Count(bucket);
+                }
+                merged.max_ = std::max(merged.max_, histogram->Max());
+            }
+        }
+
+        std::stringstream ss;
+        char line[256];
+        std::snprintf(line, sizeof(line), "%-48s %12s %10s %10s %10s %10s %12s\n", "tag", "count", "p50(ns)", "p90(ns)",
+                      "p99(ns)", "p99.9(ns)", "max(ns)");
+        ss << line;
+        for (const auto &[tag, merged] : tags) {
+            std::snprintf(line, sizeof(line), "%-48s %12lu %10ld %10ld %10ld %10ld %12ld\n", tag.c_str(), merged.total_,
+                          Percentile(merged.counts_, merged.total_, merged.max_, 0.5),
+                          Percentile(merged.counts_, merged.total_, merged.max_, 0.9),
+                          Percentile(merged.counts_, merged.total_, merged.max_, 0.99),
+                          Percentile(merged.counts_, merged.total_, merged.max_, 0.999), CyclesToNanos(merged.max_));
+            ss << line;
+        }
+        return ss.str();
+    }
+
+    // Deleted copy & move constructors and assignment-operators.
+    LatencyRegistry(const LatencyRegistry &) = delete;
+
+    LatencyRegistry(const LatencyRegistry &&) = delete;
+
+    auto operator=(const LatencyRegistry &) -> LatencyRegistry & = delete;
+
+    auto operator=(const LatencyRegistry &&) -> LatencyRegistry & = delete;
+
+   private:
+    mutable std::mutex mutex_;
+    std::vector<std::pair<std::thread::id, std::unique_ptr<LatencyHistogram>>> histograms_;
+
+    LatencyRegistry() = default;
+
+    static auto Percentile(const std::vector<uint64_t> &counts, uint64_t total, uint64_t max, double percentile)
+        -> Nanos {
+        const auto rank = static_cast<uint64_t>(percentile * static_cast<double>(total));
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket < counts.size(); ++bucket) {
+            seen += counts[bucket];
+            if (seen > rank) {
+                return CyclesToNanos(std::min(LatencyHistogram::BucketMax(bucket), max));
+            }
+        }
+        return CyclesToNanos(max);
+    }
+};
+
+/*
+ * LatencyReporter writes the LatencyRegistry report to a file every interval, from a thread of its own, and once more
+ * when it is destroyed. Each report replaces the previous one through a rename, so readers never see a partial report.
+ */
+class LatencyReporter final {
+   public:
+    static constexpr auto THREAD_NAME = "common/LatencyReporter";
+
+    explicit LatencyReporter(const std::string &file_name, std::chrono::seconds interval = std::chrono::seconds(10))
+        : FILE_NAME(file_name), INTERVAL(interval) {
+        thread_ = CreateAndStartThread(-1, THREAD_NAME, [this](std::stop_token stop_token) { Run(stop_token); });
+        ASSERT(thread_ != nullptr, "Failed to start LatencyReporter thread.");
+    }
+
+    ~LatencyReporter() {
+        thread_ = nullptr;
+        WriteReport();
+    }
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    LatencyReporter() = delete;
+
+    LatencyReporter(const LatencyReporter &) = delete;
+
+    LatencyReporter(const LatencyReporter &&) = delete;
+
+    auto operator=(const LatencyReporter &) -> LatencyReporter & = delete;
+
+    auto operator=(const LatencyReporter &&) -> LatencyReporter & = delete;
+
+   private:
+    const std::string FILE_NAME;
+    const std::chrono::seconds INTERVAL;
+
+    std::unique_ptr<ManagedThread> thread_;
+
+    auto Run(std::stop_token stop_token) -> void {
+        std::mutex mutex;
+        std::condition_variable_any stop_requested;
+        std::unique_lock lock(mutex);
+        while (!stop_token.stop_requested()) {
+            // Only returns early once a stop is requested, the destructor writes the final report then.
+            stop_requested.wait_for(lock, stop_token, INTERVAL, [] { return false; });
+            if (!stop_token.stop_requested()) {
+                WriteReport();
+            }
+        }
+    }
+
+    auto WriteReport() const -> void {
+        const auto tmp_file_name = FILE_NAME + ".tmp";
+        {
+            std::ofstream file(tmp_file_name, std::ios::trunc);
+            file << LatencyRegistry::Instance().Report();
+        }
+        std::error_code error;
+        std::filesystem::rename(tmp_file_name, FILE_NAME, error);
+        if (error) {
+            std::cerr << "Failed to write latency report " << FILE_NAME << ": " << error.message() << '\n';
+        }
+    }
+};
+
+}  // namespace common
+
+// Start latency measurement using CycleCountStart(). Creates a variable called TAG in the local scope.
+#define START_MEASURE(TAG) const auto TAG = common::CycleCountStart()
+
+// End latency measurement using CycleCountEnd() and record it in the histogram of TAG for the calling thread. Expects
+// a variable called TAG to already exist in the local scope.
+// Do while forces user to add ; at the end of macro use.
+#define END_MEASURE(TAG)                                                                                            \
+    do {                                                                                                            \
+        const auto end = common::CycleCountEnd();                                                                   \
+        static thread_local auto *const histogram = common::LatencyRegistry::Instance().ThreadHistogram(#TAG);     \
+        histogram->Record(end - (TAG));                                                                             \
+    } while (false)
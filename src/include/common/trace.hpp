@@ -0,0 +1,121 @@
+/*
+ * trace.hpp
+ * Defines the optional trace header carried by client requests, client responses and market updates for tick-to-trade
+ * tracing. Every hop a message passes through stamps its time into the header, and the trade engine logs the complete
+ * trace once the message reaches it, for trace_report to break down offline.
+ *
+ * Tracing is compiled in with the VOTS_TRACING CMake option only, since the header makes every message larger, on the
+ * wire as well, so the exchange and its clients have to be built the same way.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+#include "common/perf_utils.hpp"
+#include "common/time_utils.hpp"
+#include "common/types.hpp"
+
+namespace common {
+
+// Hops in the order messages pass through them. A response to a request, or a market update caused by it, carries the
+// hops of the request as well.
+enum class TraceHop : uint8_t {
+    TE_REQUEST_SEND = 0,      // TradingEngine::SendClientRequest(), the origin of a trace.
+    GW_REQUEST_SEND = 1,      // GatewayClient writes the request to its session.
+    OS_REQUEST_RECV = 2,      // OrderServer reads the request from its session.
+    OS_REQUEST_SEQUENCE = 3,  // FIFOSequencer routes the request to its matching engine shard.
+    ME_REQUEST_RECV = 4,      // MatchingEngine reads the request.
+    ME_RESPONSE_SEND = 5,     // MatchingEngine writes a response to the request.
+    OS_RESPONSE_SEND = 6,     // OrderServer writes the response to its session.
+    GW_RESPONSE_RECV = 7,     // GatewayClient reads the response from its session.
+    TE_RESPONSE_RECV = 8,     // TradingEngine reads the response, right before OnOrderUpdate().
+    ME_UPDATE_SEND = 9,       // MatchingEngine writes a market update caused by the request.
+    MDP_UPDATE_SEND = 10,     // MarketDataPublisher writes the update to its multicast socket.
+    MDC_UPDATE_RECV = 11,     // MarketDataConsumer reads the update from its incremental stream.
+    TE_UPDATE_RECV = 12,      // TradingEngine reads the update, right before OnMarketUpdate().
+    MAX = 13
+};
+
+inline auto TraceHopToString(TraceHop hop) -> std::string {
+    switch (hop) {
+        case TraceHop::TE_REQUEST_SEND:
+            return "TE_REQUEST_SEND";
+        case TraceHop::GW_REQUEST_SEND:
+            return "GW_REQUEST_SEND";
+        case TraceHop::OS_REQUEST_RECV:
+            return "OS_REQUEST_RECV";
+        case TraceHop::OS_REQUEST_SEQUENCE:
+            return "OS_REQUEST_SEQUENCE";
+        case TraceHop::ME_REQUEST_RECV:
+            return "ME_REQUEST_RECV";
+        case TraceHop::ME_RESPONSE_SEND:
+            return "ME_RESPONSE_SEND";
+        case TraceHop::OS_RESPONSE_SEND:
+            return "OS_RESPONSE_SEND";
+        case TraceHop::GW_RESPONSE_RECV:
+            return "GW_RESPONSE_RECV";
+        case TraceHop::TE_RESPONSE_RECV:
+            return "TE_RESPONSE_RECV";
+        case TraceHop::ME_UPDATE_SEND:
+            return "ME_UPDATE_SEND";
+        case TraceHop::MDP_UPDATE_SEND:
+            return "MDP_UPDATE_SEND";
+        case TraceHop::MDC_UPDATE_RECV:
+            return "MDC_UPDATE_RECV";
+        case TraceHop::TE_UPDATE_RECV:
+            return "TE_UPDATE_RECV";
+        case TraceHop::MAX:
+            return "MAX";
+    }
+    return "UNKNOWN";
+}
+
+#pragma pack(push, 1)
+// Time in NowNanos() at which the message passed each hop, 0 for the hops it did not pass.
+struct TraceHeader {
+    std::array<Nanos, static_cast<size_t>(TraceHop::MAX)> hops_ = {};
+    // Client whose request started the trace. Market updates reach every client, but only the originating one logs
+    // their traces, since the first hops were stamped by its processes.
+    ClientId client_id_ = CLIENT_ID_INVALID;
+
+    auto Stamp(TraceHop hop) noexcept { hops_[static_cast<size_t>(hop)] = NowNanos(); }
+
+    auto Passed(TraceHop hop) const noexcept { return hops_[static_cast<size_t>(hop)] != 0; }
+
+    // Comma separated hop times, as parsed by trace_report.
+    auto ToString() const {
+        std::stringstream ss;
+        for (size_t i = 0; i < hops_.size(); ++i) {
+            ss << (i == 0 ? "" : ",") << hops_[i];
+        }
+        return ss.str();
+    }
+};
+#pragma pack(pop)
+
+}  // namespace common
+
+#if defined(VOTS_TRACING)
+// Start a new trace on the client request MSG, dropping the hops of any message it was copied from.
+#define TRACE_START(MSG, HOP)                       \
+    do {                                            \
+        (MSG).trace_ = {};                          \
+        (MSG).trace_.client_id_ = (MSG).client_id_; \
+        (MSG).trace_.Stamp(common::TraceHop::HOP);  \
+    } while (false)
+
+// Stamp the time MSG passes HOP into its trace header.
+#define TRACE_HOP(MSG, HOP) (MSG).trace_.Stamp(common::TraceHop::HOP)
+#else
+#define TRACE_START(MSG, HOP) \
+    do {                      \
+    } while (false)
+
+#define TRACE_HOP(MSG, HOP) \
+    do {                    \
+    } while (false)
+#endif
@@ -0,0 +1,283 @@
+/*
+ * log_record.hpp
+ * Defines the binary records the Logger queues and writes to binary log files, and how they are formatted into text,
+ * by the Logger itself or offline by log_decoder.
+ *
+ * A log record is a LogRecordHeader followed by the arguments of the Log() call. Each argument is its LogType followed
+ * by its value as it is in memory, or for strings by a uint16_t length and the characters. The format string itself is
+ * not copied: the header identifies it by its address, which is the same for every call from the same call site.
+ *
+ * A binary log file starts with LOG_FILE_MAGIC. Before the first record of each format string, it holds a format record
+ * that maps the address of the format string to its text.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "log_type.hpp"
+
+namespace common {
+
+// How a Logger writes its file, picked by the LOG_FORMAT environment variable.
+enum class LogFileFormat : int8_t { INVALID = 0, TEXT = 1, BINARY = 2, MAX = 3 };
+
+inline auto LogFileFormatToString(LogFileFormat log_file_format) -> std::string {
+    switch (log_file_format) {
+        case LogFileFormat::TEXT:
+            return "TEXT";
+        case LogFileFormat::BINARY:
+            return "BINARY";
+        case LogFileFormat::INVALID:
+            return "INVALID";
+        case LogFileFormat::MAX:
+            return "MAX";
+    }
+
+    return "UNKNOWN";
+}
+
+inline auto StringToLogFileFormat(const std::string &str) -> LogFileFormat {
+    for (auto i = static_cast<int>(LogFileFormat::INVALID); i <= static_cast<int>(LogFileFormat::MAX); ++i) {
+        const auto log_file_format = static_cast<LogFileFormat>(i);
+        if (LogFileFormatToString(log_file_format) == str) {
+            return log_file_format;
+        }
+    }
+
+    return LogFileFormat::INVALID;
+}
+
+// Log file format named by the LOG_FORMAT environment variable, TEXT if it is not set.
+inline auto GetLogFileFormat() -> LogFileFormat {
+    const auto log_file_format = std::getenv("LOG_FORMAT");
+    return (log_file_format != nullptr && *log_file_format != '\0' ? StringToLogFileFormat(log_file_format)
+                                                                     : LogFileFormat::TEXT);
+}
+
+constexpr char LOG_FILE_MAGIC[8] = {'V', 'O', 'T', 'S', 'L', 'O', 'G', '1'};
+
+// num_args_ of a format record, whose header is followed by the text of the format string instead of arguments.
+constexpr uint32_t LOG_FORMAT_RECORD = std::numeric_limits<uint32_t>::max();
+
+// Longer string arguments are truncated.
+constexpr size_t LOG_MAX_STRING_SIZE = std::numeric_limits<uint16_t>::max();
+
+struct LogRecordHeader {
+    uint32_t size_;       // of the whole record, header included.
+    uint32_t num_args_;   // or LOG_FORMAT_RECORD.
+    uint64_t format_id_;  // address of the format string in the process that logged the record.
+};
+static_assert(sizeof(LogRecordHeader) == 16);
+
+// Types a record stores arguments as. Arguments of other types convert to one of them the way they would in a call to
+// an overloaded function, e.g. bool, short and enums to int.
+constexpr auto LogArgOf(char value) noexcept { return value; }
+
+constexpr auto LogArgOf(int value) noexcept { return value; }
+
+constexpr auto LogArgOf(long value) noexcept { return value; }
+
+constexpr auto LogArgOf(long long value) noexcept { return value; }
+
+constexpr auto LogArgOf(unsigned value) noexcept { return value; }
+
+constexpr auto LogArgOf(unsigned long value) noexcept { return value; }
+
+constexpr auto LogArgOf(unsigned long long value) noexcept { return value; }
+
+constexpr auto LogArgOf(float value) noexcept { return value; }
+
+constexpr auto LogArgOf(double value) noexcept { return value; }
+
+inline auto LogArgOf(const char *value) noexcept { return std::string_view(value); }
+
+inline auto LogArgOf(const std::string &value) noexcept { return std::string_view(value); }
+
+template <typename T>
+constexpr auto LogTypeOf() noexcept {
+    if constexpr (std::is_same_v<T, char>) {
+        return LogType::CHAR;
+    } else if constexpr (std::is_same_v<T, int>) {
+        return LogType::INTEGER;
+    } else if constexpr (std::is_same_v<T, long>) {
+        return LogType::LONG_INTEGER;
+    } else if constexpr (std::is_same_v<T, long long>) {
+        return LogType::LONG_LONG_INTEGER;
+    } else if constexpr (std::is_same_v<T, unsigned>) {
+        return LogType::UNSIGNED_INTEGER;
+    } else if constexpr (std::is_same_v<T, unsigned long>) {
+        return LogType::UNSIGNED_LONG_INTEGER;
+    } else if constexpr (std::is_same_v<T, unsigned long long>) {
+        return LogType::UNSIGNED_LONG_LONG_INTEGER;
+    } else if constexpr (std::is_same_v<T, float>) {
+        return LogType::FLOAT;
+    } else if constexpr (std::is_same_v<T, double>) {
+        return LogType::DOUBLE;
+    } else {
+        static_assert(std::is_same_v<T, std::string_view>, "Unsupported log argument type.");
+        return LogType::STRING;
+    }
+}
+
+// Size of an argument returned by LogArgOf() in a record.
+template <typename T>
+constexpr auto EncodedLogArgSize(const T &arg) noexcept -> size_t {
+    if constexpr (std::is_same_v<T, std::string_view>) {
+        return sizeof(LogType) + sizeof(uint16_t) + std::min(arg.size(), LOG_MAX_STRING_SIZE);
+    } else {
+        return sizeof(LogType) + sizeof(T);
+    }
+}
+
+// Writes an argument returned by LogArgOf() to dst, which has room for EncodedLogArgSize(arg) bytes, and returns the
+// end of it.
+template <typename T>
+inline auto EncodeLogArg(std::byte *dst, const T &arg) noexcept -> std::byte * {
+    constexpr auto type = LogTypeOf<T>();
+    std::memcpy(dst, &type, sizeof(type));
+    dst += sizeof(type);
+    if constexpr (std::is_same_v<T, std::string_view>) {
+        const auto size = static_cast<uint16_t>(std::min(arg.size(), LOG_MAX_STRING_SIZE));
+        std::memcpy(dst, &size, sizeof(size));
+        std::memcpy(dst + sizeof(size), arg.data(), size);
+        return dst + sizeof(size) + size;
+    } else {
+        std::memcpy(dst, &arg, sizeof(arg));
+        return dst + sizeof(arg);
+    }
+}
+
+/*
+ * Format string of a Log() call with arguments of types A. Only constructible from a string literal at compile time,
+ * which checks that the format has a % for every argument, and whose address identifies the format in log records.
+ */
+template <typename... A>
+class LogFormatString final {
+   public:
+    template <size_t N>
+    consteval LogFormatString(const char (&format)[N]) : format_(format) {  // NOLINT: implicit from literals.
+        if (CountPlaceholders(format) != sizeof...(A)) {
+            LogFormatDoesNotMatchArguments();
+        }
+    }
+
+    auto Get() const noexcept { return format_; }
+
+   private:
+    const char *format_;
+
+    // %% is an escaped %, every other % is a placeholder.
+    static consteval auto CountPlaceholders(const char *format) -> size_t {
+        size_t count = 0;
+        for (; *format != '\0'; ++format) {
+            if (*format == '%') {
+                if (*(format + 1) == '%') {
+                    ++format;
+                } else {
+                    ++count;
+                }
+            }
+        }
+        return count;
+    }
+
+    // Not constexpr, so calling it fails the compilation of a mismatched format and names the problem.
+    static auto LogFormatDoesNotMatchArguments() -> void {}
+};
+
+namespace internal {
+
+template <typename T>
+inline auto ReadLogArgValue(const std::byte **pos, const std::byte *end, std::ostream &out) -> bool {
+    if (end - *pos < static_cast<std::ptrdiff_t>(sizeof(T))) {
+        return false;
+    }
+    T value;
+    std::memcpy(&value, *pos, sizeof(value));
+    *pos += sizeof(value);
+    out << value;
+    return true;
+}
+
+// Writes the next argument at *pos to out and moves *pos past it. Returns false if it is not a valid argument.
+inline auto ReadLogArg(const std::byte **pos, const std::byte *end, std::ostream &out) -> bool {
+    if (*pos == end) {
+        return false;
+    }
+    LogType type;
+    std::memcpy(&type, *pos, sizeof(type));
+    *pos += sizeof(type);
+    switch (type) {
+        case LogType::CHAR:
+            return ReadLogArgValue<char>(pos, end, out);
+        case LogType::INTEGER:
+            return ReadLogArgValue<int>(pos, end, out);
+        case LogType::LONG_INTEGER:
+            return ReadLogArgValue<long>(pos, end, out);
+        case LogType::LONG_LONG_INTEGER:
+            return ReadLogArgValue<long long>(pos, end, out);
+        case LogType::UNSIGNED_INTEGER:
+            return ReadLogArgValue<unsigned>(pos, end, out);
+        case LogType::UNSIGNED_LONG_INTEGER:
+            return ReadLogArgValue<unsigned long>(pos, end, out);
+        case LogType::UNSIGNED_LONG_LONG_INTEGER:
+            return ReadLogArgValue<unsigned long long>(pos, end, out);
+        case LogType::FLOAT:
+            return ReadLogArgValue<float>(pos, end, out);
+        case LogType::DOUBLE:
+            return ReadLogArgValue<double>(pos, end, out);
+        case LogType::STRING: {
+            uint16_t size;
+            if (end - *pos < static_cast<std::ptrdiff_t>(sizeof(size))) {
+                return false;
+            }
+            std::memcpy(&size, *pos, sizeof(size));
+            *pos += sizeof(size);
+            if (end - *pos < size) {
+                return false;
+            }
+            out.write(reinterpret_cast<const char *>(*pos), size);
+            *pos += size;
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace internal
+
+// Writes the text of a log record to out: its format with every % replaced by the next argument and every %% by %.
+// Returns false if the arguments do not match the format.
+inline auto FormatLogRecord(std::ostream &out, std::string_view format, std::span<const std::byte> args) -> bool {
+    const auto *pos = args.data();
+    const auto *const end = args.data() + args.size();
+    size_t literal_start = 0;
+    for (size_t i = 0; i < format.size(); ++i) {
+        if (format[i] != '%') {
+            continue;
+        }
+        out.write(format.data() + literal_start, static_cast<std::streamsize>(i - literal_start));
+        if (i + 1 < format.size() && format[i + 1] == '%') {
+            literal_start = ++i;  // to allow %% -> % escape character.
+        } else {
+            if (!internal::ReadLogArg(&pos, end, out)) {
+                return false;
+            }
+            literal_start = i + 1;
+        }
+    }
+    out.write(format.data() + literal_start, static_cast<std::streamsize>(format.size() - literal_start));
+    return pos == end;
+}
+
+}  // namespace common
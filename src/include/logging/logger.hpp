@@ -5,94 +5,71 @@
 
 #pragma once
 
-#include <cstdio>
+#include <algorithm>
+#include <cstdint>
 #include <cstring>
 #include <fstream>
+#include <span>
 #include <string>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
 
 #include "common/integrity.hpp"
 #include "common/time_utils.hpp"
-#include "log_type.hpp"
+#include "log_record.hpp"
 #include "runtime/lock_free_queue.hpp"
 #include "runtime/threads.hpp"
 
 namespace common {
 
+// In bytes. A record takes 16 bytes, plus the type and value of each of its arguments.
 constexpr size_t LOG_QUEUE_SIZE = 8 * 1024 * 1024;
 
 /*
  * Logger is a fixed-sized, asynchronous logging framework that supports a few primitive types and some basic message
  * formatting. Uses a lock-free queue for efficient communication (i.e. context switch free) with the background thread.
+ *
+ * Log() only copies the address of its format string and the values of its arguments into a single record in the queue
+ * (see log_record.hpp), the format string is parsed by the background thread. Depending on LOG_FORMAT, it formats the
+ * records into the text of the log file, or writes them as they are to FILE_NAME.bin, for log_decoder to format later.
  */
 class Logger final {
    public:
-    struct Element {
-        // Although variants are a modern abstraction of this logic, they offer less runtime performance than manually
-        // managing a union.
-        LogType type_ = LogType::CHAR;
-        union {
-            char c_;
-            int i_;
-            long l_;
-            long long ll_;
-            unsigned u_;
-            unsigned long ul_;
-            unsigned long long ull_;
-            float f_;
-            double d_;
-            char s_[256];
-        } u_;
-    };
-
-    auto FlushQueue() noexcept {
-        while (running_) {
-            for (auto next = queue_.GetNextToRead(); queue_.Size() != 0 && (next != nullptr);
-                 next = queue_.GetNextToRead()) {
-                switch (next->type_) {
-                    case LogType::CHAR:
-                        file_ << next->u_.c_;
-                        break;
-                    case LogType::INTEGER:
-                        file_ << next->u_.i_;
-                        break;
-                    case LogType::LONG_INTEGER:
-                        file_ << next->u_.l_;
-                        break;
-                    case LogType::LONG_LONG_INTEGER:
-                        file_ << next->u_.ll_;
-                        break;
-                    case LogType::UNSIGNED_INTEGER:
-                        file_ << next->u_.u_;
-                        break;
-                    case LogType::UNSIGNED_LONG_INTEGER:
-                        file_ << next->u_.ul_;
-                        break;
-                    case LogType::UNSIGNED_LONG_LONG_INTEGER:
-                        file_ << next->u_.ull_;
-                        break;
-                    case LogType::FLOAT:
-                        file_ << next->u_.f_;
-                        break;
-                    case LogType::DOUBLE:
-                        file_ << next->u_.d_;
-                        break;
-                    case LogType::STRING:
-                        file_ << next->u_.s_;
-                        break;
-                }
-                queue_.UpdateReadIndex();
+    // Writes queued records out until a stop is requested, and then once more, so that nothing logged before the
+    // stop request is lost.
+    auto FlushQueue(std::stop_token stop_token) noexcept {
+        for (auto stopping = false; !stopping;) {
+            stopping = stop_token.stop_requested();
+            for (auto bytes = queue_.GetAllToRead(); !bytes.empty(); bytes = queue_.GetAllToRead()) {
+                ReadRecords(bytes);
+                queue_.UpdateReadIndex(bytes.size());
             }
             file_.flush();
 
-            using namespace std::literals::chrono_literals;
-            std::this_thread::sleep_for(10ms);
+            if (!stopping) {
+                using namespace std::literals::chrono_literals;
+                std::this_thread::sleep_for(10ms);
+            }
         }
     }
 
-    explicit Logger(const std::string &file_name) : FILE_NAME(file_name), queue_(LOG_QUEUE_SIZE) {
-        file_.open(file_name);
+    explicit Logger(const std::string &file_name)
+        : FILE_NAME(file_name), FILE_FORMAT(GetLogFileFormat()), queue_(LOG_QUEUE_SIZE) {
+        if (FILE_FORMAT == LogFileFormat::INVALID) {
+            FATAL("LOG_FORMAT must be TEXT or BINARY.");
+        }
+        if (FILE_FORMAT == LogFileFormat::BINARY) {
+            file_.open(file_name + ".bin", std::ios::binary);
+            file_.write(LOG_FILE_MAGIC, sizeof(LOG_FILE_MAGIC));
+        } else {
+            file_.open(file_name);
+        }
         ASSERT(file_.is_open(), "Could not open log file:" + file_name);
-        logger_thread_ = CreateAndStartThread(-1, "common/Logger " + FILE_NAME, [this]() { FlushQueue(); });
+        record_.reserve(4096);
+        pending_.reserve(4096);
+        logger_thread_ = CreateAndStartThread(-1, "common/Logger/" + FILE_NAME,
+                                              [this](std::stop_token stop_token) { FlushQueue(stop_token); });
         ASSERT(logger_thread_ != nullptr, "Failed to start Logger thread.");
     }
 
@@ -100,106 +77,127 @@ class Logger final {
         std::string time_str;
         std::cerr << common::GetCurrentTimeStr(&time_str) << " Flushing and closing Logger for " << FILE_NAME << '\n';
 
-        while (queue_.Size() != 0) {
-            using namespace std::literals::chrono_literals;
-            std::this_thread::sleep_for(1s);
-        }
-        running_ = false;
-        logger_thread_->join();
+        logger_thread_ = nullptr;
 
         file_.close();
         std::cerr << common::GetCurrentTimeStr(&time_str) << " Logger for " << FILE_NAME << " exiting." << '\n';
     }
 
-    auto PushValue(const Element &log_element) noexcept {
-        *(queue_.GetNextToWriteTo()) = log_element;
-        queue_.UpdateWriteIndex();
+    // Replaces every % in the format with the next argument, %% is an escaped %. The format has to be a string literal
+    // with a % for every argument, which is checked at compile time.
+    template <typename... A>
+    auto Log(LogFormatString<std::type_identity_t<A>...> format, const A &...args) noexcept {
+        PushRecord(format.Get(), LogArgOf(args)...);
     }
 
-    auto PushValue(const char value) noexcept { PushValue(Element{.type_ = LogType::CHAR, .u_ = {.c_ = value}}); }
+    // Deleted default, copy & move constructors and assignment-operators.
+    Logger() = delete;
 
-    auto PushValue(const int value) noexcept { PushValue(Element{.type_ = LogType::INTEGER, .u_ = {.i_ = value}}); }
+    Logger(const Logger &) = delete;
 
-    auto PushValue(const long value) noexcept {
-        PushValue(Element{.type_ = LogType::LONG_INTEGER, .u_ = {.l_ = value}});
-    }
+    Logger(const Logger &&) = delete;
 
-    auto PushValue(const long long value) noexcept {
-        PushValue(Element{.type_ = LogType::LONG_LONG_INTEGER, .u_ = {.ll_ = value}});
-    }
+    auto operator=(const Logger &) -> Logger & = delete;
 
-    auto PushValue(const unsigned value) noexcept {
-        PushValue(Element{.type_ = LogType::UNSIGNED_INTEGER, .u_ = {.u_ = value}});
-    }
+    auto operator=(const Logger &&) -> Logger & = delete;
 
-    auto PushValue(const unsigned long value) noexcept {
-        PushValue(Element{.type_ = LogType::UNSIGNED_LONG_INTEGER, .u_ = {.ul_ = value}});
-    }
+   private:
+    const std::string FILE_NAME;
+    const LogFileFormat FILE_FORMAT;
+    std::ofstream file_;
 
-    auto PushValue(const unsigned long long value) noexcept {
-        PushValue(Element{.type_ = LogType::UNSIGNED_LONG_LONG_INTEGER, .u_ = {.ull_ = value}});
+    LockFreeQueue<std::byte> queue_;
+    std::unique_ptr<ManagedThread> logger_thread_;
+
+    // Used by the thread that logs only, for records the queue cannot take in one contiguous piece.
+    std::vector<std::byte> record_;
+
+    // Used by the background thread only, for the part of a record read so far, and for the formats written to a
+    // binary log so far.
+    std::vector<std::byte> pending_;
+    std::unordered_set<uint64_t> formats_;
+
+    template <typename... A>
+    auto PushRecord(const char *format, const A &...args) noexcept {
+        const auto size = sizeof(LogRecordHeader) + (EncodedLogArgSize(args) + ... + 0);
+        auto free = queue_.GetNextToWriteTo(size);
+        if (free.size() == size) [[likely]] {
+            EncodeRecord(free.data(), size, format, args...);
+            queue_.AdvanceWriteIndex(size);
+        } else {  // the free slots wrap around the end of the queue, or the queue is almost full.
+            record_.resize(size);
+            EncodeRecord(record_.data(), size, format, args...);
+            for (size_t written = 0; written < size; written += free.size()) {
+                free = queue_.GetNextToWriteTo(size - written);
+                std::memcpy(free.data(), record_.data() + written, free.size());
+                queue_.AdvanceWriteIndex(free.size());
+            }
+        }
+        queue_.PublishWriteIndex();
     }
 
-    auto PushValue(const float value) noexcept { PushValue(Element{.type_ = LogType::FLOAT, .u_ = {.f_ = value}}); }
-
-    auto PushValue(const double value) noexcept { PushValue(Element{.type_ = LogType::DOUBLE, .u_ = {.d_ = value}}); }
+    template <typename... A>
+    static auto EncodeRecord(std::byte *dst, size_t size, const char *format, const A &...args) noexcept {
+        const LogRecordHeader header{.size_ = static_cast<uint32_t>(size),
+                                     .num_args_ = sizeof...(A),
+                                     .format_id_ = reinterpret_cast<uintptr_t>(format)};
+        std::memcpy(dst, &header, sizeof(header));
+        dst += sizeof(header);
+        ((dst = EncodeLogArg(dst, args)), ...);
+    }
 
-    auto PushValue(const char *value) noexcept {
-        Element l{.type_=LogType::STRING, .u_={.s_ = {}}};
-        strncpy(l.u_.s_, value, sizeof(l.u_.s_) - 1);
-        PushValue(l);
+    static auto RecordSize(const std::byte *record) noexcept {
+        LogRecordHeader header;
+        std::memcpy(&header, record, sizeof(header));
+        return static_cast<size_t>(header.size_);
     }
 
-    auto PushValue(const std::string &value) noexcept { PushValue(value.c_str()); }
-
-    template <typename T, typename... A>
-    auto Log(const char *s, const T &value, A... args) noexcept {
-        while (*s) {
-            if (*s == '%') {
-                if (*(s + 1) == '%') [[unlikely]] {  // to allow %% -> % escape character.
-                    ++s;
-                } else {
-                    PushValue(value);     // substitute % with the value specified in the arguments.
-                    Log(s + 1, args...);  // pop an argument and call self recursively.
-                    return;
-                }
+    // Writes out every complete record in bytes. A record that continues past the end of bytes, since it wraps around
+    // the end of the queue or was only partly published, is gathered in pending_ until the rest of it is read.
+    auto ReadRecords(std::span<const std::byte> bytes) noexcept -> void {
+        while (!bytes.empty()) {
+            const auto whole = (bytes.size() >= sizeof(LogRecordHeader) && RecordSize(bytes.data()) <= bytes.size());
+            if (pending_.empty() && whole) [[likely]] {
+                WriteRecord(bytes.data());
+                bytes = bytes.subspan(RecordSize(bytes.data()));
+                continue;
             }
-            PushValue(*s++);
-        }
-        FATAL("extra arguments provided to log()");
-    }
 
-    auto Log(const char *s) noexcept {
-        while (*s != 0U) {
-            if (*s == '%') {
-                if (*(s + 1) == '%') [[unlikely]] {  // to allow %% -> % escape character.
-                    ++s;
-                } else {
-                    FATAL("missing arguments to log()");
-                }
+            const auto needed = (pending_.size() < sizeof(LogRecordHeader) ? sizeof(LogRecordHeader)
+                                                                             : RecordSize(pending_.data())) -
+                                pending_.size();
+            const auto count = std::min(needed, bytes.size());
+            pending_.insert(pending_.end(), bytes.begin(), bytes.begin() + static_cast<std::ptrdiff_t>(count));
+            bytes = bytes.subspan(count);
+            if (pending_.size() >= sizeof(LogRecordHeader) && pending_.size() == RecordSize(pending_.data())) {
+                WriteRecord(pending_.data());
+                pending_.clear();
             }
-            PushValue(*s++);
         }
     }
 
-    // Deleted default, copy & move constructors and assignment-operators.
-    Logger() = delete;
-
-    Logger(const Logger &) = delete;
-
-    Logger(const Logger &&) = delete;
-
-    auto operator=(const Logger &) -> Logger & = delete;
-
-    auto operator=(const Logger &&) -> Logger & = delete;
-
-   private:
-    const std::string FILE_NAME;
-    std::ofstream file_;
+    auto WriteRecord(const std::byte *record) noexcept -> void {
+        LogRecordHeader header;
+        std::memcpy(&header, record, sizeof(header));
+        const auto *format = reinterpret_cast<const char *>(header.format_id_);
+
+        if (FILE_FORMAT == LogFileFormat::BINARY) {
+            if (formats_.insert(header.format_id_).second) {
+                const auto format_size = std::strlen(format);
+                const LogRecordHeader format_header{.size_ = static_cast<uint32_t>(sizeof(header) + format_size),
+                                                    .num_args_ = LOG_FORMAT_RECORD,
+                                                    .format_id_ = header.format_id_};
+                file_.write(reinterpret_cast<const char *>(&format_header), sizeof(format_header));
+                file_.write(format, static_cast<std::streamsize>(format_size));
+            }
+            file_.write(reinterpret_cast<const char *>(record), header.size_);
+            return;
+        }
 
-    LockFreeQueue<Element> queue_;
-    std::atomic<bool> running_ = {true};
-    std::thread *logger_thread_ = nullptr;
+        if (!FormatLogRecord(file_, format, {record + sizeof(header), header.size_ - sizeof(header)})) [[unlikely]] {
+            FATAL("Malformed log record in:" + FILE_NAME);
+        }
+    }
 };
 
 }  // namespace common
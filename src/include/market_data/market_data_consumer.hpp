@@ -1,7 +1,8 @@
 /*
  * market_data_consumer.hpp
  * Define the market participant component responsible for subscribing to the trading exchange public data streams.
- * Subscribes to the snapshot stream only if the market participant becomes unsynchronized until synchronization.
+ * Subscribes to the snapshot stream only if the market participant becomes unsynchronized until synchronization. When
+ * co-located with the exchange, the incremental stream can be read from shared memory instead of multicast.
  */
 
 #pragma once
@@ -12,8 +13,10 @@
 #include "common/integrity.hpp"
 #include "market_update.hpp"
 #include "network/mcast_socket.hpp"
+#include "network/shm_transport.hpp"
 #include "runtime/lock_free_queue.hpp"
 #include "runtime/threads.hpp"
+#include "runtime/wait_strategy.hpp"
 
 namespace trading {
 
@@ -21,22 +24,18 @@ class MarketDataConsumer {
    public:
     MarketDataConsumer(common::ClientId client_id, exchange::MEMarketUpdateLFQueue *market_updates,
                        const std::string &iface, const std::string &snapshot_ip, int snapshot_port,
-                       const std::string &incremental_ip, int incremental_port);
+                       const std::string &incremental_ip, int incremental_port, common::WaitPolicy wait_policy,
+                       common::Transport transport);
 
-    ~MarketDataConsumer() {
-        Stop();
-
-        using namespace std::literals::chrono_literals;
-        std::this_thread::sleep_for(5s);
-    }
+    ~MarketDataConsumer() { Stop(); }
 
     void Start() {
-        run_ = true;
-        ASSERT(common::CreateAndStartThread(-1, "Trading/MarketDataConsumer", [this]() { Run(); }) != nullptr,
-               "Failed to start MarketData thread.");
+        thread_ =
+            common::CreateAndStartThread(-1, THREAD_NAME, [this](std::stop_token stop_token) { Run(stop_token); });
+        ASSERT(thread_ != nullptr, "Failed to start MarketData thread.");
     }
 
-    void Stop() { run_ = false; }
+    void Stop() { thread_ = nullptr; }
 
     // Deleted default, copy & move constructors and assignment-operators.
     MarketDataConsumer() = delete;
@@ -50,10 +49,16 @@ class MarketDataConsumer {
     auto operator=(const MarketDataConsumer &&) -> MarketDataConsumer & = delete;
 
    private:
+    static constexpr auto THREAD_NAME = "Trading/MarketDataConsumer";
+
     size_t next_exp_inc_seq_num_ = 1;
     exchange::MEMarketUpdateLFQueue *incoming_md_updates_ = nullptr;
 
-    volatile bool run_ = false;
+    std::unique_ptr<common::ManagedThread> thread_;
+    common::WaitStrategy wait_strategy_;
+
+    // Stop token of the thread running Run(), which stops the updates from waiting for room in a full queue.
+    std::stop_token stop_token_;
 
     std::string time_str_;
     common::Logger logger_;
@@ -63,6 +68,11 @@ class MarketDataConsumer {
     const std::string IFACE, SNAPSHOT_IP;
     const int SNAPSHOT_PORT;
 
+    // Incremental stream when read from shared memory, and the index of the next update to read from it.
+    const common::Transport TRANSPORT;
+    exchange::MDPMarketUpdateShmRing shm_incremental_;
+    uint64_t shm_incremental_read_index_ = 0;
+
     /*
      * During synchronization effort, stores received message in order fashion. Though std::map is inefficiently
      * implemented, the market participant cannot trade with an unsynchronized orderbook anyway. Moreover, the latency
@@ -72,10 +82,16 @@ class MarketDataConsumer {
     QueuedMarketUpdates snapshot_queued_msgs_, incremental_queued_msgs_;
 
    private:
-    void Run() noexcept;
+    void Run(std::stop_token stop_token) noexcept;
 
     void RecvCallback(common::McastSocket *socket) noexcept;
 
+    // Read the updates of the shared memory incremental stream. Returns whether there were any.
+    auto RecvShm() noexcept -> bool;
+
+    // Process a market update read from the snapshot or the incremental stream, without publishing it yet.
+    void OnMarketUpdate(bool is_snapshot, const exchange::MDPMarketUpdate *request) noexcept;
+
     auto QueueMessage(bool is_snapshot, const exchange::MDPMarketUpdate *request);
 
     void StartSnapshotSync();
@@ -5,43 +5,54 @@
  * incremental stream; UDP helps achieve the ultra low-latency need of sharing updates with participants as quickly as
  * possible. To allow participants to synchronize with the trading exchange, the market data publisher also compiles
  * data and occasionally pushes a large snapshot via the snapshot stream.
+ *
+ * Every incremental update is written once into a broadcast ring, sent from there, and read in place by the snapshot
+ * synthesizer and any other tap that is given a reader cursor of the ring. With Transport::SHM, the incremental stream
+ * is also written to a shared memory broadcast ring for co-located participants.
  */
 
 #pragma once
 
 #include <functional>
 
+#include "matching_engine/shard_channels.hpp"
+#include "network/shm_transport.hpp"
 #include "snapshot_synthesizer.hpp"
 
 namespace exchange {
 class MarketDataPublisher {
    public:
-    MarketDataPublisher(MEMarketUpdateLFQueue *market_updates, const std::string &iface, const std::string &snapshot_ip,
-                        int snapshot_port, const std::string &incremental_ip, int incremental_port);
+    // Reader cursors of md_updates_.
+    static constexpr size_t MD_READER_SNAPSHOT = 0;
+    static constexpr size_t NUM_MD_READERS = 1;
+
+    MarketDataPublisher(ShardChannels *shard_channels, const std::string &iface, const std::string &snapshot_ip,
+                        int snapshot_port, const std::string &incremental_ip, int incremental_port,
+                        common::WaitPolicy wait_policy, common::Transport transport);
 
     ~MarketDataPublisher() {
         Stop();
 
-        using namespace std::literals::chrono_literals;
-        std::this_thread::sleep_for(5s);
-
         delete snapshot_synthesizer_;
         snapshot_synthesizer_ = nullptr;
     }
 
-    void Run() noexcept;
+    void Run(std::stop_token stop_token) noexcept;
 
-    void Start() {
-        run_ = true;
+    // Logs when a reader of md_updates_ falls more than half the ring behind, as the publisher soon waits for it.
+    void CheckMarketUpdateReaders() noexcept;
 
-        ASSERT(common::CreateAndStartThread(-1, "exchange/MarketDataPublisher", [this]() { Run(); }) != nullptr,
-               "Failed to start MarketData thread.");
+    void Start() {
+        thread_ =
+            common::CreateAndStartThread(-1, THREAD_NAME, [this](std::stop_token stop_token) { Run(stop_token); });
+        ASSERT(thread_ != nullptr, "Failed to start MarketData thread.");
 
         snapshot_synthesizer_->Start();
     }
 
+    // The publisher is stopped first, since it waits for the snapshot synthesizer whenever md_updates_ is full.
     void Stop() {
-        run_ = false;
+        thread_ = nullptr;
 
         snapshot_synthesizer_->Stop();
     }
@@ -58,12 +69,18 @@ class MarketDataPublisher {
     auto operator=(const MarketDataPublisher &&) -> MarketDataPublisher & = delete;
 
    private:
+    static constexpr auto THREAD_NAME = "exchange/MarketDataPublisher";
+
     size_t next_inc_seq_num_ = 1;
-    MEMarketUpdateLFQueue *outgoing_md_updates_ = nullptr;
+    // Market updates of all matching engine shards, merged in request sequence order.
+    MarketUpdateMerger outgoing_md_updates_;
 
-    MDPMarketUpdateLFQueue snapshot_md_updates_;
+    // Incremental updates as sent, for the readers that follow the incremental stream internally.
+    MDPMarketUpdateBroadcastQueue md_updates_;
+    bool md_reader_lagging_ = false;
 
-    volatile bool run_ = false;
+    std::unique_ptr<common::ManagedThread> thread_;
+    common::WaitStrategy wait_strategy_;
 
     std::string time_str_;
 
@@ -71,6 +88,10 @@ class MarketDataPublisher {
 
     common::McastSocket incremental_socket_;
 
+    // Incremental stream for co-located participants, see network/shm_transport.hpp.
+    const common::Transport TRANSPORT;
+    MDPMarketUpdateShmRing shm_incremental_;
+
     SnapshotSynthesizer *snapshot_synthesizer_ = nullptr;
 };
 
@@ -8,8 +8,11 @@
 
 #include <sstream>
 
+#include "common/trace.hpp"
 #include "common/types.hpp"
+#include "runtime/broadcast_queue.hpp"
 #include "runtime/lock_free_queue.hpp"
+#include "runtime/shm_ring.hpp"
 
 namespace exchange {
 
@@ -56,6 +59,10 @@ struct MEMarketUpdate {
     common::Price price_ = common::PRICE_INVALID;
     common::Qty qty_ = common::QTY_INVALID;
     common::Priority priority_ = common::PRIORITY_INVALID;
+#if defined(VOTS_TRACING)
+    // Mutable, since hops stamp the messages they only read, e.g. straight from a queue or socket buffer.
+    mutable common::TraceHeader trace_ = {};
+#endif
 
     auto ToString() const {
         std::stringstream ss;
@@ -85,6 +92,7 @@ struct MDPMarketUpdate {
 #pragma pack(pop)
 
 using MEMarketUpdateLFQueue = common::LockFreeQueue<MEMarketUpdate>;
-using MDPMarketUpdateLFQueue = common::LockFreeQueue<MDPMarketUpdate>;
+using MDPMarketUpdateBroadcastQueue = common::BroadcastQueue<MDPMarketUpdate>;
+using MDPMarketUpdateShmRing = common::ShmBroadcastRing<MDPMarketUpdate>;
 
 }  // namespace exchange
@@ -2,7 +2,8 @@
  * snapshot_synthesizer.hpp
  * Aggregates messages from the matching engine into snapshots that are occasionally pushed via the multicast snapshot
  * stream for market participants to synchronize their data with the trading exchange. Runs in its own thread as the
- * market data publisher needs to achieve very low latency for the incremental stream.
+ * market data publisher needs to achieve very low latency for the incremental stream. Its thread parks while there
+ * are no updates, as snapshots are only published every minute.
  */
 
 #pragma once
@@ -16,12 +17,13 @@
 #include "runtime/lock_free_queue.hpp"
 #include "runtime/memory_pool.hpp"
 #include "runtime/threads.hpp"
+#include "runtime/wait_strategy.hpp"
 
 namespace exchange {
 
 class SnapshotSynthesizer {
    public:
-    SnapshotSynthesizer(MDPMarketUpdateLFQueue *market_updates, const std::string &iface,
+    SnapshotSynthesizer(MDPMarketUpdateBroadcastQueue *market_updates, size_t reader, const std::string &iface,
                         const std::string &snapshot_ip, int snapshot_port);
 
     ~SnapshotSynthesizer();
@@ -34,7 +36,7 @@ class SnapshotSynthesizer {
 
     auto PublishSnapshot();
 
-    void Run();
+    void Run(std::stop_token stop_token);
 
     // Deleted default, copy & move constructors and assignment-operators.
     SnapshotSynthesizer() = delete;
@@ -48,11 +50,16 @@ class SnapshotSynthesizer {
     auto operator=(const SnapshotSynthesizer &&) -> SnapshotSynthesizer & = delete;
 
    private:
-    MDPMarketUpdateLFQueue *snapshot_md_updates_ = nullptr;
+    static constexpr auto THREAD_NAME = "exchange/SnapshotSynthesizer";
+
+    // Incremental market updates as sent by the market data publisher, read through the reader cursor md_reader_.
+    MDPMarketUpdateBroadcastQueue *md_updates_ = nullptr;
+    size_t md_reader_ = 0;
 
     common::Logger logger_;
 
-    volatile bool run_ = false;
+    std::unique_ptr<common::ManagedThread> thread_;
+    common::WaitStrategy wait_strategy_;
 
     std::string time_str_;
 
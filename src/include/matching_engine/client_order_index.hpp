@@ -0,0 +1,128 @@
+/*
+ * client_order_index.hpp
+ * Defines the index the matching engine order book uses to look up live orders by (ClientId, OrderId). The index is a
+ * fixed-capacity, open-addressing hash table sized to the number of orders that can be live at once, rather than to the
+ * full ClientId x OrderId space.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "common/integrity.hpp"
+#include "common/types.hpp"
+#include "exchange_order.hpp"
+#include "runtime/huge_pages.hpp"
+
+namespace exchange {
+
+/*
+ * ClientOrderIndex maps (ClientId, OrderId) to the live ExchangeOrder with that key using linear probing. Slots only
+ * hold the ExchangeOrder pointer since the key already lives in the order itself, which keeps a slot at 8 bytes.
+ *
+ * The table is allocated once at construction with at least twice as many slots as the maximum number of live orders,
+ * so the load factor never exceeds 0.5 and probe sequences stay short. It is backed by huge pages, since every lookup
+ * starts at an effectively random slot. Erase uses backward-shift deletion instead of tombstones, so lookup cost does
+ * not degrade as orders churn. None of the operations allocate. Inserting more orders than the table was sized for is
+ * fatal, in every build type, since Find() relies on there always being an empty slot to stop at.
+ *
+ * The index itself does not bound ClientIds or OrderIds, but the order book still keeps its per-client order lists in
+ * an array of ME_MAX_NUM_CLIENTS, so ClientIds remain below that.
+ */
+class ClientOrderIndex final {
+   public:
+    explicit ClientOrderIndex(std::size_t max_live_orders)
+        : slots_(std::bit_ceil(max_live_orders * 2)), mask_(slots_.size() - 1) {}
+
+    // Returns the live order for the key, or nullptr if there is none.
+    auto Find(common::ClientId client_id, common::OrderId client_order_id) const noexcept -> ExchangeOrder * {
+        for (auto index = HomeIndex(client_id, client_order_id);; index = (index + 1) & mask_) {
+            const auto order = slots_[index];
+            if (order == nullptr || (order->client_id_ == client_id && order->client_order_id_ == client_order_id)) {
+                return order;
+            }
+        }
+    }
+
+    // Index an order by its (client_id_, client_order_id_). Replaces any order already indexed with the same key.
+    auto Insert(ExchangeOrder *order) noexcept {
+        auto index = HomeIndex(order->client_id_, order->client_order_id_);
+        for (; slots_[index] != nullptr; index = (index + 1) & mask_) {
+            if (slots_[index]->client_id_ == order->client_id_ &&
+                slots_[index]->client_order_id_ == order->client_order_id_) {
+                slots_[index] = order;
+                return;
+            }
+        }
+
+        if (size_ == (slots_.size() >> 1)) [[unlikely]] {
+            FATAL("ClientOrderIndex out of space. size:" + std::to_string(size_));
+        }
+        slots_[index] = order;
+        ++size_;
+    }
+
+    // Remove the order indexed under the key of the provided order, if any.
+    auto Erase(const ExchangeOrder *order) noexcept {
+        auto index = HomeIndex(order->client_id_, order->client_order_id_);
+        for (;; index = (index + 1) & mask_) {
+            const auto slot = slots_[index];
+            if (slot == nullptr) [[unlikely]] {
+                return;
+            }
+            if (slot->client_id_ == order->client_id_ && slot->client_order_id_ == order->client_order_id_) {
+                break;
+            }
+        }
+
+        // Shift back any later entry of the probe run that would otherwise become unreachable through the hole.
+        auto hole = index;
+        for (auto next = (hole + 1) & mask_; slots_[next] != nullptr; next = (next + 1) & mask_) {
+            const auto home = HomeIndex(slots_[next]->client_id_, slots_[next]->client_order_id_);
+            if (((next - home) & mask_) >= ((next - hole) & mask_)) {
+                slots_[hole] = slots_[next];
+                hole = next;
+            }
+        }
+        slots_[hole] = nullptr;
+        --size_;
+    }
+
+    auto Clear() noexcept {
+        std::fill(slots_.begin(), slots_.end(), nullptr);
+        size_ = 0;
+    }
+
+    auto Size() const noexcept { return size_; }
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    ClientOrderIndex() = delete;
+
+    ClientOrderIndex(const ClientOrderIndex &) = delete;
+
+    ClientOrderIndex(const ClientOrderIndex &&) = delete;
+
+    auto operator=(const ClientOrderIndex &) -> ClientOrderIndex & = delete;
+
+    auto operator=(const ClientOrderIndex &&) -> ClientOrderIndex & = delete;
+
+   private:
+    common::HugePageArray<ExchangeOrder *> slots_;
+    const std::size_t mask_;
+    std::size_t size_ = 0;
+
+    auto HomeIndex(common::ClientId client_id, common::OrderId client_order_id) const noexcept -> std::size_t {
+        // splitmix64 finalizer; client order ids are typically dense and sequential, so they need to be spread out.
+        auto key = client_order_id ^ (static_cast<uint64_t>(client_id) << 40U);
+        key = (key ^ (key >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+        key = (key ^ (key >> 27U)) * 0x94d049bb133111ebULL;
+        key ^= (key >> 31U);
+        return key & mask_;
+    }
+};
+
+}  // namespace exchange
@@ -2,7 +2,7 @@
  * exchange_order.hpp
  * Defines the types used in a matching engine order book. Specifically, an Order represents an order submitted by a
  * market participant, while an OrdersAtPrice stores all orders of a side at a given price. Both objects are doubly
- * linked-list nodes.
+ * linked-list nodes. An Order is also a node in the list of orders of its client.
  */
 
 #pragma once
@@ -27,6 +27,10 @@ struct ExchangeOrder {
     ExchangeOrder *prev_order_ = nullptr;
     ExchangeOrder *next_order_ = nullptr;
 
+    // Links in the circular list of live orders of the same client and side in this order book.
+    ExchangeOrder *prev_client_order_ = nullptr;
+    ExchangeOrder *next_client_order_ = nullptr;
+
     // only needed for use with MemPool.
     ExchangeOrder() = default;
 
@@ -69,15 +73,14 @@ struct ExchangeOrder {
     }
 };
 
-// Mapping from OrderId to an Order.
-using OrderMap = std::array<ExchangeOrder *, common::ME_MAX_ORDER_IDS>;
-// Mapping from ClientId to all the participants Orders mapped by OrderId.
-using ClientOrderMap = std::array<OrderMap, common::ME_MAX_NUM_CLIENTS>;
-
 struct OrdersAtPrice {
     common::Side side_ = common::Side::INVALID;
     common::Price price_ = common::PRICE_INVALID;
 
+    // Aggregates of the orders at this price, maintained as orders are added, filled and removed.
+    common::Qty total_qty_ = 0;
+    size_t num_orders_ = 0;
+
     ExchangeOrder *first_order_ = nullptr;
 
     OrdersAtPrice *prev_entry_ = nullptr;
@@ -94,6 +97,8 @@ struct OrdersAtPrice {
         ss << "MEOrdersAtPrice["
            << "side:" << common::SideToString(side_) << " "
            << "price:" << common::PriceToString(price_) << " "
+           << "qty:" << common::QtyToString(total_qty_) << " "
+           << "orders:" << num_orders_ << " "
            << "first_me_order:" << ((first_order_ != nullptr) ? first_order_->ToString() : "null") << " "
            << "prev:" << common::PriceToString((prev_entry_ != nullptr) ? prev_entry_->price_ : common::PRICE_INVALID)
            << " "
@@ -104,7 +109,4 @@ struct OrdersAtPrice {
     }
 };
 
-// Mapping from Price to OrdersAtPrice.
-using OrdersAtPriceMap = std::array<OrdersAtPrice *, common::ME_MAX_PRICE_LEVELS>;
-
 }  // namespace exchange
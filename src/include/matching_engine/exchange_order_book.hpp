@@ -5,33 +5,75 @@
  *
  * There is an OrderBook per trading instruments, each with a bid side and an ask side. Each side is a doubly
  * linked-list of OrdersAtPrice, with the bid side sorted in descending order and the ask side sorted in ascending
- * order. The Order themselves are arranged in FIFO order.
+ * order. The Order themselves are arranged in FIFO order. OrdersAtPrice are also indexed by price in a PriceLadder,
+ * which finds the position of a new price level without walking the list.
  */
 
 #pragma once
 
+#include <cstdio>
+#include <vector>
+
+#include "client_order_index.hpp"
 #include "common/types.hpp"
 #include "exchange_order.hpp"
 #include "logging/logger.hpp"
 #include "market_data/market_update.hpp"
+#include "order_book_checkpoint.hpp"
+#include "order_gateway/client_request.hpp"
 #include "order_gateway/client_response.hpp"
 #include "runtime/memory_pool.hpp"
+#include "runtime/price_ladder.hpp"
 
 namespace exchange {
 
 class MatchingEngine;
 
+// Number of chunks the order pool of a book grows to. The pool starts out with room for a quarter of ME_MAX_ORDER_IDS
+// orders and can hold ME_MAX_ORDER_IDS at most, which is as many as the ClientOrderIndex of the book can index.
+constexpr size_t ME_ORDER_POOL_CHUNKS = 4;
+static_assert(common::ME_MAX_ORDER_IDS % ME_ORDER_POOL_CHUNKS == 0);
+
 class ExchangeOrderBook final {
    public:
     explicit ExchangeOrderBook(common::TickerId ticker_id, common::Logger *logger, MatchingEngine *matching_engine);
 
     ~ExchangeOrderBook();
 
+    // Match a new order against the book and, for GTC orders, add any residual quantity to the book. The residual of
+    // IOC and FOK orders is canceled without ever being published. An order with an unknown TimeInForce, or at a price
+    // too far from the rest of the book for its PriceLadder to hold, is rejected.
     void Add(common::ClientId client_id, common::OrderId client_order_id, common::TickerId ticker_id, common::Side side,
-             common::Price price, common::Qty qty) noexcept;
+             common::Price price, common::Qty qty, TimeInForce time_in_force) noexcept;
 
     void Cancel(common::ClientId client_id, common::OrderId order_id, common::TickerId ticker_id) noexcept;
 
+    // Replace the price and quantity of a live order. A quantity decrease at the same price is applied in place and
+    // keeps the order's queue priority; any other change re-queues the order at the back of the new price level, first
+    // matching it if the new price crosses the book. Moving the order to a price too far from the rest of the book for
+    // its PriceLadder to hold is rejected, and leaves the order as it was. Such a MODIFY_REJECTED, unlike the one for
+    // an order that is not live, carries the order's market order id, side, price and quantity.
+    void Modify(common::ClientId client_id, common::OrderId order_id, common::TickerId ticker_id, common::Price price,
+                common::Qty qty) noexcept;
+
+    // Cancel every order of the client in this book, or only those of the side unless it is Side::INVALID. Only the
+    // canceled orders are visited.
+    void MassCancel(common::ClientId client_id, common::Side side) noexcept;
+
+    // Map the spare chunks the memory pools of the book asked for. The only method that is called from a thread other
+    // than the matching engine one, the checkpoint thread, which keeps the mapping off the matching path.
+    auto PrepareSpareChunks() noexcept {
+        order_pool_.PrepareSpareChunk();
+        orders_at_price_pool_.PrepareSpareChunk();
+    }
+
+    // Append the checkpoint of this book to checkpoint, see order_book_checkpoint.hpp.
+    void WriteCheckpoint(std::vector<char> *checkpoint) const noexcept;
+
+    // Load the orders of a book checkpoint into this book, which must be empty, and publish each of them as an ADD,
+    // which needs the market data publisher to be running. Returns the first byte after the book checkpoint.
+    auto RestoreCheckpoint(const char *data) noexcept -> const char *;
+
     auto ToString(bool detailed, bool validity_check) const -> std::string;
 
     // Deleted default, copy & move constructors and assignment-operators.
@@ -50,17 +92,24 @@ class ExchangeOrderBook final {
 
     MatchingEngine *matching_engine_ = nullptr;
 
-    ClientOrderMap cid_oid_to_order_;
+    // Index of live orders by (ClientId, client OrderId), used to find the order a client request refers to.
+    ClientOrderIndex cid_oid_to_order_;
 
     common::MemoryPool<OrdersAtPrice> orders_at_price_pool_;
     OrdersAtPrice *bids_by_price_ = nullptr;
     OrdersAtPrice *asks_by_price_ = nullptr;
 
-    // No need map for each side because there can't be both ask and bid orders at the same price (they'll be matched).
-    OrdersAtPriceMap price_orders_at_price_;
+    // No need for a ladder per side because there can't be both ask and bid orders at the same price (they'll be
+    // matched).
+    common::PriceLadder<OrdersAtPrice> price_ladder_;
 
     common::MemoryPool<ExchangeOrder> order_pool_;
 
+    // Hash map from ClientId -> side -> first order of the circular list of live orders of that client and side. The
+    // one place left that bounds ClientIds, to below ME_MAX_NUM_CLIENTS as the order server checks.
+    std::array<std::array<ExchangeOrder *, common::SideToIndex(common::Side::MAX) + 1>, common::ME_MAX_NUM_CLIENTS>
+        cid_side_orders_ = {};
+
     MEClientResponse client_response_;
     MEMarketUpdate market_update_;
 
@@ -72,66 +121,34 @@ class ExchangeOrderBook final {
    private:
     auto GenerateNewMarketOrderId() noexcept -> common::OrderId { return next_market_order_id_++; }
 
-    auto PriceToIndex(common::Price price) const noexcept { return (price % common::ME_MAX_PRICE_LEVELS); }
-
-    auto GetOrdersAtPrice(common::Price price) const noexcept -> OrdersAtPrice * {
-        return price_orders_at_price_.at(PriceToIndex(price));
-    }
+    auto GetOrdersAtPrice(common::Price price) const noexcept -> OrdersAtPrice * { return price_ladder_.Find(price); }
 
     auto AddOrdersAtPrice(OrdersAtPrice *new_orders_at_price) noexcept {
-        price_orders_at_price_.at(PriceToIndex(new_orders_at_price->price_)) = new_orders_at_price;
+        const auto side = new_orders_at_price->side_;
+        price_ladder_.Insert(side, new_orders_at_price->price_, new_orders_at_price);
 
-        const auto best_orders_by_price =
-            (new_orders_at_price->side_ == common::Side::BUY ? bids_by_price_ : asks_by_price_);
+        auto &best_orders_by_price = (side == common::Side::BUY ? bids_by_price_ : asks_by_price_);
         if (best_orders_by_price == nullptr) [[unlikely]] {
-            (new_orders_at_price->side_ == common::Side::BUY ? bids_by_price_ : asks_by_price_) = new_orders_at_price;
+            best_orders_by_price = new_orders_at_price;
             new_orders_at_price->prev_entry_ = new_orders_at_price->next_entry_ = new_orders_at_price;
-        } else {
-            auto target = best_orders_by_price;
-            bool add_after =
-                ((new_orders_at_price->side_ == common::Side::SELL && new_orders_at_price->price_ > target->price_) ||
-                 (new_orders_at_price->side_ == common::Side::BUY && new_orders_at_price->price_ < target->price_));
-            if (add_after) {
-                target = target->next_entry_;
-                add_after =
-                    ((new_orders_at_price->side_ == common::Side::SELL &&
-                      new_orders_at_price->price_ > target->price_) ||
-                     (new_orders_at_price->side_ == common::Side::BUY && new_orders_at_price->price_ < target->price_));
-            }
-            while (add_after && target != best_orders_by_price) {
-                add_after =
-                    ((new_orders_at_price->side_ == common::Side::SELL &&
-                      new_orders_at_price->price_ > target->price_) ||
-                     (new_orders_at_price->side_ == common::Side::BUY && new_orders_at_price->price_ < target->price_));
-                if (add_after) {
-                    target = target->next_entry_;
-                }
-            }
+            return;
+        }
 
-            if (add_after) {  // add new_orders_at_price after target.
-                if (target == best_orders_by_price) {
-                    target = best_orders_by_price->prev_entry_;
-                }
-                new_orders_at_price->prev_entry_ = target;
-                target->next_entry_->prev_entry_ = new_orders_at_price;
-                new_orders_at_price->next_entry_ = target->next_entry_;
-                target->next_entry_ = new_orders_at_price;
-            } else {  // add new_orders_at_price before target.
-                new_orders_at_price->prev_entry_ = target->prev_entry_;
-                new_orders_at_price->next_entry_ = target;
-                target->prev_entry_->next_entry_ = new_orders_at_price;
-                target->prev_entry_ = new_orders_at_price;
-
-                if ((new_orders_at_price->side_ == common::Side::BUY &&
-                     new_orders_at_price->price_ > best_orders_by_price->price_) ||
-                    (new_orders_at_price->side_ == common::Side::SELL &&
-                     new_orders_at_price->price_ < best_orders_by_price->price_)) {
-                    target->next_entry_ =
-                        (target->next_entry_ == best_orders_by_price ? new_orders_at_price : target->next_entry_);
-                    (new_orders_at_price->side_ == common::Side::BUY ? bids_by_price_ : asks_by_price_) =
-                        new_orders_at_price;
-                }
-            }
+        // Insert after the closest more aggressive level. Without one, the new level becomes the best level, i.e. it
+        // goes after the least aggressive level of the circular list.
+        auto target = price_ladder_.NextBetter(side, new_orders_at_price->price_);
+        const auto is_new_best = (target == nullptr);
+        if (is_new_best) {
+            target = best_orders_by_price->prev_entry_;
+        }
+
+        new_orders_at_price->prev_entry_ = target;
+        new_orders_at_price->next_entry_ = target->next_entry_;
+        target->next_entry_->prev_entry_ = new_orders_at_price;
+        target->next_entry_ = new_orders_at_price;
+
+        if (is_new_best) {
+            best_orders_by_price = new_orders_at_price;
         }
     }
 
@@ -152,11 +169,27 @@ class ExchangeOrderBook final {
             orders_at_price->prev_entry_ = orders_at_price->next_entry_ = nullptr;
         }
 
-        price_orders_at_price_.at(PriceToIndex(price)) = nullptr;
+        price_ladder_.Erase(side, price);
 
         orders_at_price_pool_.Deallocate(orders_at_price);
     }
 
+    // Visit the price levels of both sides, bids then asks, from the best price to the worst.
+    template <typename Visitor>
+    auto ForEachOrdersAtPrice(Visitor visitor) const noexcept {
+        for (const auto best_orders_by_price : {bids_by_price_, asks_by_price_}) {
+            if (best_orders_by_price == nullptr) {
+                continue;
+            }
+
+            auto orders_at_price = best_orders_by_price;
+            do {
+                visitor(orders_at_price);
+                orders_at_price = orders_at_price->next_entry_;
+            } while (orders_at_price != best_orders_by_price);
+        }
+    }
+
     auto GetNextPriority(common::Price price) noexcept {
         const auto orders_at_price = GetOrdersAtPrice(price);
         if (orders_at_price == nullptr) {
@@ -170,11 +203,33 @@ class ExchangeOrderBook final {
                common::OrderId client_order_id, common::OrderId new_market_order_id, ExchangeOrder *bid_itr,
                common::Qty *leaves_qty) noexcept;
 
+    // Whether the opposite side holds at least qty at prices that an order of the side at price would match.
+    auto CanFullyMatch(common::Side side, common::Price price, common::Qty qty) const noexcept {
+        const auto best_orders_by_price = (side == common::Side::BUY ? asks_by_price_ : bids_by_price_);
+        if (best_orders_by_price == nullptr) {
+            return false;
+        }
+
+        common::Qty available_qty = 0;
+        auto orders_at_price = best_orders_by_price;
+        do {
+            if ((side == common::Side::BUY && price < orders_at_price->price_) ||
+                (side == common::Side::SELL && price > orders_at_price->price_)) {
+                break;
+            }
+            available_qty += orders_at_price->total_qty_;
+            orders_at_price = orders_at_price->next_entry_;
+        } while (available_qty < qty && orders_at_price != best_orders_by_price);
+
+        return (available_qty >= qty);
+    }
+
     auto CheckForMatch(common::ClientId client_id, common::OrderId client_order_id, common::TickerId ticker_id,
-                       common::Side side, common::Price price, common::Qty qty,
-                       common::Qty new_market_order_id) noexcept;
+                       common::Side side, common::Price price, common::Qty qty, common::Qty new_market_order_id,
+                       TimeInForce time_in_force) noexcept;
 
-    auto RemoveOrder(ExchangeOrder *order) noexcept {
+    // Unlink the order from its price level, without releasing it.
+    auto DetachOrder(ExchangeOrder *order) noexcept {
         auto orders_at_price = GetOrdersAtPrice(order->price_);
 
         if (order->prev_order_ == order) {  // only one element.
@@ -189,24 +244,67 @@ class ExchangeOrderBook final {
                 orders_at_price->first_order_ = order_after;
             }
 
+            orders_at_price->total_qty_ -= order->qty_;
+            --orders_at_price->num_orders_;
+
             order->prev_order_ = order->next_order_ = nullptr;
         }
+    }
+
+    auto LinkClientOrder(ExchangeOrder *order) noexcept {
+        auto &first_order = cid_side_orders_[order->client_id_][common::SideToIndex(order->side_)];
+        if (first_order == nullptr) {
+            order->prev_client_order_ = order->next_client_order_ = order;
+            first_order = order;
+        } else {
+            order->prev_client_order_ = first_order->prev_client_order_;
+            order->next_client_order_ = first_order;
+            first_order->prev_client_order_->next_client_order_ = order;
+            first_order->prev_client_order_ = order;
+        }
+    }
 
-        cid_oid_to_order_.at(order->client_id_).at(order->client_order_id_) = nullptr;
+    auto UnlinkClientOrder(ExchangeOrder *order) noexcept {
+        auto &first_order = cid_side_orders_[order->client_id_][common::SideToIndex(order->side_)];
+        if (order->next_client_order_ == order) {  // only one element.
+            first_order = nullptr;
+        } else {
+            order->prev_client_order_->next_client_order_ = order->next_client_order_;
+            order->next_client_order_->prev_client_order_ = order->prev_client_order_;
+            if (first_order == order) {
+                first_order = order->next_client_order_;
+            }
+        }
+        order->prev_client_order_ = order->next_client_order_ = nullptr;
+    }
+
+    // Drop an order that is no longer linked into a price level from the indexes and release it.
+    auto ReleaseOrder(ExchangeOrder *order) noexcept {
+        cid_oid_to_order_.Erase(order);
+        UnlinkClientOrder(order);
         order_pool_.Deallocate(order);
     }
 
+    auto RemoveOrder(ExchangeOrder *order) noexcept {
+        DetachOrder(order);
+        ReleaseOrder(order);
+    }
+
+    // Remove a live order from the book, publishing the cancel and notifying its client.
+    auto CancelOrder(ExchangeOrder *order) noexcept;
+
+    // Append the order to its price level and index it, both by key and in the list of orders of its client. Indexing
+    // an order that is already indexed is a no-op.
     auto AddOrder(ExchangeOrder *order) noexcept {
-        const auto orders_at_price = GetOrdersAtPrice(order->price_);
+        auto orders_at_price = GetOrdersAtPrice(order->price_);
 
         if (orders_at_price == nullptr) {
             order->next_order_ = order->prev_order_ = order;
 
-            auto new_orders_at_price =
-                orders_at_price_pool_.Allocate(order->side_, order->price_, order, nullptr, nullptr);
-            AddOrdersAtPrice(new_orders_at_price);
+            orders_at_price = orders_at_price_pool_.Allocate(order->side_, order->price_, order, nullptr, nullptr);
+            AddOrdersAtPrice(orders_at_price);
         } else {
-            auto first_order = ((orders_at_price != nullptr) ? orders_at_price->first_order_ : nullptr);
+            auto first_order = orders_at_price->first_order_;
 
             first_order->prev_order_->next_order_ = order;
             order->prev_order_ = first_order->prev_order_;
@@ -214,7 +312,13 @@ class ExchangeOrderBook final {
             first_order->prev_order_ = order;
         }
 
-        cid_oid_to_order_.at(order->client_id_).at(order->client_order_id_) = order;
+        orders_at_price->total_qty_ += order->qty_;
+        ++orders_at_price->num_orders_;
+
+        cid_oid_to_order_.Insert(order);
+        if (order->next_client_order_ == nullptr) {
+            LinkClientOrder(order);
+        }
     }
 };
 
@@ -1,25 +1,36 @@
 /*
  * matching_engine.hpp
- * Defines the matching engine that is responsible for tracking and managing user orders. Runs in its own thread.
+ * Defines the matching engine that is responsible for tracking and managing user orders. The matching engine is split
+ * into shards that each own the order books of a disjoint set of tickers and run in their own thread.
  */
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
 #include "common/integrity.hpp"
+#include "common/latency_histogram.hpp"
 #include "common/perf_utils.hpp"
 #include "exchange_order_book.hpp"
 #include "market_data/market_update.hpp"
+#include "matching_engine/shard_channels.hpp"
 #include "order_gateway/client_request.hpp"
 #include "order_gateway/client_response.hpp"
 #include "runtime/lock_free_queue.hpp"
 #include "runtime/threads.hpp"
+#include "runtime/wait_strategy.hpp"
 
 namespace exchange {
 
 class MatchingEngine final {
    public:
-    MatchingEngine(ClientRequestLFQueue *client_requests, ClientResponseLFQueue *client_responses,
-                   MEMarketUpdateLFQueue *market_updates);
+    // Creates the shard shard_id of shard_channels, owning the order books of every ticker routed to that shard. The
+    // shard thread is pinned to core_id, or left unpinned if core_id is -1, and waits for requests as per wait_policy.
+    MatchingEngine(size_t shard_id, int core_id, ShardChannels *shard_channels, common::WaitPolicy wait_policy);
 
     ~MatchingEngine();
 
@@ -27,21 +38,77 @@ class MatchingEngine final {
 
     void Stop();
 
+    // Snapshot the live orders of every order book of this shard, for the checkpoint thread to write to its checkpoint
+    // file. The previous checkpoint is only replaced once the new one is complete and the journal is durable up to
+    // journal_position, the number of journaled requests processed so far. Returns false, skipping this checkpoint, if
+    // the previous one is still being written.
+    auto WriteCheckpoint(size_t journal_position) noexcept -> bool;
+
+    // Load the checkpoint file of this shard, if there is one, into its empty order books. Must be called before
+    // Start() and after the market data publisher was started. Returns false if there is no checkpoint.
+    auto RestoreCheckpoint() noexcept -> bool;
+
+    // Remove the checkpoint file of this shard, e.g. when the journal it refers to is discarded.
+    void DiscardCheckpoint() noexcept;
+
+    // A mass cancel without a ticker applies to every order book owned by this shard.
+    auto ProcessMassCancel(const MEClientRequest *client_request) noexcept {
+        if (client_request->ticker_id_ != common::TICKER_ID_INVALID) {
+            auto order_book = ticker_order_book_[client_request->ticker_id_];
+#if !defined(NDEBUG)  // the message is built on every request, ASSERT() only checks in debug builds anyway.
+            ASSERT(order_book != nullptr, "Shard:" + std::to_string(SHARD_ID) + " does not own ticker:" +
+                                              common::TickerIdToString(client_request->ticker_id_));
+#endif
+            order_book->MassCancel(client_request->client_id_, client_request->side_);
+            return;
+        }
+
+        for (auto order_book : ticker_order_book_) {
+            if (order_book != nullptr) {
+                order_book->MassCancel(client_request->client_id_, client_request->side_);
+            }
+        }
+    }
+
     auto ProcessClientRequest(const MEClientRequest *client_request) noexcept {
+        if (client_request->type_ == ClientRequestType::MASS_CANCEL) [[unlikely]] {
+            START_MEASURE(exchange_me_order_book_mass_cancel);
+            ProcessMassCancel(client_request);
+            END_MEASURE(exchange_me_order_book_mass_cancel);
+            return;
+        }
+        if (client_request->type_ == ClientRequestType::CHECKPOINT) [[unlikely]] {
+            WriteCheckpoint(client_request->order_id_);
+            return;
+        }
+
         auto order_book = ticker_order_book_[client_request->ticker_id_];
+#if !defined(NDEBUG)  // the message is built on every request, ASSERT() only checks in debug builds anyway.
+        ASSERT(order_book != nullptr, "Shard:" + std::to_string(SHARD_ID) + " does not own ticker:" +
+                                          common::TickerIdToString(client_request->ticker_id_));
+#endif
         switch (client_request->type_) {
             case ClientRequestType::NEW: {
                 START_MEASURE(exchange_me_order_book_add);
                 order_book->Add(client_request->client_id_, client_request->order_id_, client_request->ticker_id_,
-                                client_request->side_, client_request->price_, client_request->qty_);
-                END_MEASURE(exchange_me_order_book_add, logger_);
+                                client_request->side_, client_request->price_, client_request->qty_,
+                                client_request->time_in_force_);
+                END_MEASURE(exchange_me_order_book_add);
 
             } break;
 
             case ClientRequestType::CANCEL: {
                 START_MEASURE(exchange_me_order_book_cancel);
                 order_book->Cancel(client_request->client_id_, client_request->order_id_, client_request->ticker_id_);
-                END_MEASURE(exchange_me_order_book_cancel, logger_);
+                END_MEASURE(exchange_me_order_book_cancel);
+
+            } break;
+
+            case ClientRequestType::MODIFY: {
+                START_MEASURE(exchange_me_order_book_modify);
+                order_book->Modify(client_request->client_id_, client_request->order_id_, client_request->ticker_id_,
+                                   client_request->price_, client_request->qty_);
+                END_MEASURE(exchange_me_order_book_modify);
 
             } break;
 
@@ -54,34 +121,80 @@ class MatchingEngine final {
     auto SendClientResponse(const MEClientResponse *client_response) noexcept {
         logger_.Log("%:% %() % Sending %\n", __FILE__, __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_),
                     client_response->ToString());
-        auto next_write = outgoing_ogw_responses_->GetNextToWriteTo();
-        *next_write = std::move(*client_response);  // NOLINT
-        outgoing_ogw_responses_->UpdateWriteIndex();
+        auto next_write = outgoing_ogw_responses_->GetNextToWriteTo(stop_token_);
+        if (next_write == nullptr) [[unlikely]] {
+            return;  // stopping, and the order server may not read any more responses.
+        }
+        next_write->request_seq_num_ = current_request_seq_num_;
+        next_write->value_ = *client_response;
+#if defined(VOTS_TRACING)
+        next_write->value_.trace_ = current_trace_;
+#endif
+        TRACE_HOP(next_write->value_, ME_RESPONSE_SEND);
+        outgoing_ogw_responses_->AdvanceWriteIndex();
         TTT_MEASURE(t4t_matching_engine_lf_queue_write, logger_);
     }
 
     auto SendMarketUpdate(const MEMarketUpdate *market_update) noexcept {
         logger_.Log("%:% %() % Sending %\n", __FILE__, __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_),
                     market_update->ToString());
-        auto next_write = outgoing_md_updates_->GetNextToWriteTo();
-        *next_write = *market_update;
-        outgoing_md_updates_->UpdateWriteIndex();
+        auto next_write = outgoing_md_updates_->GetNextToWriteTo(stop_token_);
+        if (next_write == nullptr) [[unlikely]] {
+            return;  // stopping, and the market data publisher may not read any more updates.
+        }
+        next_write->request_seq_num_ = current_request_seq_num_;
+        next_write->value_ = *market_update;
+#if defined(VOTS_TRACING)
+        next_write->value_.trace_ = current_trace_;
+#endif
+        TRACE_HOP(next_write->value_, ME_UPDATE_SEND);
+        outgoing_md_updates_->AdvanceWriteIndex();
         TTT_MEASURE(t4_matching_engine_lf_queue_write, logger_);
     }
 
-    auto Run() noexcept {
+    // Make the responses and market updates sent so far visible to their consumers. They are sent in one go after each
+    // request, since matching a request can produce many of them.
+    auto PublishOutputs() noexcept {
+        outgoing_ogw_responses_->PublishWriteIndex();
+        outgoing_md_updates_->PublishWriteIndex();
+    }
+
+    auto Run(std::stop_token stop_token) noexcept {
         logger_.Log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_));
-        while (run_) {
-            const auto me_client_request = incoming_requests_->GetNextToRead();
-            if (me_client_request != nullptr) [[likely]] {
-                TTT_MEASURE(t3_matching_engine_lf_queue_read, logger_);
-
-                logger_.Log("%:% %() % Processing %\n", __FILE__, __LINE__, __FUNCTION__,
-                            common::GetCurrentTimeStr(&time_str_), me_client_request->ToString());
-                START_MEASURE(exchange_matching_engine_process_client_request);
-                ProcessClientRequest(me_client_request);
-                END_MEASURE(exchange_matching_engine_process_client_request, logger_);
-                incoming_requests_->UpdateReadIndex();
+        stop_token_ = stop_token;
+        while (!stop_token.stop_requested()) {
+            const auto me_client_requests = incoming_requests_->GetAllToRead();
+            if (!me_client_requests.empty()) [[likely]] {
+                wait_strategy_.Reset();
+                for (const auto &me_client_request : me_client_requests) {
+                    TTT_MEASURE(t3_matching_engine_lf_queue_read, logger_);
+
+                    logger_.Log("%:% %() % Processing seq:% %\n", __FILE__, __LINE__, __FUNCTION__,
+                                common::GetCurrentTimeStr(&time_str_), me_client_request.seq_num_,
+                                me_client_request.request_.ToString());
+                    current_request_seq_num_ = me_client_request.seq_num_;
+#if defined(VOTS_TRACING)
+                    TRACE_HOP(me_client_request.request_, ME_REQUEST_RECV);
+                    current_trace_ = me_client_request.request_.trace_;
+#endif
+                    START_MEASURE(exchange_matching_engine_process_client_request);
+                    ProcessClientRequest(&me_client_request.request_);
+                    END_MEASURE(exchange_matching_engine_process_client_request);
+                    PublishOutputs();
+
+                    done_seq_num_->store(current_request_seq_num_, std::memory_order_release);
+                }
+                incoming_requests_->UpdateReadIndex(me_client_requests.size());
+            } else {
+                // Requests sequenced for other shards do not pass through this one, so advance the watermark to the
+                // published sequence number whenever there is nothing left to process.
+                const auto published_seq_num = shard_channels_->PublishedSeqNum();
+                if (incoming_requests_->Size() == 0 && published_seq_num > current_request_seq_num_) {
+                    current_request_seq_num_ = published_seq_num;
+                    done_seq_num_->store(published_seq_num, std::memory_order_release);
+                } else {
+                    wait_strategy_.Idle();
+                }
             }
         }
     }
@@ -98,15 +211,53 @@ class MatchingEngine final {
     auto operator=(const MatchingEngine &&) -> MatchingEngine & = delete;
 
    private:
+    const size_t SHARD_ID;
+    const int CORE_ID;
+    const std::string THREAD_NAME;
+    const std::string CHECKPOINT_FILE;
+
+    // Only the order books of tickers owned by this shard are allocated, the others are nullptr.
     OrderBookMap ticker_order_book_;
 
-    ClientRequestLFQueue *incoming_requests_ = nullptr;
-    ClientResponseLFQueue *outgoing_ogw_responses_ = nullptr;
-    MEMarketUpdateLFQueue *outgoing_md_updates_ = nullptr;
+    ShardChannels *shard_channels_ = nullptr;
+    SequencedClientRequestLFQueue *incoming_requests_ = nullptr;
+    ShardClientResponseLFQueue *outgoing_ogw_responses_ = nullptr;
+    ShardMarketUpdateLFQueue *outgoing_md_updates_ = nullptr;
+    std::atomic<size_t> *done_seq_num_ = nullptr;
 
-    volatile bool run_ = false;
+    // Sequence number of the request currently being processed, tagged onto every output it produces.
+    size_t current_request_seq_num_ = 0;
+
+#if defined(VOTS_TRACING)
+    // Trace of the request currently being processed, carried on by every output it produces.
+    common::TraceHeader current_trace_;
+#endif
+
+    std::unique_ptr<common::ManagedThread> thread_;
+    common::WaitStrategy wait_strategy_;
+
+    // Stop token of the thread running Run(), which stops the outputs from waiting for room in a full queue. Outputs
+    // sent without a running thread, e.g. by a benchmark, wait as long as it takes.
+    std::stop_token stop_token_;
+
+    // Snapshot taken by WriteCheckpoint(), owned by the checkpoint thread while checkpoint_pending_ is true.
+    std::vector<char> checkpoint_;
+    std::atomic<bool> checkpoint_pending_ = {false};
+    std::mutex checkpoint_mutex_;
+    std::condition_variable_any checkpoint_cv_;
+    std::unique_ptr<common::ManagedThread> checkpoint_thread_;
 
     std::string time_str_;
     common::Logger logger_;
+
+    // How often the checkpoint thread looks for order book memory pools that want a spare chunk.
+    static constexpr auto SPARE_CHUNK_POLL_INTERVAL = std::chrono::milliseconds(10);
+
+    // Body of the checkpoint thread, which writes each snapshot taken by WriteCheckpoint() to CHECKPOINT_FILE. In
+    // between, it maps the spare chunks the memory pools of the order books ask for.
+    void RunCheckpointWriter(std::stop_token stop_token) noexcept;
+
+    // Commit the snapshot in checkpoint_ to CHECKPOINT_FILE. Returns false if writing it failed.
+    auto CommitCheckpoint() const noexcept -> bool;
 };
 }  // namespace exchange
@@ -0,0 +1,49 @@
+/*
+ * order_book_checkpoint.hpp
+ * Defines the binary layout of a matching engine checkpoint. A checkpoint holds the live orders of every order book of
+ * a matching engine shard, so that restarting the exchange only has to load the live orders and replay the part of the
+ * request journal that came after the checkpoint.
+ *
+ * A checkpoint file is a CheckpointHeader followed, for each order book, by a BookCheckpointHeader and num_orders_
+ * OrderCheckpoints. The orders of a book are stored bids then asks, best price level first and in priority order within
+ * each level, so appending them to an empty book in file order rebuilds the same levels and queues.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "common/types.hpp"
+
+namespace exchange {
+
+#pragma pack(push, 1)
+struct CheckpointHeader {
+    static constexpr uint64_t CHECKPOINT_MAGIC = 0x54504b4353544f56ULL;  // "VOTSCKPT"
+
+    uint64_t magic_ = CHECKPOINT_MAGIC;
+
+    // Number of journaled requests whose effects the checkpoint includes; replay resumes at this journal record.
+    uint64_t journal_position_ = 0;
+
+    uint64_t num_books_ = 0;
+};
+
+struct BookCheckpointHeader {
+    common::TickerId ticker_id_ = common::TICKER_ID_INVALID;
+    common::OrderId next_market_order_id_ = common::ORDER_ID_INVALID;
+    uint64_t num_orders_ = 0;
+};
+
+struct OrderCheckpoint {
+    common::ClientId client_id_ = common::CLIENT_ID_INVALID;
+    common::OrderId client_order_id_ = common::ORDER_ID_INVALID;
+    common::OrderId market_order_id_ = common::ORDER_ID_INVALID;
+    common::Side side_ = common::Side::INVALID;
+    common::Price price_ = common::PRICE_INVALID;
+    common::Qty qty_ = common::QTY_INVALID;
+    common::Priority priority_ = common::PRIORITY_INVALID;
+};
+#pragma pack(pop)
+
+}  // namespace exchange
@@ -0,0 +1,220 @@
+/*
+ * shard_channels.hpp
+ * Defines the communication channels between the order server, the matching engine shards and the market data
+ * publisher. Each shard owns a disjoint set of tickers and has its own lock-free queues, so busy instruments on one
+ * shard do not add latency to the instruments on another.
+ *
+ * Requests are stamped with a global sequence number by the FIFOSequencer. Every response and market update a shard
+ * produces is tagged with the sequence number of the request that caused it, which lets the consumers merge the shard
+ * outputs back into exactly the order the requests were sequenced in.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "common/integrity.hpp"
+#include "common/types.hpp"
+#include "market_data/market_update.hpp"
+#include "order_gateway/client_request.hpp"
+#include "order_gateway/client_response.hpp"
+#include "order_gateway/request_journal.hpp"
+#include "runtime/lock_free_queue.hpp"
+#include "runtime/wait_strategy.hpp"
+
+namespace exchange {
+
+// Client request as routed to a matching engine shard, stamped with its position in the global FIFO sequence.
+struct SequencedClientRequest {
+    size_t seq_num_ = 0;
+    MEClientRequest request_;
+};
+
+// Output of a matching engine shard, tagged with the sequence number of the request that produced it.
+template <typename T>
+struct ShardOutput {
+    size_t request_seq_num_ = 0;
+    T value_;
+};
+
+using SequencedClientRequestLFQueue = common::LockFreeQueue<SequencedClientRequest>;
+using ShardClientResponseLFQueue = common::LockFreeQueue<ShardOutput<MEClientResponse>>;
+using ShardMarketUpdateLFQueue = common::LockFreeQueue<ShardOutput<MEMarketUpdate>>;
+
+// Queues connecting a single matching engine shard to the order server and market data publisher.
+struct ShardChannel {
+    ShardChannel()
+        : requests_(common::ME_MAX_CLIENT_UPDATES),
+          client_responses_(common::ME_MAX_CLIENT_UPDATES),
+          market_updates_(common::ME_MAX_MARKET_UPDATES) {}
+
+    SequencedClientRequestLFQueue requests_;
+    ShardClientResponseLFQueue client_responses_;
+    ShardMarketUpdateLFQueue market_updates_;
+
+    // Every request routed to this shard with a sequence number <= done_seq_num_ has been fully processed and all of
+    // its outputs have been written. Written by the shard, read by the mergers.
+    alignas(64) std::atomic<size_t> done_seq_num_ = {0};
+
+    // Number of journaled requests already reflected in the order books of the shard, when they were restored from a
+    // checkpoint. Replaying the journal skips these requests for this shard. Only written before the shard starts.
+    size_t restored_journal_position_ = 0;
+
+    // Rung by the sequencer whenever it publishes, since the shard also waits for the sequence numbers of requests
+    // routed to other shards. Set by a parking shard before the sequencer starts, nullptr otherwise.
+    common::Doorbell *doorbell_ = nullptr;
+};
+
+class ShardChannels final {
+   public:
+    explicit ShardChannels(size_t num_shards) {
+        ASSERT(num_shards > 0 && num_shards <= common::ME_MAX_TICKERS,
+               "Invalid number of matching engine shards:" + std::to_string(num_shards));
+        for (size_t i = 0; i < num_shards; ++i) {
+            shards_.push_back(std::make_unique<ShardChannel>());
+        }
+    }
+
+    auto NumShards() const noexcept { return shards_.size(); }
+
+    auto ShardIdForTicker(common::TickerId ticker_id) const noexcept -> size_t { return ticker_id % shards_.size(); }
+
+    auto ShardForTicker(common::TickerId ticker_id) noexcept { return shards_[ShardIdForTicker(ticker_id)].get(); }
+
+    auto Shard(size_t shard_id) noexcept { return shards_.at(shard_id).get(); }
+
+    // Called by the sequencer once every request up to seq_num has been written to its shard queue.
+    auto PublishSeqNum(size_t seq_num) noexcept {
+        published_seq_num_.store(seq_num, std::memory_order_release);
+        for (const auto &shard : shards_) {
+            if (shard->doorbell_ != nullptr) {
+                shard->doorbell_->Ring();
+            }
+        }
+    }
+
+    auto PublishedSeqNum() const noexcept { return published_seq_num_.load(std::memory_order_acquire); }
+
+    // Journal of the requests sent to the shards, nullptr if there is none. A shard checkpoint is only committed once
+    // the journal is durable up to the journal position of the checkpoint. Set by the sequencer before it sends any
+    // request.
+    const RequestJournal *journal_ = nullptr;
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    ShardChannels() = delete;
+
+    ShardChannels(const ShardChannels &) = delete;
+
+    ShardChannels(const ShardChannels &&) = delete;
+
+    auto operator=(const ShardChannels &) -> ShardChannels & = delete;
+
+    auto operator=(const ShardChannels &&) -> ShardChannels & = delete;
+
+   private:
+    std::vector<std::unique_ptr<ShardChannel>> shards_;
+
+    alignas(64) std::atomic<size_t> published_seq_num_ = {0};
+};
+
+/*
+ * ShardOutputMerger is the consumer side of one kind of shard output (client responses or market updates). It exposes
+ * the same two-phase read interface as LockFreeQueue and yields the outputs of all shards in request sequence order.
+ *
+ * The head element with the lowest request sequence number is only released once every other shard is known to have
+ * nothing earlier left to produce: either its own head is later, or its queue is empty and it has finished every
+ * request before it. The resulting order is independent of thread scheduling, so downstream sequence numbers are
+ * gapless and reproducible.
+ */
+template <typename T>
+class ShardOutputMerger final {
+   public:
+    using Queue = common::LockFreeQueue<ShardOutput<T>>;
+
+    ShardOutputMerger(ShardChannels *shard_channels, Queue ShardChannel::*queue) {
+        for (size_t i = 0; i < shard_channels->NumShards(); ++i) {
+            auto shard = shard_channels->Shard(i);
+            queues_.push_back(&(shard->*queue));
+            done_seq_nums_.push_back(&shard->done_seq_num_);
+        }
+    }
+
+    auto GetNextToRead() noexcept -> const T * {
+        if (next_shard_ == SHARD_INVALID) {
+            next_shard_ = FindNextShard();
+            if (next_shard_ == SHARD_INVALID) {
+                return nullptr;
+            }
+        }
+
+        return &(queues_[next_shard_]->GetNextToRead()->value_);
+    }
+
+    auto UpdateReadIndex() noexcept {
+        ASSERT(next_shard_ != SHARD_INVALID, "UpdateReadIndex() called without a readable element.");
+        queues_[next_shard_]->UpdateReadIndex();
+        next_shard_ = SHARD_INVALID;
+    }
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    ShardOutputMerger() = delete;
+
+    ShardOutputMerger(const ShardOutputMerger &) = delete;
+
+    ShardOutputMerger(const ShardOutputMerger &&) = delete;
+
+    auto operator=(const ShardOutputMerger &) -> ShardOutputMerger & = delete;
+
+    auto operator=(const ShardOutputMerger &&) -> ShardOutputMerger & = delete;
+
+   private:
+    static constexpr auto SHARD_INVALID = std::numeric_limits<size_t>::max();
+
+    std::vector<Queue *> queues_;
+    std::vector<const std::atomic<size_t> *> done_seq_nums_;
+
+    size_t next_shard_ = SHARD_INVALID;
+
+    auto FindNextShard() const noexcept -> size_t {
+        auto best_shard = SHARD_INVALID;
+        auto best_seq_num = std::numeric_limits<size_t>::max();
+        for (size_t i = 0; i < queues_.size(); ++i) {
+            const auto head = queues_[i]->GetNextToRead();
+            if (head != nullptr && head->request_seq_num_ < best_seq_num) {
+                best_shard = i;
+                best_seq_num = head->request_seq_num_;
+            }
+        }
+
+        if (best_shard == SHARD_INVALID || queues_.size() == 1) [[likely]] {
+            return best_shard;
+        }
+
+        for (size_t i = 0; i < queues_.size(); ++i) {
+            if (i == best_shard) {
+                continue;
+            }
+
+            // Load the watermark before re-checking the queue; outputs are written before the watermark advances.
+            const auto done_seq_num = done_seq_nums_[i]->load(std::memory_order_acquire);
+            const auto head = queues_[i]->GetNextToRead();
+            if (head != nullptr) {
+                if (head->request_seq_num_ < best_seq_num) [[unlikely]] {
+                    return SHARD_INVALID;  // arrived since the scan above, retry on the next call.
+                }
+            } else if (done_seq_num + 1 < best_seq_num) {
+                return SHARD_INVALID;  // shard might still produce output for an earlier request.
+            }
+        }
+
+        return best_shard;
+    }
+};
+
+using ClientResponseMerger = ShardOutputMerger<MEClientResponse>;
+using MarketUpdateMerger = ShardOutputMerger<MEMarketUpdate>;
+
+}  // namespace exchange
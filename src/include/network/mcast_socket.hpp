@@ -8,6 +8,7 @@
 #include <functional>
 
 #include "logging/logger.hpp"
+#include "runtime/huge_pages.hpp"
 #include "socket_utils.hpp"
 
 namespace common {
@@ -16,10 +17,8 @@ namespace common {
 constexpr size_t MCAST_BUFFER_SIZE = 64 * 1024 * 1024;
 
 struct McastSocket {
-    explicit McastSocket(Logger &logger) : logger_(logger) {
-        outbound_data_.resize(MCAST_BUFFER_SIZE);
-        inbound_data_.resize(MCAST_BUFFER_SIZE);
-    }
+    explicit McastSocket(Logger &logger)
+        : outbound_data_(MCAST_BUFFER_SIZE), inbound_data_(MCAST_BUFFER_SIZE), logger_(logger) {}
 
     // Initialize multicast socket to read from or publish to a stream.
     // Does not join the multicast stream yet.
@@ -40,9 +39,9 @@ struct McastSocket {
     int socket_fd_ = -1;
 
     // Send and receive buffers, typically only one or the other is needed, not both.
-    std::vector<char> outbound_data_;
+    HugePageArray<char> outbound_data_;
     size_t next_send_valid_index_ = 0;
-    std::vector<char> inbound_data_;
+    HugePageArray<char> inbound_data_;
     size_t next_rcv_valid_index_ = 0;
 
     // Function wrapper for the method to call when data is read.
@@ -0,0 +1,101 @@
+/*
+ * shm_transport.hpp
+ * Defines the shared memory transport between an exchange and the trading clients co-located with it, the counterpart
+ * of the TCP order entry sessions and of the multicast incremental market data stream that never enters the kernel.
+ *
+ * Order entry sessions are a pair of ShmRings per client, requests from the client and responses to it, which the
+ * client creates and registers in the session table the exchange creates. The incremental stream is a ShmBroadcastRing
+ * that the exchange creates and every client reads on its own. Rings carry the same OMClientRequest, OMClientResponse
+ * and MDPMarketUpdate framing as the sockets do, sequence numbers included.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#include "common/types.hpp"
+
+namespace common {
+
+enum class Transport : int8_t { INVALID = 0, SOCKET = 1, SHM = 2, MAX = 3 };
+
+inline auto TransportToString(Transport transport) -> std::string {
+    switch (transport) {
+        case Transport::SOCKET:
+            return "SOCKET";
+        case Transport::SHM:
+            return "SHM";
+        case Transport::INVALID:
+            return "INVALID";
+        case Transport::MAX:
+            return "MAX";
+    }
+
+    return "UNKNOWN";
+}
+
+// Only names a real transport, INVALID for anything else, "INVALID" and "MAX" included.
+inline auto StringToTransport(const std::string &str) -> Transport {
+    for (auto i = static_cast<int>(Transport::INVALID) + 1; i < static_cast<int>(Transport::MAX); ++i) {
+        const auto transport = static_cast<Transport>(i);
+        if (TransportToString(transport) == str) {
+            return transport;
+        }
+    }
+
+    return Transport::INVALID;
+}
+
+// Transport named by the TRANSPORT environment variable, SOCKET if it is not set.
+inline auto GetTransport() -> Transport {
+    const auto transport = std::getenv("TRANSPORT");
+    return (transport != nullptr && *transport != '\0' ? StringToTransport(transport) : Transport::SOCKET);
+}
+
+// Names of the shared memory segments, see shm_overview(7).
+constexpr auto SHM_ORDER_SESSIONS = "/vots_order_sessions";
+constexpr auto SHM_MD_INCREMENTAL = "/vots_md_incremental";
+
+// Rings of a session are named after its connect count, so that an order server never mistakes the rings of a later
+// session of the same client for those of the session it read from the session table.
+inline auto ShmRequestRingName(ClientId client_id, uint64_t connects) {
+    return "/vots_order_" + std::to_string(client_id) + "_" + std::to_string(connects) + "_requests";
+}
+
+inline auto ShmResponseRingName(ClientId client_id, uint64_t connects) {
+    return "/vots_order_" + std::to_string(client_id) + "_" + std::to_string(connects) + "_responses";
+}
+
+/*
+ * ShmSessionTable is where co-located clients register their order entry sessions with the exchange. To connect, a
+ * client creates the rings of its next session, stores its pid_, bumps connects_ of its slot, sets connected_ and bumps
+ * changes_. To disconnect, it clears connected_ and bumps changes_. The order server only scans the slots when changes_
+ * moves, and detaches a session whose slot no longer shows it as connected, or shows a later one.
+ *
+ * The order server also drops sessions on its own: that of a client that does not keep up with its responses, and, as
+ * it checks every attached pid_ once a second, that of a client that died without disconnecting. It cancels their
+ * orders and stores their connects_ in dropped_connects_, so that it never attaches them again while the slot still
+ * shows them as connected. A client that finds its session dropped has to connect a new one.
+ */
+struct ShmSession {
+    std::atomic<uint64_t> connects_;
+    std::atomic<bool> connected_;
+    std::atomic<pid_t> pid_;
+    std::atomic<uint64_t> dropped_connects_;
+};
+
+struct ShmSessionTable {
+    static constexpr uint64_t MAGIC = 0x564F545353455353;  // "VOTSSESS"
+
+    std::atomic<uint64_t> magic_;
+    alignas(64) std::atomic<uint64_t> changes_;
+    std::array<ShmSession, ME_MAX_NUM_CLIENTS> sessions_;
+};
+
+}  // namespace common
@@ -16,16 +16,23 @@ struct TCPServer {
     // Start listening for connections on the provided interface and port.
     void Listen(const std::string &iface, int port);
 
-    // Check for new connections or dead connections and update containers that track the sockets.
-    void Poll() noexcept;
+    // Check for new connections or dead connections and update containers that track the sockets. What a dead
+    // connection sent before it went away is only read if receive is true.
+    void Poll(bool receive = true) noexcept;
 
-    // Publish outgoing data from the send buffer and read incoming data from the receive buffer.
-    void SendAndRecv() noexcept;
+    // Publish outgoing data from the send buffer and read incoming data from the receive buffer, unless receive is
+    // false, which leaves it in the kernel buffers and eventually makes the peers stop sending. Returns true if data
+    // was received on any connection.
+    auto SendAndRecv(bool receive = true) noexcept -> bool;
 
    private:
     // Add and remove socket file descriptors to and from the EPOLL list.
     auto AddToEpollList(TCPSocket *socket);
 
+    // Read whatever the peer sent before hanging up if receive is true, report the disconnect, then forget and close
+    // the socket.
+    void Disconnect(TCPSocket *socket, bool receive) noexcept;
+
    public:
     // Socket on which this server is listening for new connections on.
     int epoll_fd_ = -1;
@@ -40,6 +47,9 @@ struct TCPServer {
     std::function<void(TCPSocket *s, Nanos rx_time)> recv_callback_ = nullptr;
     // Function wrapper to call back when all data across all TCPSockets has been read and dispatched this round.
     std::function<void()> recv_finished_callback_ = nullptr;
+    // Function wrapper to call back when a connection is closed by the peer or fails. The socket is deleted once the
+    // callback returns.
+    std::function<void(TCPSocket *s, Nanos rx_time)> disconnect_callback_ = nullptr;
 
     std::string time_str_;
     Logger &logger_;
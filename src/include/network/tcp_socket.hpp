@@ -8,6 +8,7 @@
 #include <functional>
 
 #include "logging/logger.hpp"
+#include "runtime/huge_pages.hpp"
 #include "socket_utils.hpp"
 
 namespace common {
@@ -16,17 +17,15 @@ namespace common {
 constexpr size_t TCP_BUFFER_SIZE = 64 * 1024 * 1024;
 
 struct TCPSocket {
-    explicit TCPSocket(Logger &logger) : logger_(logger) {
-        outbound_data_.resize(TCP_BUFFER_SIZE);
-        inbound_data_.resize(TCP_BUFFER_SIZE);
-    }
+    explicit TCPSocket(Logger &logger)
+        : outbound_data_(TCP_BUFFER_SIZE), inbound_data_(TCP_BUFFER_SIZE), logger_(logger) {}
 
     // Create TCPSocket with provided attributes to either listen-on / connect-to.
     auto Connect(const std::string &ip, const std::string &iface, int port, bool is_listening) -> int;
 
     // Called to publish outgoing data from the buffers as well as check for and callback if data is available in the
-    // read buffers.
-    auto SendAndRecv() noexcept -> bool;
+    // read buffers. Incoming data is left in the kernel buffers if receive is false.
+    auto SendAndRecv(bool receive = true) noexcept -> bool;
 
     // Write outgoing data to the send buffers.
     void Send(const void *data, size_t len) noexcept;
@@ -46,9 +45,9 @@ struct TCPSocket {
     int socket_fd_ = -1;
 
     // Send and receive buffers and trackers for read/write indices.
-    std::vector<char> outbound_data_;
+    HugePageArray<char> outbound_data_;
     size_t next_send_valid_index_ = 0;
-    std::vector<char> inbound_data_;
+    HugePageArray<char> inbound_data_;
     size_t next_rcv_valid_index_ = 0;
 
     // Socket attributes.
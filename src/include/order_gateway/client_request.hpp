@@ -8,13 +8,27 @@
 
 #include <sstream>
 
+#include "common/trace.hpp"
 #include "common/types.hpp"
 #include "runtime/lock_free_queue.hpp"
+#include "runtime/shm_ring.hpp"
 
 namespace exchange {
 
 #pragma pack(push, 1)
-enum class ClientRequestType : uint8_t { INVALID = 0, NEW = 1, CANCEL = 2 };
+// A MASS_CANCEL cancels every order of the client, limited to the ticker_id_ and side_ of the request unless those are
+// TICKER_ID_INVALID and Side::INVALID respectively. Each canceled order gets its own CANCELED response.
+// A CHECKPOINT is internal to the exchange and never accepted from clients: the FIFOSequencer sends one to every
+// matching engine shard to have it checkpoint its order books, with order_id_ holding the number of requests journaled
+// before it.
+enum class ClientRequestType : uint8_t {
+    INVALID = 0,
+    NEW = 1,
+    CANCEL = 2,
+    MODIFY = 3,
+    MASS_CANCEL = 4,
+    CHECKPOINT = 5
+};
 
 inline auto ClientRequestTypeToString(ClientRequestType type) -> std::string {
     switch (type) {
@@ -22,12 +36,37 @@ inline auto ClientRequestTypeToString(ClientRequestType type) -> std::string {
             return "NEW";
         case ClientRequestType::CANCEL:
             return "CANCEL";
+        case ClientRequestType::MODIFY:
+            return "MODIFY";
+        case ClientRequestType::MASS_CANCEL:
+            return "MASS_CANCEL";
+        case ClientRequestType::CHECKPOINT:
+            return "CHECKPOINT";
         case ClientRequestType::INVALID:
             return "INVALID";
     }
     return "UNKNOWN";
 }
 
+// How long a NEW order stays in the book. GTC orders rest until filled or canceled. IOC orders execute whatever they
+// can on arrival and cancel the rest. FOK orders execute in full on arrival or not at all.
+enum class TimeInForce : uint8_t { GTC = 0, IOC = 1, FOK = 2 };
+
+inline auto TimeInForceToString(TimeInForce time_in_force) -> std::string {
+    switch (time_in_force) {
+        case TimeInForce::GTC:
+            return "GTC";
+        case TimeInForce::IOC:
+            return "IOC";
+        case TimeInForce::FOK:
+            return "FOK";
+    }
+    return "UNKNOWN";
+}
+
+// Whether the value is one of the TimeInForce values, which one received from a client need not be.
+constexpr auto IsValidTimeInForce(TimeInForce time_in_force) noexcept { return time_in_force <= TimeInForce::FOK; }
+
 struct MEClientRequest {
     ClientRequestType type_ = ClientRequestType::INVALID;
 
@@ -37,6 +76,11 @@ struct MEClientRequest {
     common::Side side_ = common::Side::INVALID;
     common::Price price_ = common::PRICE_INVALID;
     common::Qty qty_ = common::QTY_INVALID;
+    TimeInForce time_in_force_ = TimeInForce::GTC;
+#if defined(VOTS_TRACING)
+    // Mutable, since hops stamp the messages they only read, e.g. straight from a queue or socket buffer.
+    mutable common::TraceHeader trace_ = {};
+#endif
 
     auto ToString() const {
         std::stringstream ss;
@@ -45,7 +89,7 @@ struct MEClientRequest {
            << "type:" << ClientRequestTypeToString(type_) << " client:" << common::ClientIdToString(client_id_)
            << " ticker:" << common::TickerIdToString(ticker_id_) << " oid:" << common::OrderIdToString(order_id_)
            << " side:" << common::SideToString(side_) << " qty:" << common::QtyToString(qty_)
-           << " price:" << common::PriceToString(price_) << "]";
+           << " price:" << common::PriceToString(price_) << " tif:" << TimeInForceToString(time_in_force_) << "]";
         return ss.str();
     }
 };
@@ -67,5 +111,6 @@ struct OMClientRequest {
 #pragma pack(pop)
 
 using ClientRequestLFQueue = common::LockFreeQueue<MEClientRequest>;
+using OMClientRequestShmRing = common::ShmRing<OMClientRequest>;
 
 }  // namespace exchange
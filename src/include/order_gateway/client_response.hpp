@@ -8,13 +8,24 @@
 
 #include <sstream>
 
+#include "common/trace.hpp"
 #include "common/types.hpp"
 #include "runtime/lock_free_queue.hpp"
+#include "runtime/shm_ring.hpp"
 
 namespace exchange {
 
 #pragma pack(push, 1)
-enum class ClientResponseType : uint8_t { INVALID = 0, ACCEPTED = 1, CANCELED = 2, FILLED = 3, CANCEL_REJECTED = 4 };
+enum class ClientResponseType : uint8_t {
+    INVALID = 0,
+    ACCEPTED = 1,
+    CANCELED = 2,
+    FILLED = 3,
+    CANCEL_REJECTED = 4,
+    MODIFIED = 5,
+    MODIFY_REJECTED = 6,
+    NEW_REJECTED = 7
+};
 
 inline auto ClientResponseTypeToString(ClientResponseType type) -> std::string {
     switch (type) {
@@ -26,6 +37,12 @@ inline auto ClientResponseTypeToString(ClientResponseType type) -> std::string {
             return "FILLED";
         case ClientResponseType::CANCEL_REJECTED:
             return "CANCEL_REJECTED";
+        case ClientResponseType::MODIFIED:
+            return "MODIFIED";
+        case ClientResponseType::MODIFY_REJECTED:
+            return "MODIFY_REJECTED";
+        case ClientResponseType::NEW_REJECTED:
+            return "NEW_REJECTED";
         case ClientResponseType::INVALID:
             return "INVALID";
     }
@@ -42,6 +59,10 @@ struct MEClientResponse {
     common::Price price_ = common::PRICE_INVALID;
     common::Qty exec_qty_ = common::QTY_INVALID;
     common::Qty leaves_qty_ = common::QTY_INVALID;
+#if defined(VOTS_TRACING)
+    // Mutable, since hops stamp the messages they only read, e.g. straight from a queue or socket buffer.
+    mutable common::TraceHeader trace_ = {};
+#endif
 
     auto ToString() const {
         std::stringstream ss;
@@ -74,5 +95,6 @@ struct OMClientResponse {
 #pragma pack(pop)
 
 using ClientResponseLFQueue = common::LockFreeQueue<MEClientResponse>;
+using OMClientResponseShmRing = common::ShmRing<OMClientResponse>;
 
 }  // namespace exchange
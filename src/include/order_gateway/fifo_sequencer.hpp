@@ -1,21 +1,42 @@
 /*
  * fifo_sequencer.hpp
  * Component in order gateway that is responsible for arranging client requests in FIFO order to provide fairness.
- * Accommodates a maximum of ME_MAX_PENDING_REQUESTS at a time.
+ * Accommodates a maximum of ME_MAX_PENDING_REQUESTS at a time. Sequenced requests are stamped with a global sequence
+ * number, routed to the matching engine shard that owns their ticker and appended to the request journal.
+ *
+ * Client requests can be added from several gateway threads at once. Sequencing, i.e. SequenceAndPublish() and
+ * ReplayJournal(), must always be done by the same thread.
+ *
+ * The sequencing thread also drains the outputs of the shards, so it never waits for room in a shard queue, which could
+ * wait on a shard that waits for its outputs to be drained in turn. Requests that find their shard queue full are held
+ * back, and Backlogged() tells the gateway to stop reading new requests until they are sequenced. The cancels of
+ * clients that went away are always accepted though, backlog or not.
  */
 
 #pragma once
 
+#include <algorithm>
+#include <vector>
+
 #include "client_request.hpp"
 #include "common/integrity.hpp"
+#include "common/perf_utils.hpp"
 #include "logging/logger.hpp"
+#include "matching_engine/shard_channels.hpp"
+#include "request_journal.hpp"
+#include "runtime/mpsc_queue.hpp"
 #include "runtime/threads.hpp"
-#include "common/perf_utils.hpp"
 
 namespace exchange {
 
 constexpr size_t ME_MAX_PENDING_REQUESTS = 1024;
 
+// Number of journaled requests replayed before waiting for the matching engine shards to catch up.
+constexpr size_t ME_REPLAY_BATCH_SIZE = 4096;
+
+// Number of journaled requests between two checkpoints of the matching engine shards.
+constexpr size_t ME_CHECKPOINT_INTERVAL = 1024 * 1024;
+
 class FIFOSequencer {
    private:
     // Needs to be defined before sort call down below on pending_client_requests_.
@@ -23,24 +44,160 @@ class FIFOSequencer {
         common::Nanos recv_time_ = 0;
         MEClientRequest request_;
 
-        auto operator<(const RecvTimeClientRequest &rhs) const { return (recv_time_ < rhs.recv_time_); }
+        // Position in which the request was taken off incoming_requests_, which keeps requests received at the same
+        // time in the order their gateway added them.
+        size_t arrival_ = 0;
+
+        auto operator<(const RecvTimeClientRequest &rhs) const {
+            return (recv_time_ < rhs.recv_time_ || (recv_time_ == rhs.recv_time_ && arrival_ < rhs.arrival_));
+        }
     };
 
+    // journal_index is the position of the request in the journal. Shards restored from a checkpoint that already
+    // includes it are skipped. The request only becomes visible to the shard with the next Publish(). The shard queue
+    // must have room, see HaveRoomFor().
+    auto WriteToShard(ShardChannel *shard, const MEClientRequest &request, size_t journal_index) noexcept {
+        if (journal_index < shard->restored_journal_position_) [[unlikely]] {
+            return;
+        }
+
+        auto next_write = shard->requests_.TryGetNextToWriteTo();
+        ASSERT(next_write != nullptr, "Request written to a full shard queue.");
+        next_write->seq_num_ = next_seq_num_++;
+        next_write->request_ = request;
+        TRACE_HOP(next_write->request_, OS_REQUEST_SEQUENCE);
+        shard->requests_.AdvanceWriteIndex();
+    }
+
+    // Make every request written so far visible to the shards, then let them know they have been sent everything up to
+    // the last sequence number.
+    auto Publish() noexcept {
+        for (size_t shard_id = 0; shard_id < shard_channels_->NumShards(); ++shard_id) {
+            shard_channels_->Shard(shard_id)->requests_.PublishWriteIndex();
+        }
+        shard_channels_->PublishSeqNum(next_seq_num_ - 1);
+    }
+
+    // Whether the request is routed to every shard rather than to the shard that owns its ticker.
+    static auto GoesToAllShards(const MEClientRequest &request) noexcept {
+        return (request.ticker_id_ == common::TICKER_ID_INVALID &&
+                (request.type_ == ClientRequestType::MASS_CANCEL || request.type_ == ClientRequestType::CHECKPOINT));
+    }
+
+    // Whether every shard queue the request is routed to has room for it.
+    auto HaveRoomFor(const MEClientRequest &request) noexcept {
+        if (GoesToAllShards(request)) [[unlikely]] {
+            for (size_t shard_id = 0; shard_id < shard_channels_->NumShards(); ++shard_id) {
+                if (shard_channels_->Shard(shard_id)->requests_.TryGetNextToWriteTo() == nullptr) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        return (shard_channels_->ShardForTicker(request.ticker_id_)->requests_.TryGetNextToWriteTo() != nullptr);
+    }
+
+    auto RouteToShards(const MEClientRequest &request, size_t journal_index) noexcept {
+        if (GoesToAllShards(request)) [[unlikely]] {
+            // Every shard may hold orders of the client, or has to checkpoint. Each shard gets its own copy under its
+            // own sequence number, which keeps the merged shard outputs ordered by shard.
+            for (size_t shard_id = 0; shard_id < shard_channels_->NumShards(); ++shard_id) {
+                WriteToShard(shard_channels_->Shard(shard_id), request, journal_index);
+            }
+            return;
+        }
+
+        WriteToShard(shard_channels_->ShardForTicker(request.ticker_id_), request, journal_index);
+    }
+
+    // Have every shard checkpoint its order books once it has processed every request journaled so far. Returns false,
+    // for the checkpoint to be requested again later, if a shard queue has no room for the request.
+    auto RequestCheckpoint() noexcept {
+        const MEClientRequest checkpoint{.type_ = ClientRequestType::CHECKPOINT,
+                                         .client_id_ = common::CLIENT_ID_INVALID,
+                                         .ticker_id_ = common::TICKER_ID_INVALID,
+                                         .order_id_ = journal_.Size(),
+                                         .side_ = common::Side::INVALID,
+                                         .price_ = common::PRICE_INVALID,
+                                         .qty_ = common::QTY_INVALID,
+                                         .time_in_force_ = TimeInForce::GTC};
+        if (!HaveRoomFor(checkpoint)) [[unlikely]] {
+            return false;
+        }
+        RouteToShards(checkpoint, journal_.Size());
+        Publish();
+
+        last_checkpoint_position_ = journal_.Size();
+        return true;
+    }
+
    public:
-    FIFOSequencer(ClientRequestLFQueue *client_requests, common::Logger *logger)
-        : incoming_requests_(client_requests), logger_(logger) {}
+    // The journal at journal_file is replayed by ReplayJournal() if replay_journal is true, else started afresh.
+    FIFOSequencer(ShardChannels *shard_channels, common::Logger *logger, const std::string &journal_file,
+                  bool replay_journal)
+        : shard_channels_(shard_channels),
+          logger_(logger),
+          journal_(journal_file, (replay_journal ? JournalOpenMode::APPEND : JournalOpenMode::CREATE)) {
+        shard_channels_->journal_ = &journal_;
+        disconnect_cancels_.reserve(common::ME_MAX_NUM_CLIENTS);
+    }
 
     ~FIFOSequencer() = default;
 
-    auto AddClientRequest(common::Nanos rx_time, const MEClientRequest &request) {
-        if (pending_size_ >= pending_client_requests_.size()) {
-            FATAL("Too many pending requests");
+    // Safe to call from several threads concurrently. Returns false if too many requests are pending already, and the
+    // request is to be added again once the sequencer is no longer Backlogged().
+    auto AddClientRequest(common::Nanos rx_time, const MEClientRequest &request) -> bool {
+        const auto index = incoming_requests_.TryClaimWrite();
+        if (index == common::MPSCQueue<RecvTimeClientRequest>::INDEX_INVALID) [[unlikely]] {
+            return false;
         }
-        pending_client_requests_.at(pending_size_++) =
-            RecvTimeClientRequest{.recv_time_ = rx_time, .request_ = request};
+        auto slot = incoming_requests_.GetWriteSlot(index);
+        *slot = RecvTimeClientRequest{.recv_time_ = rx_time, .request_ = request};
+        TRACE_HOP(slot->request_, OS_REQUEST_RECV);
+        incoming_requests_.PublishWrite(index);
+        return true;
+    }
+
+    // Add the mass cancel of a client that went away. Never fails, unlike AddClientRequest(), since the cancel matters
+    // most when the exchange is too busy to take requests. Only from the sequencing thread.
+    auto AddDisconnectCancel(common::Nanos rx_time, const MEClientRequest &mass_cancel) {
+        disconnect_cancels_.push_back(RecvTimeClientRequest{.recv_time_ = rx_time, .request_ = mass_cancel});
+        TRACE_HOP(disconnect_cancels_.back().request_, OS_REQUEST_RECV);
+    }
+
+    // Whether the last SequenceAndPublish() held back requests because their shard queues were full, or left requests
+    // in incoming_requests_ or disconnect_cancels_ because too many were held back.
+    auto Backlogged() const noexcept {
+        return (pending_size_ != 0 || incoming_requests_.Size() != 0 || !disconnect_cancels_.empty());
     }
 
     auto SequenceAndPublish() {
+        // Requests that do not fit behind the ones held back stay in incoming_requests_ for a later call.
+        auto incoming_drained = false;
+        while (pending_size_ < pending_client_requests_.size()) {
+            const auto request = incoming_requests_.GetNextToRead();
+            if (request == nullptr) {
+                incoming_drained = true;
+                break;
+            }
+            auto &pending_client_request = pending_client_requests_[pending_size_];
+            pending_client_request = *request;
+            pending_client_request.arrival_ = pending_size_++;
+            incoming_requests_.UpdateReadIndex();
+        }
+        // Disconnect cancels are only taken once every request added before them is, so that they stay behind the
+        // requests their clients sent before going away.
+        if (incoming_drained && !disconnect_cancels_.empty()) [[unlikely]] {
+            size_t num_taken = 0;
+            for (; num_taken < disconnect_cancels_.size() && pending_size_ < pending_client_requests_.size();
+                 ++num_taken) {
+                auto &pending_client_request = pending_client_requests_[pending_size_];
+                pending_client_request = disconnect_cancels_[num_taken];
+                pending_client_request.arrival_ = pending_size_++;
+            }
+            disconnect_cancels_.erase(disconnect_cancels_.begin(), disconnect_cancels_.begin() + num_taken);
+        }
         if (pending_size_ == 0) [[unlikely]] {
             return;
         }
@@ -52,20 +209,85 @@ class FIFOSequencer {
         // typically be small.
         std::sort(pending_client_requests_.begin(), pending_client_requests_.begin() + pending_size_);
 
-        for (size_t i = 0; i < pending_size_; ++i) {
-            const auto &client_request = pending_client_requests_.at(i);
+        size_t num_sequenced = 0;
+        for (; num_sequenced < pending_size_; ++num_sequenced) {
+            const auto &client_request = pending_client_requests_[num_sequenced];
+            if (!HaveRoomFor(client_request.request_)) [[unlikely]] {
+                break;  // it and every later request wait for the shards to catch up.
+            }
+            const auto seq_num = next_seq_num_;
 
-            logger_->Log("%:% %() % Writing RX:% Req:% to FIFO.\n", __FILE__, __LINE__, __FUNCTION__,
-                         common::GetCurrentTimeStr(&time_str_), client_request.recv_time_,
+            logger_->Log("%:% %() % Writing RX:% Seq:% Req:% to FIFO.\n", __FILE__, __LINE__, __FUNCTION__,
+                         common::GetCurrentTimeStr(&time_str_), client_request.recv_time_, seq_num,
                          client_request.request_.ToString());
 
-            auto next_write = incoming_requests_->GetNextToWriteTo();
-            *next_write = client_request.request_;
-            incoming_requests_->UpdateWriteIndex();
+            RouteToShards(client_request.request_, journal_.Size());
             TTT_MEASURE(t2_order_server_lf_queue_write, (*logger_));
+
+            // Journaled once the shards have the request, so that the matching engine is not kept waiting on it.
+            journal_.Append(seq_num, client_request.request_);
+        }
+
+        // Only publish once the whole batch has been written, with a single index update per shard. This also lets idle
+        // shards advance their watermark.
+        Publish();
+
+        journal_.Commit();
+
+        // The requests held back stay ahead of the ones added later, which only tie with them on receive time if they
+        // were received at the same time, and then are taken off incoming_requests_ after them.
+        std::move(pending_client_requests_.begin() + num_sequenced,
+                  pending_client_requests_.begin() + pending_size_, pending_client_requests_.begin());
+        pending_size_ -= num_sequenced;
+        for (size_t i = 0; i < pending_size_; ++i) {
+            pending_client_requests_[i].arrival_ = i;
         }
 
-        pending_size_ = 0;
+        if (journal_.Size() - last_checkpoint_position_ >= ME_CHECKPOINT_INTERVAL) [[unlikely]] {
+            RequestCheckpoint();
+        }
+    }
+
+    // Sequence every journaled request again, which rebuilds the order books the matching engine shards held when the
+    // journal was written. Shards restored from a checkpoint only get the requests journaled after it. Requests are
+    // written in batches and each batch is waited on, calling drain_outputs meanwhile, so that none of the queues
+    // between the shards and their consumers can fill up.
+    template <typename DrainFn>
+    auto ReplayJournal(DrainFn drain_outputs) noexcept {
+        auto replay_position = journal_.Size();
+        for (size_t shard_id = 0; shard_id < shard_channels_->NumShards(); ++shard_id) {
+            const auto restored_journal_position = shard_channels_->Shard(shard_id)->restored_journal_position_;
+            if (restored_journal_position > journal_.Size()) [[unlikely]] {
+                FATAL("Checkpoint of shard:" + std::to_string(shard_id) + " at journal position:" +
+                      std::to_string(restored_journal_position) + " is ahead of the journal.");
+            }
+            replay_position = std::min(replay_position, restored_journal_position);
+        }
+
+        logger_->Log("%:% %() % Replaying journaled requests % to %.\n", __FILE__, __LINE__, __FUNCTION__,
+                     common::GetCurrentTimeStr(&time_str_), replay_position, journal_.Size());
+
+        for (size_t i = replay_position; i < journal_.Size();) {
+            for (const auto batch_end = std::min(i + ME_REPLAY_BATCH_SIZE, journal_.Size()); i < batch_end; ++i) {
+                RouteToShards(journal_.At(i)->request_, i);
+            }
+
+            const auto last_seq_num = next_seq_num_ - 1;
+            Publish();
+            while (!ShardsDone(last_seq_num)) {
+                drain_outputs();
+            }
+        }
+        drain_outputs();
+
+        logger_->Log("%:% %() % Replayed journal up to Seq:%.\n", __FILE__, __LINE__, __FUNCTION__,
+                     common::GetCurrentTimeStr(&time_str_), next_seq_num_ - 1);
+
+        // Checkpoint right away so that the next restart does not have to replay the same requests again.
+        last_checkpoint_position_ = replay_position;
+        if (journal_.Size() > last_checkpoint_position_) {
+            RequestCheckpoint();
+        }
     }
 
     // Deleted default, copy & move constructors and assignment-operators.
@@ -80,13 +302,39 @@ class FIFOSequencer {
     auto operator=(const FIFOSequencer &&) -> FIFOSequencer & = delete;
 
    private:
-    ClientRequestLFQueue *incoming_requests_ = nullptr;
+    ShardChannels *shard_channels_ = nullptr;
+
+    // Global sequence number to stamp on the next request routed to a matching engine shard.
+    size_t next_seq_num_ = 1;
 
     std::string time_str_;
     common::Logger *logger_ = nullptr;
 
+    // Requests added by the gateway threads and not sequenced yet. SequenceAndPublish() only takes as many as fit in
+    // pending_client_requests_ next to the requests it holds back, so both can fill up while the shards are behind.
+    // Backlogged() is true then, and the gateway has to stop adding requests until it is not.
+    common::MPSCQueue<RecvTimeClientRequest> incoming_requests_{ME_MAX_PENDING_REQUESTS};
+
     std::array<RecvTimeClientRequest, ME_MAX_PENDING_REQUESTS> pending_client_requests_;
     size_t pending_size_ = 0;
+
+    // Mass cancels of clients that went away, added by the sequencing thread itself and not taken into
+    // pending_client_requests_ yet.
+    std::vector<RecvTimeClientRequest> disconnect_cancels_;
+
+    RequestJournal journal_;
+
+    // Journal position at which the shards were last asked to checkpoint.
+    size_t last_checkpoint_position_ = 0;
+
+    auto ShardsDone(size_t seq_num) const noexcept -> bool {
+        for (size_t shard_id = 0; shard_id < shard_channels_->NumShards(); ++shard_id) {
+            if (shard_channels_->Shard(shard_id)->done_seq_num_.load(std::memory_order_acquire) < seq_num) {
+                return false;
+            }
+        }
+        return true;
+    }
 };
 
 }  // namespace exchange
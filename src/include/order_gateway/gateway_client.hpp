@@ -1,6 +1,7 @@
 /*
  * gateway_client.hpp
- * Defines the component that the market participant uses to communicate with the trading exchange's order gateway.
+ * Defines the component that the market participant uses to communicate with the trading exchange's order gateway,
+ * over TCP or, when co-located with the exchange, over a shared memory session.
  */
 
 #pragma once
@@ -8,10 +9,12 @@
 #include <functional>
 
 #include "common/integrity.hpp"
+#include "network/shm_transport.hpp"
 #include "network/tcp_server.hpp"
 #include "order_gateway/client_request.hpp"
 #include "order_gateway/client_response.hpp"
 #include "runtime/threads.hpp"
+#include "runtime/wait_strategy.hpp"
 
 namespace trading {
 
@@ -19,25 +22,27 @@ class GatewayClient {
    public:
     GatewayClient(common::ClientId client_id, exchange::ClientRequestLFQueue *client_requests,
                   exchange::ClientResponseLFQueue *client_responses, std::string ip, const std::string &iface,
-                  int port);
+                  int port, common::WaitPolicy wait_policy, common::Transport transport);
 
-    ~GatewayClient() {
-        Stop();
-
-        using namespace std::literals::chrono_literals;
-        std::this_thread::sleep_for(5s);
-    }
+    ~GatewayClient() { Stop(); }
 
     void Start() {
-        run_ = true;
-        ASSERT(tcp_socket_.Connect(ip_, IFACE, PORT, false) >= 0,
-               "Unable to connect to ip:" + ip_ + " port:" + std::to_string(PORT) + " on iface:" + IFACE +
-                   " error:" + std::string(std::strerror(errno)));
-        ASSERT(common::CreateAndStartThread(-1, "Trading/OrderGateway", [this]() { Run(); }) != nullptr,
-               "Failed to start OrderGateway thread.");
+        if (TRANSPORT == common::Transport::SHM) {
+            ConnectShm();
+        } else {
+            ASSERT(tcp_socket_.Connect(ip_, IFACE, PORT, false) >= 0,
+                   "Unable to connect to ip:" + ip_ + " port:" + std::to_string(PORT) + " on iface:" + IFACE +
+                       " error:" + std::string(std::strerror(errno)));
+        }
+        thread_ =
+            common::CreateAndStartThread(-1, THREAD_NAME, [this](std::stop_token stop_token) { Run(stop_token); });
+        ASSERT(thread_ != nullptr, "Failed to start OrderGateway thread.");
     }
 
-    void Stop() { run_ = false; }
+    void Stop() {
+        thread_ = nullptr;
+        DisconnectShm();
+    }
 
     // Deleted default, copy & move constructors and assignment-operators.
     GatewayClient() = delete;
@@ -51,16 +56,23 @@ class GatewayClient {
     auto operator=(const GatewayClient &&) -> GatewayClient & = delete;
 
    private:
+    static constexpr auto THREAD_NAME = "Trading/OrderGateway";
+
     const common::ClientId CLIENT_ID;
 
     std::string ip_;
     const std::string IFACE;
     const int PORT = 0;
+    const common::Transport TRANSPORT;
 
     exchange::ClientRequestLFQueue *outgoing_requests_ = nullptr;
     exchange::ClientResponseLFQueue *incoming_responses_ = nullptr;
 
-    volatile bool run_ = false;
+    std::unique_ptr<common::ManagedThread> thread_;
+    common::WaitStrategy wait_strategy_;
+
+    // Stop token of the thread running Run(), which stops the responses from waiting for room in a full queue.
+    std::stop_token stop_token_;
 
     std::string time_str_;
     common::Logger logger_;
@@ -69,10 +81,33 @@ class GatewayClient {
     size_t next_exp_seq_num_ = 1;
     common::TCPSocket tcp_socket_;
 
+    // Session with the exchange when connected over shared memory, and its connect count, see
+    // network/shm_transport.hpp.
+    common::SharedMemory shm_sessions_;
+    common::ShmSession *shm_session_ = nullptr;
+    uint64_t shm_connects_ = 0;
+    exchange::OMClientRequestShmRing shm_requests_;
+    exchange::OMClientResponseShmRing shm_responses_;
+
    private:
-    void Run() noexcept;
+    void Run(std::stop_token stop_token) noexcept;
+
+    // Write a client request to the exchange. Returns false if the shared memory session has no room for it yet.
+    auto SendClientRequest(const exchange::MEClientRequest &client_request) noexcept -> bool;
 
     void RecvCallback(common::TCPSocket *socket, common::Nanos rx_time) noexcept;
+
+    // Read the client responses of the shared memory session. Returns whether there were any.
+    auto RecvShm() noexcept -> bool;
+
+    // Check an incoming client response and forward it to the trade engine, without publishing it yet.
+    void OnClientResponse(const exchange::OMClientResponse *response) noexcept;
+
+    // Register a new shared memory session with the exchange, also to replace one the exchange dropped, and unregister
+    // it.
+    void ConnectShm();
+
+    void DisconnectShm() noexcept;
 };
 
 }  // namespace trading
@@ -2,27 +2,34 @@
  * order_server.hpp
  * Defines the order gateway server that accepts new connections to the exchange from market participants. The server
  * also handles incoming client requests, sequencing them in FIFO order for fairness and passing them on to the matching
- * engine.
+ * engine. Besides TCP connections, the server can serve shared memory sessions of clients co-located with it.
  */
 
 #pragma once
 
 #include <functional>
+#include <vector>
 
 #include "client_request.hpp"
 #include "client_response.hpp"
 #include "common/integrity.hpp"
+#include "common/latency_histogram.hpp"
 #include "common/perf_utils.hpp"
 #include "fifo_sequencer.hpp"
+#include "network/shm_transport.hpp"
 #include "network/tcp_server.hpp"
 #include "runtime/threads.hpp"
+#include "runtime/wait_strategy.hpp"
 
 namespace exchange {
 
 class OrderServer {
    public:
-    OrderServer(ClientRequestLFQueue *client_requests, ClientResponseLFQueue *client_responses,
-                const std::string &iface, int port);
+    // Client requests are journaled to journal_file. If replay_journal is true, the requests already in it are replayed
+    // through the matching engine before any client connection is served. With Transport::SHM, shared memory sessions
+    // are served next to the TCP connections.
+    OrderServer(ShardChannels *shard_channels, const std::string &iface, int port, const std::string &journal_file,
+                bool replay_journal, common::WaitPolicy wait_policy, common::Transport transport);
 
     ~OrderServer();
 
@@ -32,17 +39,28 @@ class OrderServer {
     void Stop();
 
     // Main run loop for this thread - accepts new client connections, receives client requests from them and sends
-    // client responses to them.
-    auto Run() noexcept {
+    // client responses to them. While the sequencer holds back requests for full shard queues, or has no room for more,
+    // no new requests are read, so that the clients are pushed back, and the held back ones are retried after draining
+    // the responses. Requests read but not taken by the sequencer are forwarded first once it has room again.
+    auto Run(std::stop_token stop_token) noexcept {
         logger_.Log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_));
-        while (run_) {
-            tcp_server_.Poll();
+        ReplayJournal();
 
-            tcp_server_.SendAndRecv();
+        while (!stop_token.stop_requested()) {
+            tcp_server_.Poll(!fifo_sequencer_.Backlogged());
+            if (!stalled_sockets_.empty() && !fifo_sequencer_.Backlogged()) [[unlikely]] {
+                ResumeStalledSockets();
+            }
+
+            const auto backlogged = fifo_sequencer_.Backlogged();
+            auto idle = !tcp_server_.SendAndRecv(!backlogged);
+            if (TRANSPORT == common::Transport::SHM && !backlogged) {
+                idle &= !PollShmSessions();
+            }
 
-            for (auto client_response = outgoing_responses_->GetNextToRead();
-                 (outgoing_responses_->Size() != 0) && (client_response != nullptr);
-                 client_response = outgoing_responses_->GetNextToRead()) {
+            for (auto client_response = outgoing_responses_.GetNextToRead(); client_response != nullptr;
+                 client_response = outgoing_responses_.GetNextToRead()) {
+                idle = false;
                 TTT_MEASURE(t5t_order_server_lf_queue_read, logger_);
 
                 auto &next_outgoing_seq_num = cid_next_outgoing_seq_num_[client_response->client_id_];
@@ -50,24 +68,67 @@ class OrderServer {
                             common::GetCurrentTimeStr(&time_str_), client_response->client_id_, next_outgoing_seq_num,
                             client_response->ToString());
 
-                ASSERT(cid_tcp_socket_[client_response->client_id_] != nullptr,
-                       "Dont have a TCPSocket for ClientId:" + std::to_string(client_response->client_id_));
-                START_MEASURE(exchange_tcp_socket_send);
-                // Sends an OMClientResponse as its components (a sequence number followed by an MEClientResponse).
-                cid_tcp_socket_[client_response->client_id_]->Send(&next_outgoing_seq_num,
-                                                                   sizeof(next_outgoing_seq_num));
-                cid_tcp_socket_[client_response->client_id_]->Send(client_response, sizeof(MEClientResponse));
-                END_MEASURE(exchange_tcp_socket_send, logger_);
+                auto socket = cid_tcp_socket_[client_response->client_id_];
+                auto &shm_session = cid_shm_session_[client_response->client_id_];
+                // e.g. the cancels that follow a disconnect.
+                if (socket == nullptr && !shm_session.requests_.IsOpen()) [[unlikely]] {
+                    logger_.Log("%:% %() % Dropping response for disconnected ClientId:%\n", __FILE__, __LINE__,
+                                __FUNCTION__, common::GetCurrentTimeStr(&time_str_), client_response->client_id_);
+                    outgoing_responses_.UpdateReadIndex();
+                    continue;
+                }
+
+                TRACE_HOP(*client_response, OS_RESPONSE_SEND);
+                if (socket != nullptr) {
+                    START_MEASURE(exchange_tcp_socket_send);
+                    // Sends an OMClientResponse as its components (a sequence number followed by an MEClientResponse).
+                    socket->Send(&next_outgoing_seq_num, sizeof(next_outgoing_seq_num));
+                    socket->Send(client_response, sizeof(MEClientResponse));
+                    END_MEASURE(exchange_tcp_socket_send);
+                } else {
+                    START_MEASURE(exchange_shm_session_send);
+                    auto shm_response = shm_session.responses_.GetNextToWriteTo();
+                    if (shm_response != nullptr) [[likely]] {
+                        shm_response->seq_num_ = next_outgoing_seq_num;
+                        shm_response->me_client_response_ = *client_response;
+                        shm_session.responses_.UpdateWriteIndex();
+                    }
+                    END_MEASURE(exchange_shm_session_send);
+                    if (shm_response == nullptr) [[unlikely]] {
+                        // A client that does not keep up would hold back every other one, so it is disconnected.
+                        logger_.Log("%:% %() % Responses to ClientId:% fill its shared memory session.\n", __FILE__,
+                                    __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_),
+                                    client_response->client_id_);
+                        outgoing_responses_.UpdateReadIndex();
+                        DropShmSession(client_response->client_id_, common::NowNanos());
+                        RecvFinishedCallback();
+                        continue;
+                    }
+                }
 
-                outgoing_responses_->UpdateReadIndex();
+                outgoing_responses_.UpdateReadIndex();
                 TTT_MEASURE(t6t_order_server_tcp_write, logger_);
 
                 ++next_outgoing_seq_num;
             }
+
+            if (backlogged) [[unlikely]] {
+                idle = false;
+                RecvFinishedCallback();
+            }
+
+            // Responses buffered above are only sent by the next SendAndRecv(), so the loop never waits right after
+            // them. There is nothing to ring the doorbell when parked, the loop wakes up after the park timeout.
+            if (idle) {
+                wait_strategy_.Idle();
+            } else {
+                wait_strategy_.Reset();
+            }
         }
     }
 
     // Read client request from the TCP receive buffer, check for sequence gaps and forward it to the FIFO sequencer.
+    // Once the sequencer has no room for more, the rest stay in the buffer and the socket is stalled until it has.
     auto RecvCallback(common::TCPSocket *socket, common::Nanos rx_time) noexcept {
         TTT_MEASURE(t1_order_server_tcp_read, logger_);
 
@@ -81,6 +142,27 @@ class OrderServer {
                 logger_.Log("%:% %() % Received %\n", __FILE__, __LINE__, __FUNCTION__,
                             common::GetCurrentTimeStr(&time_str_), request->ToString());
 
+                if (request->me_client_request_.type_ == ClientRequestType::CHECKPOINT) [[unlikely]] {
+                    logger_.Log("%:% %() % Dropping internal request from client socket:%\n", __FILE__, __LINE__,
+                                __FUNCTION__, common::GetCurrentTimeStr(&time_str_), socket->socket_fd_);
+                    continue;
+                }
+
+                if (request->me_client_request_.client_id_ >= common::ME_MAX_NUM_CLIENTS) [[unlikely]] {
+                    logger_.Log("%:% %() % Received ClientRequest from invalid ClientId:% on socket:%\n", __FILE__,
+                                __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_),
+                                request->me_client_request_.client_id_, socket->socket_fd_);
+                    continue;
+                }
+
+                if (cid_shm_session_[request->me_client_request_.client_id_].requests_.IsOpen()) [[unlikely]] {
+                    logger_.Log("%:% %() % Received ClientRequest from ClientId:% with a shared memory session on "
+                                "socket:%\n",
+                                __FILE__, __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_),
+                                request->me_client_request_.client_id_, socket->socket_fd_);
+                    continue;
+                }
+
                 if (cid_tcp_socket_[request->me_client_request_.client_id_] == nullptr) [[unlikely]] {
                     cid_tcp_socket_[request->me_client_request_.client_id_] = socket;
                 }
@@ -103,25 +185,91 @@ class OrderServer {
                     continue;
                 }
 
-                ++next_exp_seq_num;
-
                 START_MEASURE(exchange_fifo_sequencer_add_client_request);
-                fifo_sequencer_.AddClientRequest(rx_time, request->me_client_request_);
-                END_MEASURE(exchange_fifo_sequencer_add_client_request, logger_);
+                const auto added = fifo_sequencer_.AddClientRequest(rx_time, request->me_client_request_);
+                END_MEASURE(exchange_fifo_sequencer_add_client_request);
+                if (!added) [[unlikely]] {
+                    stalled_sockets_.push_back({socket, rx_time});
+                    break;
+                }
+                ++next_exp_seq_num;
             }
 
-            // Shift down leftover bytes to the start of inbound_data_.
-            memcpy(socket->inbound_data_.data(), socket->inbound_data_.data() + i, socket->next_rcv_valid_index_ - i);
+            // Shift down leftover bytes to the start of inbound_data_, which can overlap them if the socket stalled.
+            memmove(socket->inbound_data_.data(), socket->inbound_data_.data() + i, socket->next_rcv_valid_index_ - i);
             socket->next_rcv_valid_index_ -= i;
         }
     }
 
+    // Cancel every order of the clients of a connection that went away, after any request they sent before it did. The
+    // clients start over with a fresh session, sequence numbers included, if they connect again.
+    auto DisconnectCallback(common::TCPSocket *socket, common::Nanos rx_time) noexcept {
+        // The requests the sequencer had no room for go away with the socket, the mass cancels below follow them.
+        std::erase_if(stalled_sockets_, [socket](const auto &stalled) { return stalled.socket_ == socket; });
+
+        for (size_t client_id = 0; client_id < cid_tcp_socket_.size(); ++client_id) {
+            if (cid_tcp_socket_[client_id] != socket) {
+                continue;
+            }
+
+            logger_.Log("%:% %() % ClientId:% disconnected socket:%\n", __FILE__, __LINE__, __FUNCTION__,
+                        common::GetCurrentTimeStr(&time_str_), client_id, socket->socket_fd_);
+
+            MassCancel(static_cast<common::ClientId>(client_id), rx_time);
+
+            cid_tcp_socket_[client_id] = nullptr;
+            cid_next_exp_seq_num_[client_id] = 1;
+            cid_next_outgoing_seq_num_[client_id] = 1;
+        }
+    }
+
+    // Forward the requests left in the receive buffers of the stalled sockets, under the receive times they were read
+    // at, as far as the FIFO sequencer has room for them.
+    auto ResumeStalledSockets() noexcept -> void {
+        // Sockets that stall again are added back behind the ones resumed here.
+        const auto num_stalled = stalled_sockets_.size();
+        for (size_t i = 0; i < num_stalled; ++i) {
+            RecvCallback(stalled_sockets_[i].socket_, stalled_sockets_[i].rx_time_);
+        }
+        stalled_sockets_.erase(stalled_sockets_.begin(), stalled_sockets_.begin() + num_stalled);
+        RecvFinishedCallback();
+    }
+
+    // Cancel every order of the client, after any request it sent before. Accepted even while the FIFO sequencer is
+    // backlogged.
+    auto MassCancel(common::ClientId client_id, common::Nanos rx_time) noexcept -> void {
+        const MEClientRequest mass_cancel{.type_ = ClientRequestType::MASS_CANCEL,
+                                          .client_id_ = client_id,
+                                          .ticker_id_ = common::TICKER_ID_INVALID,
+                                          .order_id_ = common::ORDER_ID_INVALID,
+                                          .side_ = common::Side::INVALID,
+                                          .price_ = common::PRICE_INVALID,
+                                          .qty_ = common::QTY_INVALID,
+                                          .time_in_force_ = TimeInForce::GTC};
+        fifo_sequencer_.AddDisconnectCancel(rx_time, mass_cancel);
+    }
+
+    // Attach and detach the shared memory sessions that connected and disconnected, drop those of clients that died,
+    // then read the client requests of every attached session and forward them to the FIFO sequencer. Returns whether
+    // there were any.
+    auto PollShmSessions() noexcept -> bool;
+
+    // Attach the rings of the session the client registered in the shared memory session table.
+    auto ConnectShmSession(common::ClientId client_id, uint64_t connects) noexcept -> void;
+
+    // Cancel every order of the client of a shared memory session that went away, and detach its rings.
+    auto DisconnectShmSession(common::ClientId client_id, common::Nanos rx_time) noexcept -> void;
+
+    // Disconnect a shared memory session the client did not end itself, and mark it dropped in the session table so
+    // that it is not attached again.
+    auto DropShmSession(common::ClientId client_id, common::Nanos rx_time) noexcept -> void;
+
     // End of reading incoming messages across all the TCP connections, sequence and publish the client requests to the
     // matching engine.
-    auto RecvFinishedCallback() noexcept {
+    auto RecvFinishedCallback() noexcept -> void {
         START_MEASURE(exchange_fifo_sequencer_sequence_and_publish);
         fifo_sequencer_.SequenceAndPublish();
-        END_MEASURE(exchange_fifo_sequencer_sequence_and_publish, logger_);
+        END_MEASURE(exchange_fifo_sequencer_sequence_and_publish);
     }
 
     // Deleted default, copy & move constructors and assignment-operators.
@@ -136,13 +284,24 @@ class OrderServer {
     auto operator=(const OrderServer &&) -> OrderServer & = delete;
 
    private:
+    static constexpr auto THREAD_NAME = "exchange/OrderServer";
+
+    // How often the clients of the attached shared memory sessions are checked for being alive.
+    static constexpr common::Nanos SHM_LIVENESS_INTERVAL = common::NANOS_TO_SECS;
+
+    // Rebuild the order books from the journal. No client is connected yet, so the responses are discarded.
+    void ReplayJournal() noexcept;
+
     const std::string IFACE;
     const int PORT = 0;
+    const common::Transport TRANSPORT;
 
-    // Lock free queue of outgoing client responses to be sent out to connected clients.
-    ClientResponseLFQueue *outgoing_responses_ = nullptr;
+    // Outgoing client responses of all matching engine shards, merged in request sequence order, to be sent out to
+    // connected clients.
+    ClientResponseMerger outgoing_responses_;
 
-    volatile bool run_ = false;
+    std::unique_ptr<common::ManagedThread> thread_;
+    common::WaitStrategy wait_strategy_;
 
     std::string time_str_;
     common::Logger logger_;
@@ -159,6 +318,28 @@ class OrderServer {
     // TCP server instance listening for new client connections.
     common::TCPServer tcp_server_;
 
+    // Sockets with requests left in their receive buffers because the FIFO sequencer had no room for them, and the time
+    // they were received at.
+    struct StalledSocket {
+        common::TCPSocket *socket_ = nullptr;
+        common::Nanos rx_time_ = 0;
+    };
+    std::vector<StalledSocket> stalled_sockets_;
+
+    // Shared memory session table that co-located clients register their sessions in, the value of its changes_ the
+    // sessions were last scanned at, when their clients were last checked for being alive, the attached session of
+    // every ClientId and the ClientIds with one attached, see network/shm_transport.hpp.
+    struct ShmSessionRings {
+        uint64_t connects_ = 0;
+        OMClientRequestShmRing requests_;
+        OMClientResponseShmRing responses_;
+    };
+    common::SharedMemory shm_sessions_;
+    uint64_t shm_sessions_changes_ = 0;
+    common::Nanos shm_sessions_checked_at_ = 0;
+    std::array<ShmSessionRings, common::ME_MAX_NUM_CLIENTS> cid_shm_session_;
+    std::vector<common::ClientId> shm_client_ids_;
+
     // FIFO sequencer responsible for making sure incoming client requests are processed in the order in which they
     // were received.
     FIFOSequencer fifo_sequencer_;
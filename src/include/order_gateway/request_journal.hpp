@@ -0,0 +1,136 @@
+/*
+ * request_journal.hpp
+ * Defines the append-only journal of sequenced client requests. The journal is a pre-allocated file mapped into memory,
+ * so appending a request is a plain memory copy and the kernel writes the pages back in the background. A full journal
+ * grows its file and mapping by a large step at a time. Replaying the journal through the matching engine rebuilds
+ * every order book since matching is deterministic.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "client_request.hpp"
+#include "common/integrity.hpp"
+
+namespace exchange {
+
+// Number of requests a new journal has room for, and that a full journal grows by.
+constexpr size_t ME_JOURNAL_GROWTH_RECORDS = 8 * 1024 * 1024;
+
+// How a RequestJournal opens its file.
+enum class JournalOpenMode : int8_t {
+    CREATE = 0,    // start an empty journal, discarding the records of an existing one.
+    APPEND = 1,    // keep the records of an existing journal, so that they can be replayed, and append after them.
+    READ_ONLY = 2  // only read the records of an existing journal, which is neither created, allocated nor written.
+};
+
+#pragma pack(push, 1)
+// A client request as sequenced by the FIFOSequencer, stamped with the sequence number it was first assigned.
+struct JournalRecord {
+    size_t seq_num_ = 0;
+    MEClientRequest request_;
+};
+#pragma pack(pop)
+
+class RequestJournal final {
+   public:
+    // Open or create the journal file as per mode. Append() and Commit() must not be called on a READ_ONLY journal.
+    RequestJournal(const std::string &file_path, JournalOpenMode mode);
+
+    ~RequestJournal();
+
+    // Write a record after the last one. It only becomes part of the journal once Commit() is called. A full journal
+    // first grows by ME_JOURNAL_GROWTH_RECORDS, which allocates and maps the additional file space in this call.
+    auto Append(size_t seq_num, const MEClientRequest &request) noexcept {
+        if (next_record_index_ >= header_->max_records_) [[unlikely]] {
+            Grow(header_->max_records_ + ME_JOURNAL_GROWTH_RECORDS);
+        }
+        records_[next_record_index_++] = JournalRecord{.seq_num_ = seq_num, .request_ = request};
+    }
+
+    // Make every appended record part of the journal, then do the bookkeeping that keeps later appends cheap: touching
+    // the pages ahead of the write position, so that appends do not page fault, and periodically asking the kernel to
+    // start writing the dirty pages back.
+    auto Commit() noexcept {
+        std::atomic_ref<size_t>(header_->num_records_).store(next_record_index_, std::memory_order_release);
+
+        PrefaultAhead();
+        if (next_record_index_ - synced_record_index_ >= SYNC_INTERVAL_RECORDS) [[unlikely]] {
+            Sync(false);
+        }
+    }
+
+    // Number of records in the journal.
+    auto Size() const noexcept { return next_record_index_; }
+
+    // Wait until every committed record is written back to the file. Unlike the other methods, safe to call from any
+    // thread, e.g. to make the journal durable before a checkpoint that refers to it. Returns false if syncing failed.
+    auto SyncToDisk() const noexcept -> bool;
+
+    auto At(size_t index) const noexcept -> const JournalRecord * {
+        ASSERT(index < next_record_index_, "Journal record:" + std::to_string(index) + " does not exist.");
+        return &records_[index];
+    }
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    RequestJournal() = delete;
+
+    RequestJournal(const RequestJournal &) = delete;
+
+    RequestJournal(const RequestJournal &&) = delete;
+
+    auto operator=(const RequestJournal &) -> RequestJournal & = delete;
+
+    auto operator=(const RequestJournal &&) -> RequestJournal & = delete;
+
+   private:
+    static constexpr uint64_t JOURNAL_MAGIC = 0x4c4e524a53544f56ULL;  // "VOTSJRNL"
+    static constexpr size_t PAGE_SIZE = 4096;
+    static constexpr size_t PREFAULT_BYTES = 64 * PAGE_SIZE;
+    static constexpr size_t SYNC_INTERVAL_RECORDS = 64 * 1024;
+
+    // Header at the start of the file, padded to a cache line so that the records do not share one with it.
+    struct alignas(64) JournalHeader {
+        uint64_t magic_ = 0;
+        uint64_t record_size_ = 0;
+        uint64_t max_records_ = 0;
+        uint64_t num_records_ = 0;
+    };
+
+    const std::string FILE_PATH;
+    const bool READ_ONLY;
+
+    int fd_ = -1;
+    char *mapping_ = nullptr;
+    size_t mapping_size_ = 0;
+
+    JournalHeader *header_ = nullptr;
+    JournalRecord *records_ = nullptr;
+
+    size_t next_record_index_ = 0;
+    size_t synced_record_index_ = 0;
+
+    // Every page of the mapping below this offset has already been written to.
+    size_t prefaulted_offset_ = 0;
+
+    auto RecordsEndOffset() const noexcept {
+        return static_cast<size_t>(reinterpret_cast<const char *>(records_ + next_record_index_) - mapping_);
+    }
+
+    void PrefaultAhead() noexcept;
+
+    // Write the dirty pages back to the file, waiting for completion only if wait is true.
+    void Sync(bool wait) noexcept;
+
+    // Extend the file and its mapping to hold max_records records. The mapping may move, so pointers into it returned
+    // by At() are invalidated.
+    void Grow(size_t max_records) noexcept;
+
+    // Reserve the blocks of the file up to mapping_size_, so that writing to the mapping never has to allocate them.
+    void Allocate() noexcept;
+};
+
+}  // namespace exchange
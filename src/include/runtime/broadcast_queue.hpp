@@ -0,0 +1,174 @@
+/*
+ * broadcast_queue.hpp
+ * Provides implementation of a generic, fixed-sized, lock-free broadcast ring for the Single Producer Multiple Consumer
+ * paradigm, where every consumer sees every element.
+ */
+
+#pragma once
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "common/integrity.hpp"
+
+namespace common {
+
+/*
+ * Single Producer Multiple Consumer, fixed-sized, lock-free broadcast ring.
+ *
+ * Elements are written once and read in place by a fixed number of readers, each identified by an index below
+ * NumReaders() and tracking its own cursor. A slot is only reused once every reader has released it, so a full ring
+ * makes the producer wait in GetNextToWriteTo() for the slowest reader. Lag() and SlowestReader() let the producer or a
+ * monitor find out which reader is holding it back.
+ *
+ * Writes and reads follow the two-phase protocol of LockFreeQueue. The producer can read a slot it got from
+ * GetNextToWriteTo() until it moves on, and can publish several written slots at once with PublishWriteIndex(). Like in
+ * LockFreeQueue, each cursor lives on its own cache line next to the copy of the write index its reader last loaded,
+ * and the producer only reloads the reader cursors when its copy of the slowest one says the ring is full.
+ */
+template <typename T>
+class BroadcastQueue final {
+   public:
+    BroadcastQueue(std::size_t num_elems, std::size_t num_readers)
+        : store_(std::bit_ceil(num_elems), T()), MASK(store_.size() - 1), readers_(num_readers) {
+        ASSERT(num_readers != 0, "A broadcast queue needs at least one reader.");
+    }
+
+    auto GetNextToWriteTo() noexcept {
+        WaitForFreeSlot();
+        return &store_[next_write_index_ & MASK];
+    }
+
+    auto UpdateWriteIndex() noexcept {
+        ++next_write_index_;
+        PublishWriteIndex();
+    }
+
+    // Commit the slot returned by GetNextToWriteTo() without making it visible to the readers yet.
+    auto AdvanceWriteIndex() noexcept { ++next_write_index_; }
+
+    // Make every slot committed so far visible to the readers.
+    auto PublishWriteIndex() noexcept {
+        if (write_index_.load(std::memory_order_relaxed) != next_write_index_) {
+            write_index_.store(next_write_index_, std::memory_order_release);
+        }
+    }
+
+    auto GetNextToRead(size_t reader) const noexcept -> const T * {
+        const auto &cursor = readers_[reader];
+        const auto read_index = cursor.read_index_.load(std::memory_order_relaxed);
+        if (read_index == cursor.cached_write_index_) {
+            cursor.cached_write_index_ = write_index_.load(std::memory_order_acquire);
+            if (read_index == cursor.cached_write_index_) {
+                return nullptr;
+            }
+        }
+        return &store_[read_index & MASK];
+    }
+
+    // Every element the reader can read up to the end of the store, or an empty span if there is none. Elements that
+    // wrapped around are returned by the next call.
+    auto GetAllToRead(size_t reader) const noexcept -> std::span<const T> {
+        const auto &cursor = readers_[reader];
+        const auto read_index = cursor.read_index_.load(std::memory_order_relaxed);
+        if (read_index == cursor.cached_write_index_) {
+            cursor.cached_write_index_ = write_index_.load(std::memory_order_acquire);
+        }
+        const auto offset = read_index & MASK;
+        return {&store_[offset], std::min(cursor.cached_write_index_ - read_index, store_.size() - offset)};
+    }
+
+    auto UpdateReadIndex(size_t reader) noexcept { UpdateReadIndex(reader, 1); }
+
+    // Release the first count elements returned to the reader by GetAllToRead().
+    auto UpdateReadIndex(size_t reader, size_t count) noexcept {
+        auto &cursor = readers_[reader];
+        const auto read_index = cursor.read_index_.load(std::memory_order_relaxed);
+#if !defined(NDEBUG)  // the check reloads the write index and builds its message on every read.
+        ASSERT(count <= write_index_.load(std::memory_order_acquire) - read_index,
+               "Read an invalid element in:" + std::to_string(pthread_self()));
+#endif
+        cursor.read_index_.store(read_index + count, std::memory_order_release);
+    }
+
+    // Number of published elements the reader has not released yet.
+    auto Lag(size_t reader) const noexcept {
+        const auto read_index = readers_[reader].read_index_.load(std::memory_order_acquire);
+        return write_index_.load(std::memory_order_acquire) - read_index;
+    }
+
+    // Reader with the largest Lag(), i.e. the one the producer would wait for once the ring is full.
+    auto SlowestReader() const noexcept {
+        size_t slowest = 0;
+        MinReadIndex(&slowest);
+        return slowest;
+    }
+
+    auto NumReaders() const noexcept { return readers_.size(); }
+
+    auto Capacity() const noexcept { return store_.size(); }
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    BroadcastQueue() = delete;
+
+    BroadcastQueue(const BroadcastQueue &) = delete;
+
+    BroadcastQueue(const BroadcastQueue &&) = delete;
+
+    auto operator=(const BroadcastQueue &) -> BroadcastQueue & = delete;
+
+    auto operator=(const BroadcastQueue &&) -> BroadcastQueue & = delete;
+
+   private:
+    // Written by its reader only.
+    struct alignas(64) ReaderCursor {
+        std::atomic<size_t> read_index_ = {0};
+        mutable size_t cached_write_index_ = 0;
+    };
+
+    std::vector<T> store_;
+    const size_t MASK;
+    std::vector<ReaderCursor> readers_;
+
+    // Written by the producer only. Slots below next_write_index_ are written, the ones below write_index_ are visible
+    // to the readers.
+    alignas(64) std::atomic<size_t> write_index_ = {0};
+    size_t next_write_index_ = 0;
+    size_t cached_min_read_index_ = 0;
+
+    // Read index of the slowest reader, whose position is written to slowest if not null. Each cursor is loaded once,
+    // so the result never exceeds the read index of any reader.
+    auto MinReadIndex(size_t *slowest) const noexcept {
+        auto min_read_index = readers_[0].read_index_.load(std::memory_order_acquire);
+        for (size_t reader = 1; reader < readers_.size(); ++reader) {
+            const auto read_index = readers_[reader].read_index_.load(std::memory_order_acquire);
+            if (read_index < min_read_index) {
+                min_read_index = read_index;
+                if (slowest != nullptr) {
+                    *slowest = reader;
+                }
+            }
+        }
+        return min_read_index;
+    }
+
+    // Waits until the slowest reader has released at least one slot. Written slots that are not published yet are
+    // published before waiting, since the readers could otherwise never release a slot.
+    auto WaitForFreeSlot() noexcept {
+        if (next_write_index_ - cached_min_read_index_ == store_.size()) [[unlikely]] {
+            PublishWriteIndex();
+            do {
+                cached_min_read_index_ = MinReadIndex(nullptr);
+            } while (next_write_index_ - cached_min_read_index_ == store_.size());
+        }
+    }
+};
+
+}  // namespace common
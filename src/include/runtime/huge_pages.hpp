@@ -0,0 +1,233 @@
+/*
+ * huge_pages.hpp
+ * Backing storage for the large, fixed-sized arrays used on the hot path. Arrays are mapped on explicit huge pages
+ * where the system has them, placed on the NUMA node of the thread that uses them, and locked and prefaulted up front,
+ * so that neither page faults nor TLB misses on freshly touched pages land in the middle of processing.
+ */
+
+#pragma once
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <system_error>
+
+#include "common/integrity.hpp"
+
+#if !defined(MAP_HUGE_SHIFT)
+#define MAP_HUGE_SHIFT 26
+#endif
+#if !defined(MAP_HUGE_2MB)
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#if !defined(MAP_HUGE_1GB)
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+namespace common {
+
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+constexpr size_t GIGANTIC_PAGE_SIZE = 1024 * 1024 * 1024;
+
+constexpr int NUMA_NODE_ANY = -1;
+
+/*
+ * NumaNodeOfCore returns the NUMA node the CPU core belongs to, or NUMA_NODE_ANY if the core is -1 (i.e. the thread is
+ * not pinned) or the system does not expose its NUMA topology.
+ */
+inline auto NumaNodeOfCore(int core_id) noexcept -> int {
+    if (core_id < 0) {
+        return NUMA_NODE_ANY;
+    }
+
+    std::error_code error;
+    std::filesystem::directory_iterator itr("/sys/devices/system/cpu/cpu" + std::to_string(core_id), error);
+    for (; !error && itr != std::filesystem::directory_iterator(); itr.increment(error)) {
+        const auto name = itr->path().filename().string();
+        if (name.size() > 4 && name.starts_with("node") && std::isdigit(name[4]) != 0) {
+            return std::atoi(name.c_str() + 4);
+        }
+    }
+    return NUMA_NODE_ANY;
+}
+
+namespace internal {
+inline thread_local int preferred_memory_node = NUMA_NODE_ANY;
+}  // namespace internal
+
+// NUMA node that HugePageArrays created by the calling thread are placed on by default.
+inline auto PreferredMemoryNode() noexcept { return internal::preferred_memory_node; }
+
+inline auto SetPreferredMemoryNode(int numa_node) noexcept { internal::preferred_memory_node = numa_node; }
+
+/*
+ * MemoryNodeScope places the HugePageArrays the calling thread creates during its lifetime on the provided NUMA node.
+ * Meant for components that build their state on the main thread before handing it over to a thread pinned elsewhere.
+ */
+class MemoryNodeScope final {
+   public:
+    explicit MemoryNodeScope(int numa_node) : previous_node_(PreferredMemoryNode()) {
+        SetPreferredMemoryNode(numa_node);
+    }
+
+    ~MemoryNodeScope() { SetPreferredMemoryNode(previous_node_); }
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    MemoryNodeScope() = delete;
+
+    MemoryNodeScope(const MemoryNodeScope &) = delete;
+
+    MemoryNodeScope(const MemoryNodeScope &&) = delete;
+
+    auto operator=(const MemoryNodeScope &) -> MemoryNodeScope & = delete;
+
+    auto operator=(const MemoryNodeScope &&) -> MemoryNodeScope & = delete;
+
+   private:
+    const int previous_node_;
+};
+
+/*
+ * Fixed-sized array of value-initialized T objects, allocated once at construction.
+ *
+ * Arrays of at least a gigantic page try 1 GB huge pages first, arrays of at least half a huge page try 2 MB huge
+ * pages, and everything else, as well as arrays for which the system has no huge pages reserved, falls back to regular
+ * pages with transparent huge pages requested. The mapping then prefers the provided NUMA node, is locked into memory
+ * and every page of it is faulted in before the objects are constructed. Failing to lock, e.g. for lack of privileges
+ * or a too low RLIMIT_MEMLOCK, is reported once and otherwise ignored.
+ */
+template <typename T>
+class HugePageArray final {
+   public:
+    explicit HugePageArray(std::size_t num_elems, int numa_node = PreferredMemoryNode()) : size_(num_elems) {
+        static_assert(alignof(T) <= 4096, "HugePageArray only guarantees page alignment.");
+        if (size_ == 0) {
+            return;
+        }
+
+        Map(size_ * sizeof(T), numa_node);
+        std::uninitialized_value_construct_n(data_, size_);
+    }
+
+    ~HugePageArray() {
+        if (data_ != nullptr) {
+            std::destroy_n(data_, size_);
+            munmap(data_, mapped_bytes_);
+        }
+    }
+
+    auto operator[](std::size_t index) noexcept -> T & { return data_[index]; }
+
+    auto operator[](std::size_t index) const noexcept -> const T & { return data_[index]; }
+
+    auto at(std::size_t index) noexcept -> T & {  // NOLINT(readability-identifier-naming)
+        ASSERT(index < size_, "HugePageArray index out of range:" + std::to_string(index));
+        return data_[index];
+    }
+
+    auto fill(const T &value) noexcept {  // NOLINT(readability-identifier-naming)
+        std::fill(data_, data_ + size_, value);
+    }
+
+    auto data() noexcept { return data_; }  // NOLINT(readability-identifier-naming)
+
+    auto data() const noexcept -> const T * { return data_; }  // NOLINT(readability-identifier-naming)
+
+    auto size() const noexcept { return size_; }  // NOLINT(readability-identifier-naming)
+
+    auto begin() noexcept { return data_; }  // NOLINT(readability-identifier-naming)
+
+    auto begin() const noexcept -> const T * { return data_; }  // NOLINT(readability-identifier-naming)
+
+    auto end() noexcept { return data_ + size_; }  // NOLINT(readability-identifier-naming)
+
+    auto end() const noexcept -> const T * { return data_ + size_; }  // NOLINT(readability-identifier-naming)
+
+    // Size of the pages backing the array.
+    auto PageSize() const noexcept { return page_size_; }
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    HugePageArray() = delete;
+
+    HugePageArray(const HugePageArray &) = delete;
+
+    HugePageArray(const HugePageArray &&) = delete;
+
+    auto operator=(const HugePageArray &) -> HugePageArray & = delete;
+
+    auto operator=(const HugePageArray &&) -> HugePageArray & = delete;
+
+   private:
+    // Memory policy mode of mbind(2). Preferring the node rather than binding to it keeps a node that runs out of huge
+    // pages from turning into SIGBUS on first touch.
+    static constexpr int MPOL_PREFERRED_MODE = 1;
+
+    T *data_ = nullptr;
+    const std::size_t size_;
+    std::size_t mapped_bytes_ = 0;
+    std::size_t page_size_ = 0;
+
+    auto TryMap(std::size_t bytes, std::size_t page_size, int flags) noexcept {
+        const auto mapped_bytes = (bytes + page_size - 1) / page_size * page_size;
+        auto addr = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+        if (addr == MAP_FAILED) {
+            return false;
+        }
+
+        data_ = static_cast<T *>(addr);
+        mapped_bytes_ = mapped_bytes;
+        page_size_ = page_size;
+        return true;
+    }
+
+    auto Map(std::size_t bytes, int numa_node) noexcept {
+        const auto small_page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        if (!(bytes >= GIGANTIC_PAGE_SIZE && TryMap(bytes, GIGANTIC_PAGE_SIZE, MAP_HUGETLB | MAP_HUGE_1GB)) &&
+            !(bytes >= HUGE_PAGE_SIZE / 2 && TryMap(bytes, HUGE_PAGE_SIZE, MAP_HUGETLB | MAP_HUGE_2MB))) {
+            if (!TryMap(bytes, small_page_size, 0)) {
+                FATAL("Failed to map " + std::to_string(bytes) + " bytes: " + std::strerror(errno));
+                return;
+            }
+            if (bytes >= HUGE_PAGE_SIZE) {
+                madvise(data_, mapped_bytes_, MADV_HUGEPAGE);
+            }
+        }
+
+        if (numa_node >= 0) {
+            std::array<unsigned long, 4> node_mask = {};
+            const auto max_node = node_mask.size() * 64;
+            if (static_cast<std::size_t>(numa_node) < max_node) {
+                node_mask[numa_node / 64] = 1UL << (numa_node % 64);
+                syscall(SYS_mbind, data_, mapped_bytes_, MPOL_PREFERRED_MODE, node_mask.data(), max_node, 0);
+            }
+        }
+
+        if (mlock(data_, mapped_bytes_) != 0) {
+            static std::atomic<bool> reported = false;
+            if (!reported.exchange(true)) {
+                std::cerr << "Failed to lock " << mapped_bytes_ << " bytes into memory: " << std::strerror(errno)
+                          << ". Pages of HugePageArrays may be swapped out." << '\n';
+            }
+        }
+
+        // mlock() already faults in the pages it locks, but it might have failed.
+        for (std::size_t offset = 0; offset < mapped_bytes_; offset += page_size_) {
+            reinterpret_cast<volatile char *>(data_)[offset] = 0;
+        }
+    }
+};
+
+}  // namespace common
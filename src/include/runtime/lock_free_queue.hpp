@@ -8,12 +8,17 @@
 
 #include <pthread.h>
 
+#include <algorithm>
 #include <atomic>
+#include <bit>
 #include <cstddef>
+#include <span>
+#include <stop_token>
 #include <string>
 #include <vector>
 
 #include "common/integrity.hpp"
+#include "wait_strategy.hpp"
 
 namespace common {
 
@@ -23,28 +28,132 @@ namespace common {
  * The queue implements two-phase write and read operations. This enables partial writes, minimizing atomic operations
  * and optimizing memory usage. Moreover, it simplifies shared data management, as consumption and production is only
  * visible after "commits" done via the Update* methods.
+ *
+ * The write and read indices only ever increase and are mapped onto the store with a mask, so the capacity is rounded
+ * up to a power of two. Each index lives on its own cache line, next to the copy of the other index its owner last
+ * loaded. The owner only reloads the other index when that copy says the queue is full or empty, so in the common case
+ * producer and consumer do not touch each other's cache line at all.
+ *
+ * A full queue makes the producer wait in GetNextToWriteTo() until the consumer frees a slot, or until the producer is
+ * asked to stop, since the consumer may have stopped already. A producer that must never wait, e.g. because it also
+ * consumes what its consumer produces, uses TryGetNextToWriteTo() and holds back its input while the queue is full.
+ *
+ * Bursts can be moved with fewer atomic operations. The producer can write several elements with AdvanceWriteIndex()
+ * and make all of them visible with one PublishWriteIndex(), or fill a span of contiguous slots and commit it with
+ * UpdateWriteIndex(count). The consumer can take a span of every readable element with GetAllToRead() and release it
+ * with UpdateReadIndex(count).
+ *
+ * A consumer that parks while the queue is empty can have its doorbell rung whenever new elements are published.
  */
 template <typename T>
 class LockFreeQueue final {
    public:
-    explicit LockFreeQueue(std::size_t num_elems) : store_(num_elems, T()) {}
+    explicit LockFreeQueue(std::size_t num_elems) : store_(std::bit_ceil(num_elems), T()), MASK(store_.size() - 1) {}
+
+    // The next free slot, waiting for the consumer to free one if the queue is full. Returns nullptr, and the element
+    // is to be dropped, if the stop of the producer is requested while waiting.
+    auto GetNextToWriteTo(const std::stop_token &stop_token) noexcept -> T * {
+        if (NumFreeSlots() == 0) [[unlikely]] {
+            do {
+                if (stop_token.stop_requested()) {
+                    return nullptr;
+                }
+                CpuRelax();
+            } while (NumFreeSlots() == 0);
+        }
+        return &store_[next_write_index_ & MASK];
+    }
+
+    // The next free slot, or nullptr if the queue is full.
+    auto TryGetNextToWriteTo() noexcept -> T * {
+        return (NumFreeSlots() != 0 ? &store_[next_write_index_ & MASK] : nullptr);
+    }
 
-    auto GetNextToWriteTo() noexcept { return &store_[next_write_index_]; }
+    // Up to count contiguous free slots, waiting until there is at least one. Fewer are returned when the free slots
+    // wrap around the end of the store. Only for producers whose consumer runs until every producer is done, like the
+    // one of a Logger, since the wait cannot be stopped.
+    auto GetNextToWriteTo(size_t count) noexcept -> std::span<T> {
+        auto num_free = NumFreeSlots();
+        while (num_free == 0) {
+            CpuRelax();
+            num_free = NumFreeSlots();
+        }
+        const auto offset = next_write_index_ & MASK;
+        return {&store_[offset], std::min({count, num_free, store_.size() - offset})};
+    }
 
     auto UpdateWriteIndex() noexcept {
-        next_write_index_ = (next_write_index_ + 1) % store_.size();
-        num_elements_++;
+        ++next_write_index_;
+        PublishWriteIndex();
+    }
+
+    // Commit the first count slots returned by GetNextToWriteTo(count).
+    auto UpdateWriteIndex(size_t count) noexcept {
+        next_write_index_ += count;
+        PublishWriteIndex();
     }
 
-    auto GetNextToRead() const noexcept -> const T * { return (Size() ? &store_[next_read_index_] : nullptr); }
+    // Commit the slot returned by GetNextToWriteTo() without making it visible to the consumer yet.
+    auto AdvanceWriteIndex() noexcept { ++next_write_index_; }
+
+    // Commit the first count slots returned by GetNextToWriteTo(count) without making them visible to the consumer yet.
+    auto AdvanceWriteIndex(size_t count) noexcept { next_write_index_ += count; }
 
-    auto UpdateReadIndex() noexcept {
-        next_read_index_ = (next_read_index_ + 1) % store_.size();
-        ASSERT(num_elements_ != 0, "Read an invalid element in:" + std::to_string(pthread_self()));
-        num_elements_--;
+    // Make every slot committed so far visible to the consumer.
+    auto PublishWriteIndex() noexcept {
+        if (write_index_.load(std::memory_order_relaxed) != next_write_index_) {
+            write_index_.store(next_write_index_, std::memory_order_release);
+            if (doorbell_ != nullptr) {
+                doorbell_->Ring();
+            }
+        }
     }
 
-    auto Size() const noexcept { return num_elements_.load(); }
+    // Doorbell to ring whenever elements are published, or nullptr for none. Must be set before the producer starts.
+    auto SetDoorbell(Doorbell *doorbell) noexcept { doorbell_ = doorbell; }
+
+    auto GetNextToRead() const noexcept -> const T * {
+        const auto read_index = read_index_.load(std::memory_order_relaxed);
+        if (read_index == cached_write_index_) {
+            cached_write_index_ = write_index_.load(std::memory_order_acquire);
+            if (read_index == cached_write_index_) {
+                return nullptr;
+            }
+        }
+        return &store_[read_index & MASK];
+    }
+
+    // Every readable element up to the end of the store, or an empty span if there is none. Elements that wrapped
+    // around are returned by the next call.
+    auto GetAllToRead() const noexcept -> std::span<const T> {
+        const auto read_index = read_index_.load(std::memory_order_relaxed);
+        if (read_index == cached_write_index_) {
+            cached_write_index_ = write_index_.load(std::memory_order_acquire);
+        }
+        const auto offset = read_index & MASK;
+        return {&store_[offset], std::min(cached_write_index_ - read_index, store_.size() - offset)};
+    }
+
+    auto UpdateReadIndex() noexcept { UpdateReadIndex(1); }
+
+    // Release the first count elements returned by GetAllToRead().
+    auto UpdateReadIndex(size_t count) noexcept {
+        const auto read_index = read_index_.load(std::memory_order_relaxed);
+#if !defined(NDEBUG)  // the check reloads the write index and builds its message on every read.
+        ASSERT(count <= write_index_.load(std::memory_order_acquire) - read_index,
+               "Read an invalid element in:" + std::to_string(pthread_self()));
+#endif
+        read_index_.store(read_index + count, std::memory_order_release);
+    }
+
+    // Number of elements written and not read yet. Exact when called by the producer or the consumer while the other
+    // side is idle, a snapshot otherwise.
+    auto Size() const noexcept {
+        const auto read_index = read_index_.load(std::memory_order_acquire);
+        return write_index_.load(std::memory_order_acquire) - read_index;
+    }
+
+    auto Capacity() const noexcept { return store_.size(); }
 
     // Deleted default, copy & move constructors and assignment-operators.
     LockFreeQueue() = delete;
@@ -59,11 +168,28 @@ class LockFreeQueue final {
 
    private:
     std::vector<T> store_;
-
-    std::atomic<size_t> next_write_index_ = {0};
-    std::atomic<size_t> next_read_index_ = {0};
-
-    std::atomic<size_t> num_elements_ = {0};
+    const size_t MASK;
+
+    // Written by the producer only. Slots below next_write_index_ are written, the ones below write_index_ are visible
+    // to the consumer.
+    alignas(64) std::atomic<size_t> write_index_ = {0};
+    size_t next_write_index_ = 0;
+    size_t cached_read_index_ = 0;
+    Doorbell *doorbell_ = nullptr;
+
+    // Written by the consumer only.
+    alignas(64) std::atomic<size_t> read_index_ = {0};
+    mutable size_t cached_write_index_ = 0;
+
+    // Number of free slots, only reloading the read index when the cached one says there is none. Written slots that
+    // are not published yet are published then, since the consumer could otherwise never free a slot.
+    auto NumFreeSlots() noexcept -> size_t {
+        if (next_write_index_ - cached_read_index_ == store_.size()) [[unlikely]] {
+            PublishWriteIndex();
+            cached_read_index_ = read_index_.load(std::memory_order_acquire);
+        }
+        return store_.size() - (next_write_index_ - cached_read_index_);
+    }
 };
 
 }  // namespace common
@@ -1,46 +1,123 @@
 /*
  * memory_pool.hpp
- * Implements a simple memory pool that tracks allocation on-heap.
+ * Implements a simple memory pool that tracks allocation in preallocated, huge page backed chunks.
  */
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <sstream>
 #include <string>
 #include <vector>
 
 #include "common/integrity.hpp"
+#include "runtime/huge_pages.hpp"
 
 namespace common {
 
+// Occupancy counters of a MemoryPool since its construction.
+struct MemoryPoolStats {
+    size_t capacity_ = 0;
+    size_t num_chunks_ = 0;
+    size_t in_use_ = 0;
+    size_t high_water_mark_ = 0;
+    uint64_t allocations_ = 0;
+    uint64_t deallocations_ = 0;
+
+    auto ToString() const {
+        std::stringstream ss;
+        ss << "MemoryPoolStats[capacity:" << capacity_ << " chunks:" << num_chunks_ << " in_use:" << in_use_
+           << " high_water_mark:" << high_water_mark_ << " allocations:" << allocations_
+           << " deallocations:" << deallocations_ << "]";
+        return ss.str();
+    }
+};
+
+/*
+ * Pool of T objects with O(1) allocation and deallocation, made of chunks of CHUNK_ELEMS objects each.
+ *
+ * Free blocks form an intrusive singly-linked list: a free block holds a pointer to the next free block in place of its
+ * object, so tracking free blocks takes no memory beyond the objects themselves. Deallocated blocks are pushed on the
+ * front of the list and handed out first again, while they are still likely to be in cache.
+ *
+ * The pool starts out with a single chunk. Allocating from an exhausted pool adds another one on a cold path, which
+ * never moves existing objects. Exhausting MAX_CHUNKS chunks is fatal in every build type. Stats() reports occupancy
+ * and the high-water mark, so that pools can be sized from real data. Neither growing nor the counters are thread-safe;
+ * a pool belongs to a single thread.
+ *
+ * Mapping and prefaulting a chunk takes milliseconds, so once fewer than a quarter of a chunk's blocks are free the
+ * pool asks for a spare chunk. A helper thread that calls PrepareSpareChunk() maps it ahead of time, on the NUMA node
+ * the pool was constructed on, and the owning thread only links it in. Without a helper, or if it is late, the owning
+ * thread maps the chunk itself.
+ *
+ * Debug builds additionally track which blocks are in use in a separate bitmap to catch double frees.
+ */
 template <typename T>
 class MemoryPool final {
    public:
-    explicit MemoryPool(std::size_t num_elems) : store_(num_elems, {T(), true}) {
-        // Ensure that object_ is the first member of ObjectBlock such that pointer to object_ points to its owning
-        // ObjectBlock, too.
-        ASSERT(reinterpret_cast<const ObjectBlock *>(&(store_[0].object_)) == store_.data(),
-               "T object should be first member of ObjectBlock.");
+    static constexpr size_t DEFAULT_MAX_CHUNKS = 16;
+
+    explicit MemoryPool(std::size_t chunk_elems, std::size_t max_chunks = DEFAULT_MAX_CHUNKS)
+        : CHUNK_ELEMS(chunk_elems), MAX_CHUNKS(max_chunks) {
+        ASSERT(chunk_elems != 0 && max_chunks != 0,
+               "Invalid Memory Pool size:" + std::to_string(chunk_elems) + "x" + std::to_string(max_chunks));
+        chunks_.reserve(MAX_CHUNKS);
+        AddChunk();
     }
 
+    ~MemoryPool() { delete spare_chunk_.load(std::memory_order_acquire); }
+
     template <typename... Args>
     auto Allocate(Args... args) noexcept -> T * {
-        auto obj_block = &(store_[next_free_index_]);
-        ASSERT(obj_block->is_free_, "Expected free ObjectBlock at index:" + std::to_string(next_free_index_));
-        T *ret = &(obj_block->object_);
-        ret = new (ret) T(args...);  // placement new.
-        obj_block->is_free_ = false;
-
-        UpdateNextFreeIndex();
+        if (free_head_ == nullptr) [[unlikely]] {
+            AddChunk();
+        }
+        auto obj_block = free_head_;
+        free_head_ = obj_block->next_free_;
+#if !defined(NDEBUG)
+        const auto index = BlockIndex(obj_block);
+        ASSERT(!in_use_[index], "Expected free ObjectBlock at index:" + std::to_string(index));
+        in_use_[index] = true;
+#endif
+        ++stats_.allocations_;
+        stats_.high_water_mark_ = std::max(stats_.high_water_mark_, ++stats_.in_use_);
+        if (stats_.in_use_ == spare_threshold_) [[unlikely]] {
+            spare_wanted_.store(true, std::memory_order_release);
+        }
 
-        return ret;
+        return new (&(obj_block->object_)) T(args...);  // placement new.
     }
 
     auto Deallocate(const T *elem) noexcept {
-        const auto elem_index = (reinterpret_cast<const ObjectBlock *>(elem) - store_.data());
-        ASSERT(elem_index >= 0 && static_cast<size_t>(elem_index) < store_.size(),
-               "Element being deallocated does not belong to this Memory pool.");
-        ASSERT(!store_[elem_index].is_free_, "Expected in-use ObjectBlock at index:" + std::to_string(elem_index));
-        store_[elem_index].is_free_ = true;
+        // object_ is the first member of ObjectBlock, so the object and its block share their address.
+        auto obj_block = reinterpret_cast<ObjectBlock *>(const_cast<T *>(elem));
+#if !defined(NDEBUG)
+        const auto index = BlockIndex(obj_block);
+        ASSERT(index != INDEX_INVALID, "Element being deallocated does not belong to this Memory pool.");
+        ASSERT(in_use_[index], "Expected in-use ObjectBlock at index:" + std::to_string(index));
+        in_use_[index] = false;
+#endif
+        elem->~T();
+
+        obj_block->next_free_ = free_head_;
+        free_head_ = obj_block;
+        ++stats_.deallocations_;
+        --stats_.in_use_;
+    }
+
+    auto Stats() const noexcept -> const MemoryPoolStats & { return stats_; }
+
+    // Map the spare chunk the pool asked for, if it did. Safe to call from one helper thread other than the owning one.
+    auto PrepareSpareChunk() noexcept {
+        if (!spare_wanted_.load(std::memory_order_acquire) || spare_chunk_.load(std::memory_order_acquire) != nullptr) {
+            return;
+        }
+        spare_wanted_.store(false, std::memory_order_relaxed);
+        spare_chunk_.store(NewChunk().release(), std::memory_order_release);
     }
 
     // Deleted default, copy & move constructors and assignment-operators.
@@ -55,30 +132,86 @@ class MemoryPool final {
     auto operator=(const MemoryPool &&) -> MemoryPool & = delete;
 
    private:
-    struct ObjectBlock {
+    // Holds either a live object or, while free, the next free block.
+    union ObjectBlock {
+        ObjectBlock() : next_free_(nullptr) {}
+
+        ~ObjectBlock() {}
+
         T object_;
-        bool is_free_ = true;
+        ObjectBlock *next_free_;
     };
 
+    const size_t CHUNK_ELEMS;
+    const size_t MAX_CHUNKS;
+    const int NUMA_NODE = PreferredMemoryNode();
+
     // std::array not preferred; It is good to have objects on the stack, but performance starts getting worse as the
-    // size of the pool increases.
-    std::vector<ObjectBlock> store_;
+    // size of the pool increases. Reserved for MAX_CHUNKS up front, so adding a chunk never moves the others.
+    std::vector<std::unique_ptr<HugePageArray<ObjectBlock>>> chunks_;
 
-    size_t next_free_index_ = 0;
+    // First free block, nullptr once every chunk is full.
+    ObjectBlock *free_head_ = nullptr;
 
-    auto UpdateNextFreeIndex() noexcept {
-        const auto initial_free_index = next_free_index_;
-        while (!store_[next_free_index_].is_free_) {
-            ++next_free_index_;
+    MemoryPoolStats stats_;
 
-            // hardware branch predictor should typically never predict this --> minimal cost of if.
-            if (next_free_index_ == store_.size()) [[unlikely]] {
-                next_free_index_ = 0;
-            }
-            if (initial_free_index == next_free_index_) [[unlikely]] {
-                ASSERT(initial_free_index != next_free_index_, "Memory Pool out of space.");
+    // Number of blocks in use at which a spare chunk is asked for, never reached once the pool cannot grow any more.
+    size_t spare_threshold_ = 0;
+    std::atomic<bool> spare_wanted_ = {false};
+    // Set by the helper thread, taken by the owning thread.
+    std::atomic<HugePageArray<ObjectBlock> *> spare_chunk_ = {nullptr};
+
+#if !defined(NDEBUG)
+    static constexpr auto INDEX_INVALID = std::numeric_limits<size_t>::max();
+
+    std::vector<bool> in_use_;
+
+    // Position of the block across all chunks, INDEX_INVALID if it does not belong to this pool.
+    auto BlockIndex(const ObjectBlock *obj_block) const noexcept {
+        for (size_t i = 0; i < chunks_.size(); ++i) {
+            const auto offset = obj_block - chunks_[i]->data();
+            if (offset >= 0 && static_cast<size_t>(offset) < CHUNK_ELEMS) {
+                return i * CHUNK_ELEMS + static_cast<size_t>(offset);
             }
         }
+        return INDEX_INVALID;
+    }
+#endif
+
+    // Maps a chunk and links all of its blocks in order, the last one to nullptr.
+    auto NewChunk() const noexcept {
+        auto chunk = std::make_unique<HugePageArray<ObjectBlock>>(CHUNK_ELEMS, NUMA_NODE);
+        // Ensure that object_ is at the start of ObjectBlock such that pointer to object_ points to its owning
+        // ObjectBlock, too.
+        ASSERT(reinterpret_cast<const ObjectBlock *>(&((*chunk)[0].object_)) == chunk->data(),
+               "T object should be first member of ObjectBlock.");
+
+        for (size_t i = 0; i + 1 < CHUNK_ELEMS; ++i) {
+            (*chunk)[i].next_free_ = &(*chunk)[i + 1];
+        }
+        return chunk;
+    }
+
+    // Adds the spare chunk, or else a new one, and links all of its blocks, in order, in front of the free list.
+    [[gnu::cold, gnu::noinline]] void AddChunk() noexcept {
+        if (chunks_.size() == MAX_CHUNKS) {
+            FATAL("Memory Pool out of space. " + stats_.ToString());
+            return;
+        }
+
+        spare_wanted_.store(false, std::memory_order_relaxed);
+        std::unique_ptr<HugePageArray<ObjectBlock>> spare_chunk(
+            spare_chunk_.exchange(nullptr, std::memory_order_acquire));
+        auto &chunk = *chunks_.emplace_back(spare_chunk != nullptr ? std::move(spare_chunk) : NewChunk());
+        chunk[CHUNK_ELEMS - 1].next_free_ = free_head_;
+        free_head_ = chunk.data();
+
+        stats_.capacity_ += CHUNK_ELEMS;
+        stats_.num_chunks_ = chunks_.size();
+        spare_threshold_ = (chunks_.size() < MAX_CHUNKS ? stats_.capacity_ - CHUNK_ELEMS / 4 : 0);
+#if !defined(NDEBUG)
+        in_use_.resize(stats_.capacity_, false);
+#endif
     }
 };
 }  // namespace common
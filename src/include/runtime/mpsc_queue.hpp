@@ -0,0 +1,121 @@
+/*
+ * mpsc_queue.hpp
+ * Provides implementation of a generic, fixed-sized, lock-free queue for the Multiple Producer Single Consumer
+ * paradigm.
+ */
+
+#pragma once
+
+#include <pthread.h>
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "common/integrity.hpp"
+
+namespace common {
+
+/*
+ * Multiple Producer Single Consumer, fixed-sized, lock-free queue.
+ *
+ * A producer claims a run of consecutive slots with a single compare-and-swap on the shared write index, fills them and
+ * then publishes them. Claiming several slots at once lets a producer hand over a burst with one contended operation,
+ * and since a run is claimed as a whole, the elements of one producer are read in the order it wrote them.
+ *
+ * Producers publish independently of each other, so every slot carries the index it was last published under. The
+ * consumer reads slots strictly in index order and stops at the first one that is not published yet, even if later
+ * slots are. The capacity is rounded up to a power of two.
+ */
+template <typename T>
+class MPSCQueue final {
+   public:
+    static constexpr size_t INDEX_INVALID = std::numeric_limits<size_t>::max();
+
+    explicit MPSCQueue(std::size_t num_elems) : store_(std::bit_ceil(num_elems)), MASK(store_.size() - 1) {}
+
+    // Claim count consecutive slots and return the index of the first one, or INDEX_INVALID if the queue does not have
+    // that many free slots.
+    auto TryClaimWrite(size_t count = 1) noexcept -> size_t {
+        ASSERT(count != 0 && count <= store_.size(), "Invalid number of slots to claim:" + std::to_string(count));
+        auto write_index = write_index_.load(std::memory_order_relaxed);
+        do {
+            if (write_index + count - read_index_.load(std::memory_order_acquire) > store_.size()) {
+                return INDEX_INVALID;
+            }
+        } while (!write_index_.compare_exchange_weak(write_index, write_index + count, std::memory_order_relaxed));
+        return write_index;
+    }
+
+    // Claim count consecutive slots, waiting for the consumer to free them if needed. Returns the index of the first.
+    auto ClaimWrite(size_t count = 1) noexcept {
+        auto index = TryClaimWrite(count);
+        while (index == INDEX_INVALID) {
+            index = TryClaimWrite(count);
+        }
+        return index;
+    }
+
+    // Slot to write to for a claimed index.
+    auto GetWriteSlot(size_t index) noexcept { return &store_[index & MASK].value_; }
+
+    // Make the count claimed slots starting at index visible to the consumer.
+    auto PublishWrite(size_t index, size_t count = 1) noexcept {
+        for (size_t i = index; i < index + count; ++i) {
+            store_[i & MASK].sequence_.store(i + 1, std::memory_order_release);
+        }
+    }
+
+    auto GetNextToRead() const noexcept -> const T * {
+        const auto read_index = read_index_.load(std::memory_order_relaxed);
+        const auto &slot = store_[read_index & MASK];
+        return (slot.sequence_.load(std::memory_order_acquire) == read_index + 1 ? &slot.value_ : nullptr);
+    }
+
+    auto UpdateReadIndex() noexcept {
+        const auto read_index = read_index_.load(std::memory_order_relaxed);
+        ASSERT(store_[read_index & MASK].sequence_.load(std::memory_order_acquire) == read_index + 1,
+               "Read an invalid element in:" + std::to_string(pthread_self()));
+        read_index_.store(read_index + 1, std::memory_order_release);
+    }
+
+    // Number of claimed slots that have not been read yet, including the ones that are not published yet.
+    auto Size() const noexcept {
+        const auto read_index = read_index_.load(std::memory_order_acquire);
+        return write_index_.load(std::memory_order_acquire) - read_index;
+    }
+
+    auto Capacity() const noexcept { return store_.size(); }
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    MPSCQueue() = delete;
+
+    MPSCQueue(const MPSCQueue &) = delete;
+
+    MPSCQueue(const MPSCQueue &&) = delete;
+
+    auto operator=(const MPSCQueue &) -> MPSCQueue & = delete;
+
+    auto operator=(const MPSCQueue &&) -> MPSCQueue & = delete;
+
+   private:
+    struct Slot {
+        // Index + 1 of the last element published in this slot, 0 if there was none.
+        std::atomic<size_t> sequence_ = {0};
+        T value_ = T();
+    };
+
+    std::vector<Slot> store_;
+    const size_t MASK;
+
+    // Claimed by the producers.
+    alignas(64) std::atomic<size_t> write_index_ = {0};
+
+    // Written by the consumer only.
+    alignas(64) std::atomic<size_t> read_index_ = {0};
+};
+
+}  // namespace common
@@ -0,0 +1,255 @@
+/*
+ * price_ladder.hpp
+ * Implements a price ladder, a fixed-size array of price levels keyed by tick offset from a rolling reference price.
+ * Occupied levels of each side are tracked in a two-level bitmap, so finding the best level or the neighbouring level
+ * of a price takes a couple of bit-scan instructions rather than a walk over the levels.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <utility>
+
+#include "common/integrity.hpp"
+#include "common/types.hpp"
+
+namespace common {
+
+/*
+ * PriceLadder maps the prices of a window of NUM_TICKS consecutive ticks to the level stored at that price. Bids and
+ * asks share the window since a price can only hold orders of one side, but each side has its own occupancy bitmap.
+ *
+ * When a level is inserted at a price outside of the window, the window is re-centered around the range spanned by
+ * the existing levels and the new price. Re-centering is O(NUM_TICKS) but only happens when the market drifts. A price
+ * NUM_TICKS or more away from an existing level cannot be held at all, which CanHold() tells before inserting it.
+ */
+template <typename T>
+class PriceLadder final {
+   public:
+    static constexpr size_t NUM_TICKS = 64 * 64;
+
+    PriceLadder() noexcept { levels_.fill(nullptr); }
+
+    // Returns the level at the price, or nullptr if there is none.
+    auto Find(Price price) const noexcept -> T * {
+        return (InWindow(price) ? levels_[static_cast<size_t>(price - base_price_)] : nullptr);
+    }
+
+    // Whether a level can be inserted at the price, i.e. the price is less than NUM_TICKS away from every level.
+    auto CanHold(Price price) const noexcept {
+        if (InWindow(price)) [[likely]] {
+            return true;
+        }
+        const auto [low, high] = Span(price);
+        return Ticks(low, high) < NUM_TICKS;
+    }
+
+    // The price must be one CanHold().
+    auto Insert(Side side, Price price, T *level) noexcept {
+        if (!InWindow(price)) [[unlikely]] {
+            Recenter(price);
+        }
+
+        const auto index = static_cast<size_t>(price - base_price_);
+#if !defined(NDEBUG)
+        ASSERT(levels_[index] == nullptr, "PriceLadder already has a level at price:" + PriceToString(price));
+#endif
+        levels_[index] = level;
+        occupancy_[SideIndex(side)].Set(index);
+    }
+
+    auto Erase(Side side, Price price) noexcept {
+#if !defined(NDEBUG)
+        ASSERT(InWindow(price), "PriceLadder has no level at price:" + PriceToString(price));
+#endif
+        const auto index = static_cast<size_t>(price - base_price_);
+        levels_[index] = nullptr;
+        occupancy_[SideIndex(side)].Reset(index);
+    }
+
+    // Highest bid or lowest ask, or nullptr if the side is empty.
+    auto Best(Side side) const noexcept -> T * {
+        const auto &occupancy = occupancy_[SideIndex(side)];
+        return LevelAt(side == Side::BUY ? occupancy.HighestBelow(NUM_TICKS) : occupancy.LowestFrom(0));
+    }
+
+    // Closest level of the side that is more aggressive than the price, or nullptr if there is none.
+    auto NextBetter(Side side, Price price) const noexcept -> T * {
+        const auto index = static_cast<size_t>(price - base_price_);
+        const auto &occupancy = occupancy_[SideIndex(side)];
+        return LevelAt(side == Side::BUY ? occupancy.LowestFrom(index + 1) : occupancy.HighestBelow(index));
+    }
+
+    // Closest level of the side that is less aggressive than the price, or nullptr if there is none.
+    auto NextWorse(Side side, Price price) const noexcept -> T * {
+        const auto index = static_cast<size_t>(price - base_price_);
+        const auto &occupancy = occupancy_[SideIndex(side)];
+        return LevelAt(side == Side::BUY ? occupancy.HighestBelow(index) : occupancy.LowestFrom(index + 1));
+    }
+
+    auto Clear() noexcept {
+        levels_.fill(nullptr);
+        occupancy_.fill({});
+    }
+
+    // Deleted copy & move constructors and assignment-operators.
+    PriceLadder(const PriceLadder &) = delete;
+
+    PriceLadder(const PriceLadder &&) = delete;
+
+    auto operator=(const PriceLadder &) -> PriceLadder & = delete;
+
+    auto operator=(const PriceLadder &&) -> PriceLadder & = delete;
+
+   private:
+    static constexpr size_t INDEX_INVALID = NUM_TICKS;
+
+    // Bit i of words_ is set iff index i is occupied, and bit w of summary_ is set iff words_[w] is non-zero.
+    struct OccupancyBitmap {
+        uint64_t summary_ = 0;
+        std::array<uint64_t, 64> words_ = {};
+
+        auto Set(size_t index) noexcept {
+            words_[index >> 6U] |= (1ULL << (index & 63U));
+            summary_ |= (1ULL << (index >> 6U));
+        }
+
+        auto Reset(size_t index) noexcept {
+            auto &word = words_[index >> 6U];
+            word &= ~(1ULL << (index & 63U));
+            if (word == 0) {
+                summary_ &= ~(1ULL << (index >> 6U));
+            }
+        }
+
+        auto Empty() const noexcept { return summary_ == 0; }
+
+        // Lowest occupied index >= index, or INDEX_INVALID.
+        auto LowestFrom(size_t index) const noexcept -> size_t {
+            if (index >= NUM_TICKS) {
+                return INDEX_INVALID;
+            }
+
+            const auto word_index = index >> 6U;
+            const auto bits = words_[word_index] & ~LowBits(index & 63U);
+            if (bits != 0) {
+                return (word_index << 6U) + std::countr_zero(bits);
+            }
+
+            const auto words = summary_ & ~LowBits(word_index + 1);
+            if (words == 0) {
+                return INDEX_INVALID;
+            }
+            const auto next_word_index = static_cast<size_t>(std::countr_zero(words));
+            return (next_word_index << 6U) + std::countr_zero(words_[next_word_index]);
+        }
+
+        // Highest occupied index < index, or INDEX_INVALID.
+        auto HighestBelow(size_t index) const noexcept -> size_t {
+            if (index == 0) {
+                return INDEX_INVALID;
+            }
+
+            const auto last = index - 1;
+            const auto word_index = last >> 6U;
+            const auto bits = words_[word_index] & LowBits((last & 63U) + 1);
+            if (bits != 0) {
+                return (word_index << 6U) + 63 - std::countl_zero(bits);
+            }
+
+            const auto words = summary_ & LowBits(word_index);
+            if (words == 0) {
+                return INDEX_INVALID;
+            }
+            const auto prev_word_index = static_cast<size_t>(63 - std::countl_zero(words));
+            return (prev_word_index << 6U) + 63 - std::countl_zero(words_[prev_word_index]);
+        }
+
+        // Mask with the lowest num_bits bits set, num_bits in [0, 64].
+        static auto LowBits(size_t num_bits) noexcept -> uint64_t {
+            return (num_bits >= 64 ? ~0ULL : (1ULL << num_bits) - 1);
+        }
+    };
+
+    std::array<T *, NUM_TICKS> levels_;
+    std::array<OccupancyBitmap, 2> occupancy_;
+
+    // Price of levels_[0].
+    Price base_price_ = 0;
+
+    static auto SideIndex(Side side) noexcept -> size_t { return (side == Side::BUY ? 0 : 1); }
+
+    // Ticks from the low price up to the high one, computed in unsigned arithmetic so that prices far apart, e.g. on
+    // either side of zero, cannot overflow.
+    static auto Ticks(Price low, Price high) noexcept -> uint64_t {
+        return static_cast<uint64_t>(high) - static_cast<uint64_t>(low);
+    }
+
+    auto InWindow(Price price) const noexcept {
+        return (price >= base_price_ && Ticks(base_price_, price) < NUM_TICKS);
+    }
+
+    auto LevelAt(size_t index) const noexcept -> T * { return (index == INDEX_INVALID ? nullptr : levels_[index]); }
+
+    // Lowest and highest price of every existing level and the price.
+    auto Span(Price price) const noexcept -> std::pair<Price, Price> {
+        auto low = price;
+        auto high = price;
+        for (const auto &occupancy : occupancy_) {
+            if (!occupancy.Empty()) {
+                low = std::min(low, base_price_ + static_cast<Price>(occupancy.LowestFrom(0)));
+                high = std::max(high, base_price_ + static_cast<Price>(occupancy.HighestBelow(NUM_TICKS)));
+            }
+        }
+        return {low, high};
+    }
+
+    // Moves the window so that it is centered on the range spanned by every existing level and the price.
+    auto Recenter(Price price) noexcept {
+        const auto [low, high] = Span(price);
+        const auto span = Ticks(low, high);
+        if (span >= NUM_TICKS) [[unlikely]] {  // callers check CanHold() first.
+            FATAL("PriceLadder cannot span prices " + PriceToString(low) + " to " + PriceToString(high) +
+                  ", max ticks:" + std::to_string(NUM_TICKS));
+        }
+
+        // The window starts no lower than the lowest Price.
+        const auto margin =
+            std::min<uint64_t>((NUM_TICKS - 1 - span) / 2, Ticks(std::numeric_limits<Price>::min(), low));
+        const auto new_base_price = low - static_cast<Price>(margin);
+        const auto old_base_price = std::exchange(base_price_, new_base_price);
+
+        if (occupancy_[0].Empty() && occupancy_[1].Empty()) {
+            return;
+        }
+
+        // The existing levels fit in both the old and new windows, so |shift| < NUM_TICKS. Only computed then, since
+        // the bases of windows far apart could overflow it.
+        const auto shift = new_base_price - old_base_price;
+        const auto distance = static_cast<size_t>(shift > 0 ? shift : -shift);
+        if (shift > 0) {
+            std::copy(levels_.begin() + distance, levels_.end(), levels_.begin());
+            std::fill(levels_.end() - distance, levels_.end(), nullptr);
+        } else {
+            std::copy_backward(levels_.begin(), levels_.end() - distance, levels_.end());
+            std::fill(levels_.begin(), levels_.begin() + distance, nullptr);
+        }
+
+        for (auto &occupancy : occupancy_) {
+            const auto old_occupancy = occupancy;
+            occupancy = {};
+            for (auto index = old_occupancy.LowestFrom(0); index != INDEX_INVALID;
+                 index = old_occupancy.LowestFrom(index + 1)) {
+                occupancy.Set(static_cast<size_t>(static_cast<Price>(index) - shift));
+            }
+        }
+    }
+};
+
+}  // namespace common
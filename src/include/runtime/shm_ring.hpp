@@ -0,0 +1,415 @@
+/*
+ * shm_ring.hpp
+ * Named POSIX shared memory segments and the lock-free rings laid out in them, for passing fixed-sized messages
+ * between processes on the same host without a system call or a kernel copy per message.
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace common {
+
+/*
+ * SharedMemory maps a named POSIX shared memory segment, see shm_overview(7). The process that creates a segment owns
+ * its name and unlinks it when it closes the segment, processes that only open it just unmap it. A segment stays valid
+ * for every process that has it mapped after it is unlinked. Mappings are prefaulted, so that first touches do not
+ * fault on the hot path.
+ */
+class SharedMemory final {
+   public:
+    SharedMemory() = default;
+
+    ~SharedMemory() { Close(); }
+
+    // Create a zero-filled segment of size bytes, replacing any stale segment of the same name, e.g. one left behind
+    // by a process that crashed. Returns false with errno set on failure.
+    auto Create(const std::string &name, size_t size) noexcept -> bool {
+        Close();
+        shm_unlink(name.c_str());
+        const auto fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0) {
+            return false;
+        }
+
+        const auto mapped = (ftruncate(fd, static_cast<off_t>(size)) == 0 && Map(fd, size));
+        const auto error = errno;
+        close(fd);
+        if (!mapped) {
+            shm_unlink(name.c_str());
+            errno = error;
+            return false;
+        }
+        name_ = name;
+        owner_ = true;
+        return true;
+    }
+
+    // Map all of an existing segment. Returns false with errno set on failure.
+    auto Open(const std::string &name) noexcept -> bool {
+        Close();
+        const auto fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat stat_buf{};
+        const auto mapped = (fstat(fd, &stat_buf) == 0 && Map(fd, static_cast<size_t>(stat_buf.st_size)));
+        const auto error = errno;
+        close(fd);
+        errno = error;
+        return mapped;
+    }
+
+    auto Close() noexcept -> void {
+        if (data_ != nullptr) {
+            munmap(data_, size_);
+            data_ = nullptr;
+            size_ = 0;
+        }
+        if (owner_) {
+            shm_unlink(name_.c_str());
+            owner_ = false;
+        }
+    }
+
+    auto IsOpen() const noexcept { return data_ != nullptr; }
+
+    // Remove the name of a segment that its owner left behind.
+    static auto Unlink(const std::string &name) noexcept { shm_unlink(name.c_str()); }
+
+    auto Data() const noexcept { return data_; }
+
+    auto Size() const noexcept { return size_; }
+
+    // Deleted copy & move constructors and assignment-operators.
+    SharedMemory(const SharedMemory &) = delete;
+
+    SharedMemory(const SharedMemory &&) = delete;
+
+    auto operator=(const SharedMemory &) -> SharedMemory & = delete;
+
+    auto operator=(const SharedMemory &&) -> SharedMemory & = delete;
+
+   private:
+    void *data_ = nullptr;
+    size_t size_ = 0;
+    std::string name_;
+    bool owner_ = false;
+
+    auto Map(int fd, size_t size) noexcept -> bool {
+        if (size == 0) {
+            errno = EINVAL;
+            return false;
+        }
+        auto addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            return false;
+        }
+        data_ = addr;
+        size_ = size;
+        return true;
+    }
+};
+
+namespace internal {
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared memory rings need address-free atomics.");
+
+// Header at the start of the segment of every ring. The creator stores the magic number last, so a process that opens
+// the segment while it is being created sees a ring that is not ready yet.
+struct ShmRingHeader {
+    std::atomic<uint64_t> magic_;
+    uint64_t slot_size_;
+    uint64_t capacity_;
+
+    // Written by the producer only.
+    alignas(64) std::atomic<uint64_t> write_index_;
+
+    // Written by the consumer only, ShmBroadcastRing has none.
+    alignas(64) std::atomic<uint64_t> read_index_;
+};
+
+// Create the segment of a ring of capacity slots laid out after its header, or nullptr with errno set on failure.
+inline auto CreateShmRing(SharedMemory *memory, const std::string &name, size_t capacity, size_t slot_size,
+                          uint64_t magic) noexcept -> ShmRingHeader * {
+    if (!memory->Create(name, sizeof(ShmRingHeader) + capacity * slot_size)) {
+        return nullptr;
+    }
+    auto header = static_cast<ShmRingHeader *>(memory->Data());
+    header->slot_size_ = slot_size;
+    header->capacity_ = capacity;
+    header->magic_.store(magic, std::memory_order_release);
+    return header;
+}
+
+// Open the segment of a ring, or nullptr with errno set on failure, EPROTO if it is not a ready ring of slot_size.
+inline auto OpenShmRing(SharedMemory *memory, const std::string &name, size_t slot_size, uint64_t magic) noexcept
+    -> ShmRingHeader * {
+    if (!memory->Open(name)) {
+        return nullptr;
+    }
+    auto header = static_cast<ShmRingHeader *>(memory->Data());
+    if (memory->Size() < sizeof(ShmRingHeader) || header->magic_.load(std::memory_order_acquire) != magic ||
+        header->slot_size_ != slot_size || !std::has_single_bit(header->capacity_) ||
+        memory->Size() < sizeof(ShmRingHeader) + header->capacity_ * slot_size) {
+        memory->Close();
+        errno = EPROTO;
+        return nullptr;
+    }
+    return header;
+}
+
+}  // namespace internal
+
+/*
+ * Single Producer Single Consumer, fixed-sized, lock-free ring in a named shared memory segment, for a producer and a
+ * consumer in different processes.
+ *
+ * One of the two creates the ring and the other opens it by name. Writes and reads follow the two-phase protocol of
+ * LockFreeQueue, and like there each side keeps a process-local copy of the index of the other side, only reloading it
+ * when the ring looks full or empty. Unlike LockFreeQueue, a full ring makes GetNextToWriteTo() return nullptr rather
+ * than wait, since the consumer is another process that may have gone away, so the producer decides whether to retry
+ * later or give up on the consumer.
+ */
+template <typename T>
+class ShmRing final {
+   public:
+    static_assert(std::is_trivially_copyable_v<T>, "Shared memory rings hold trivially copyable elements only.");
+
+    static constexpr uint64_t MAGIC = 0x564F545353505343;  // "VOTSSPSC"
+
+    ShmRing() = default;
+
+    // Create the ring, with room for num_elems rounded up to a power of two. Returns false with errno set on failure.
+    auto Create(const std::string &name, size_t num_elems) noexcept -> bool {
+        return Attach(internal::CreateShmRing(&memory_, name, std::bit_ceil(num_elems), sizeof(T), MAGIC));
+    }
+
+    // Open a ring created by the other side. Returns false with errno set on failure.
+    auto Open(const std::string &name) noexcept -> bool {
+        return Attach(internal::OpenShmRing(&memory_, name, sizeof(T), MAGIC));
+    }
+
+    auto Close() noexcept {
+        header_ = nullptr;
+        store_ = nullptr;
+        memory_.Close();
+    }
+
+    auto IsOpen() const noexcept { return header_ != nullptr; }
+
+    // Next free slot, or nullptr if the ring is full.
+    auto GetNextToWriteTo() noexcept -> T * {
+        if (next_write_index_ - cached_read_index_ == capacity_) [[unlikely]] {
+            cached_read_index_ = header_->read_index_.load(std::memory_order_acquire);
+            if (next_write_index_ - cached_read_index_ == capacity_) {
+                return nullptr;
+            }
+        }
+        return &store_[next_write_index_ & mask_];
+    }
+
+    auto UpdateWriteIndex() noexcept {
+        ++next_write_index_;
+        PublishWriteIndex();
+    }
+
+    // Commit the slot returned by GetNextToWriteTo() without making it visible to the consumer yet.
+    auto AdvanceWriteIndex() noexcept { ++next_write_index_; }
+
+    // Make every slot committed so far visible to the consumer.
+    auto PublishWriteIndex() noexcept {
+        if (header_->write_index_.load(std::memory_order_relaxed) != next_write_index_) {
+            header_->write_index_.store(next_write_index_, std::memory_order_release);
+        }
+    }
+
+    auto GetNextToRead() noexcept -> const T * {
+        if (next_read_index_ == cached_write_index_) {
+            cached_write_index_ = header_->write_index_.load(std::memory_order_acquire);
+            if (next_read_index_ == cached_write_index_) {
+                return nullptr;
+            }
+        }
+        return &store_[next_read_index_ & mask_];
+    }
+
+    auto UpdateReadIndex() noexcept {
+        ++next_read_index_;
+        header_->read_index_.store(next_read_index_, std::memory_order_release);
+    }
+
+    auto Capacity() const noexcept { return capacity_; }
+
+    // Deleted copy & move constructors and assignment-operators.
+    ShmRing(const ShmRing &) = delete;
+
+    ShmRing(const ShmRing &&) = delete;
+
+    auto operator=(const ShmRing &) -> ShmRing & = delete;
+
+    auto operator=(const ShmRing &&) -> ShmRing & = delete;
+
+   private:
+    SharedMemory memory_;
+    internal::ShmRingHeader *header_ = nullptr;
+    T *store_ = nullptr;
+    size_t capacity_ = 0;
+    size_t mask_ = 0;
+
+    // Process-local state of the producer.
+    uint64_t next_write_index_ = 0;
+    uint64_t cached_read_index_ = 0;
+
+    // Process-local state of the consumer.
+    uint64_t next_read_index_ = 0;
+    uint64_t cached_write_index_ = 0;
+
+    auto Attach(internal::ShmRingHeader *header) noexcept -> bool {
+        if (header == nullptr) {
+            Close();
+            return false;
+        }
+        header_ = header;
+        store_ = reinterpret_cast<T *>(header + 1);
+        capacity_ = header->capacity_;
+        mask_ = capacity_ - 1;
+        next_write_index_ = header->write_index_.load(std::memory_order_acquire);
+        next_read_index_ = header->read_index_.load(std::memory_order_acquire);
+        cached_read_index_ = next_read_index_;
+        cached_write_index_ = next_write_index_;
+        return true;
+    }
+};
+
+/*
+ * Single Producer Multiple Consumer, fixed-sized, lock-free broadcast ring in a named shared memory segment, where any
+ * number of processes read every element without the producer knowing about them.
+ *
+ * The producer creates the ring and never waits: once the ring is full it overwrites the oldest element, like a
+ * multicast stream that a slow subscriber drops datagrams of. Every slot carries a sequence number, odd while its
+ * element is being written and even once it is written, so a reader that copies an element out can tell whether it was
+ * overwritten in the meantime. Readers keep their read index themselves, and one that finds the producer lapped it
+ * skips ahead to the last published element, leaving it to the reader to spot the gap in the messages it reads.
+ */
+template <typename T>
+class ShmBroadcastRing final {
+   public:
+    static_assert(std::is_trivially_copyable_v<T>, "Shared memory rings hold trivially copyable elements only.");
+
+    static constexpr uint64_t MAGIC = 0x564F545353504D43;  // "VOTSSPMC"
+
+    ShmBroadcastRing() = default;
+
+    // Create the ring, with room for num_elems rounded up to a power of two. Returns false with errno set on failure.
+    auto Create(const std::string &name, size_t num_elems) noexcept -> bool {
+        return Attach(internal::CreateShmRing(&memory_, name, std::bit_ceil(num_elems), sizeof(Slot), MAGIC));
+    }
+
+    // Open a ring created by the producer to read from it. Returns false with errno set on failure.
+    auto Open(const std::string &name) noexcept -> bool {
+        return Attach(internal::OpenShmRing(&memory_, name, sizeof(Slot), MAGIC));
+    }
+
+    auto Close() noexcept {
+        header_ = nullptr;
+        slots_ = nullptr;
+        memory_.Close();
+    }
+
+    auto IsOpen() const noexcept { return header_ != nullptr; }
+
+    // Slot to write the next element to, which readers see as being written until AdvanceWriteIndex().
+    auto GetNextToWriteTo() noexcept -> T * {
+        auto &slot = slots_[next_write_index_ & mask_];
+        slot.sequence_.store(2 * next_write_index_ + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return &slot.element_;
+    }
+
+    // Commit the slot returned by GetNextToWriteTo(), making it readable.
+    auto AdvanceWriteIndex() noexcept {
+        slots_[next_write_index_ & mask_].sequence_.store(2 * next_write_index_ + 2, std::memory_order_release);
+        ++next_write_index_;
+    }
+
+    // Publish the index of the next element to write, where readers that open the ring start reading.
+    auto PublishWriteIndex() noexcept { header_->write_index_.store(next_write_index_, std::memory_order_release); }
+
+    auto WriteIndex() const noexcept { return header_->write_index_.load(std::memory_order_acquire); }
+
+    // Copy the element at *read_index to element and move *read_index past it. Returns false if the element is not
+    // written yet, or if it was overwritten, in which case *read_index skips ahead to WriteIndex().
+    auto Read(uint64_t *read_index, T *element) const noexcept -> bool {
+        const auto &slot = slots_[*read_index & mask_];
+        const auto written = 2 * *read_index + 2;
+        const auto sequence = slot.sequence_.load(std::memory_order_acquire);
+        if (sequence < written) {
+            return false;
+        }
+        if (sequence == written) {
+            std::memcpy(element, &slot.element_, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence_.load(std::memory_order_relaxed) == written) {
+                ++*read_index;
+                return true;
+            }
+        }
+        *read_index = WriteIndex();
+        return false;
+    }
+
+    auto Capacity() const noexcept { return capacity_; }
+
+    // Deleted copy & move constructors and assignment-operators.
+    ShmBroadcastRing(const ShmBroadcastRing &) = delete;
+
+    ShmBroadcastRing(const ShmBroadcastRing &&) = delete;
+
+    auto operator=(const ShmBroadcastRing &) -> ShmBroadcastRing & = delete;
+
+    auto operator=(const ShmBroadcastRing &&) -> ShmBroadcastRing & = delete;
+
+   private:
+    struct Slot {
+        std::atomic<uint64_t> sequence_;
+        T element_;
+    };
+
+    SharedMemory memory_;
+    internal::ShmRingHeader *header_ = nullptr;
+    Slot *slots_ = nullptr;
+    size_t capacity_ = 0;
+    size_t mask_ = 0;
+
+    // Process-local state of the producer.
+    uint64_t next_write_index_ = 0;
+
+    auto Attach(internal::ShmRingHeader *header) noexcept -> bool {
+        if (header == nullptr) {
+            Close();
+            return false;
+        }
+        header_ = header;
+        slots_ = reinterpret_cast<Slot *>(header + 1);
+        capacity_ = header->capacity_;
+        mask_ = capacity_ - 1;
+        next_write_index_ = header->write_index_.load(std::memory_order_acquire);
+        return true;
+    }
+};
+
+}  // namespace common
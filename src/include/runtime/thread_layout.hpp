@@ -0,0 +1,283 @@
+/*
+ * thread_layout.hpp
+ * Declarative placement of the threads of a process: the core, scheduling policy, priority, NUMA node and wait policy
+ * of each named thread, read from a layout file at startup.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "common/integrity.hpp"
+#include "runtime/huge_pages.hpp"
+#include "runtime/wait_strategy.hpp"
+
+namespace common {
+
+enum class SchedPolicy : int8_t { INVALID = 0, OTHER = 1, FIFO = 2, RR = 3, MAX = 4 };
+
+inline auto SchedPolicyToString(SchedPolicy policy) -> std::string {
+    switch (policy) {
+        case SchedPolicy::OTHER:
+            return "OTHER";
+        case SchedPolicy::FIFO:
+            return "FIFO";
+        case SchedPolicy::RR:
+            return "RR";
+        case SchedPolicy::INVALID:
+            return "INVALID";
+        case SchedPolicy::MAX:
+            return "MAX";
+    }
+
+    return "UNKNOWN";
+}
+
+inline auto StringToSchedPolicy(const std::string &str) -> SchedPolicy {
+    for (auto i = static_cast<int>(SchedPolicy::INVALID); i <= static_cast<int>(SchedPolicy::MAX); ++i) {
+        const auto policy = static_cast<SchedPolicy>(i);
+        if (SchedPolicyToString(policy) == str) {
+            return policy;
+        }
+    }
+
+    return SchedPolicy::INVALID;
+}
+
+inline auto SchedPolicyToNative(SchedPolicy policy) noexcept {
+    switch (policy) {
+        case SchedPolicy::FIFO:
+            return SCHED_FIFO;
+        case SchedPolicy::RR:
+            return SCHED_RR;
+        case SchedPolicy::OTHER:
+        case SchedPolicy::INVALID:
+        case SchedPolicy::MAX:
+            break;
+    }
+
+    return SCHED_OTHER;
+}
+
+struct ThreadConfig {
+    // -1 leaves the thread unpinned.
+    int core_id_ = -1;
+    SchedPolicy sched_policy_ = SchedPolicy::OTHER;
+    int priority_ = 0;
+    int numa_node_ = NUMA_NODE_ANY;
+    // Whether the thread has its core to itself.
+    bool dedicated_ = false;
+    // How the run loop of the thread waits for work, INVALID for the policy its process was started with.
+    WaitPolicy wait_policy_ = WaitPolicy::INVALID;
+
+    // NUMA node for the memory of the thread: the configured one, or else the one of its core.
+    auto MemoryNode() const noexcept { return (numa_node_ != NUMA_NODE_ANY ? numa_node_ : NumaNodeOfCore(core_id_)); }
+
+    // Wait policy for the run loop of the thread: the configured one, or else default_policy.
+    auto WaitPolicyOr(WaitPolicy default_policy) const noexcept {
+        return (wait_policy_ != WaitPolicy::INVALID ? wait_policy_ : default_policy);
+    }
+
+    auto ToString() const {
+        std::stringstream ss;
+        ss << "ThreadConfig[core:" << core_id_ << " sched:" << SchedPolicyToString(sched_policy_)
+           << " priority:" << priority_ << " numa:" << numa_node_ << " dedicated:" << dedicated_
+           << " wait:" << WaitPolicyToString(wait_policy_) << "]";
+        return ss.str();
+    }
+};
+
+// CPUs listed in a cpulist like "2-5,8", the format of the isolcpus boot parameter and of its sysfs file.
+inline auto ParseCpuList(const std::string &cpu_list) -> std::set<int> {
+    std::set<int> cpus;
+    std::stringstream ss(cpu_list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        const auto dash = range.find('-');
+        const auto first = std::atoi(range.c_str());
+        const auto last = (dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1));
+        for (auto cpu = first; cpu <= last && !range.empty(); ++cpu) {
+            cpus.insert(cpu);
+        }
+    }
+    return cpus;
+}
+
+/*
+ * ThreadLayout maps thread names, as passed to CreateAndStartThread(), to their ThreadConfig. Every line of a layout
+ * file that is neither empty nor starts with '#' reads
+ *
+ *   <thread name> [core=<id>] [sched=OTHER|FIFO|RR] [priority=<n>] [numa=<node>] [dedicated]
+ *                 [wait=BUSY_SPIN|YIELD|PARK]
+ *
+ * wait overrides the WAIT_POLICY the process was started with for the run loop of the thread, e.g. to busy-spin the
+ * dedicated hot threads and park the others.
+ * A name ending in '*' matches every thread whose name starts with the rest of it, e.g. common/Logger* for all the
+ * loggers, and the first line matching a thread applies. A dedicated thread must be named exactly and is the only
+ * thread the layout puts on its core. That core should also be isolated from the scheduler through isolcpus, which is
+ * reported, like a NUMA node the core does not belong to, but is not fatal. Anything else invalid is.
+ */
+class ThreadLayout final {
+   public:
+    explicit ThreadLayout(const std::string &file_name) {
+        std::ifstream file(file_name);
+        if (!file) {
+            FATAL("Unable to open thread layout:" + file_name);
+        }
+
+        std::string line;
+        for (size_t line_num = 1; std::getline(file, line); ++line_num) {
+            ParseLine(file_name + ":" + std::to_string(line_num), line);
+        }
+        Validate();
+    }
+
+    // Config of the first line matching the thread, nullptr if there is none.
+    auto Lookup(const std::string &thread_name) const noexcept -> const ThreadConfig * {
+        for (const auto &[pattern, config] : entries_) {
+            const auto prefix = std::string_view(pattern).substr(0, pattern.size() - 1);
+            if (pattern.ends_with('*') ? thread_name.starts_with(prefix) : thread_name == pattern) {
+                return &config;
+            }
+        }
+        return nullptr;
+    }
+
+    auto ToString() const {
+        std::stringstream ss;
+        ss << "ThreadLayout[";
+        for (const auto &[pattern, config] : entries_) {
+            ss << pattern << ":" << config.ToString() << " ";
+        }
+        ss << "]";
+        return ss.str();
+    }
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    ThreadLayout() = delete;
+
+    ThreadLayout(const ThreadLayout &) = delete;
+
+    ThreadLayout(const ThreadLayout &&) = delete;
+
+    auto operator=(const ThreadLayout &) -> ThreadLayout & = delete;
+
+    auto operator=(const ThreadLayout &&) -> ThreadLayout & = delete;
+
+   private:
+    std::vector<std::pair<std::string, ThreadConfig>> entries_;
+
+    auto ParseLine(const std::string &location, const std::string &line) -> void {
+        std::stringstream ss(line);
+        std::string pattern;
+        if (!(ss >> pattern) || pattern.starts_with('#')) {
+            return;
+        }
+
+        ThreadConfig config;
+        std::string token;
+        while (ss >> token) {
+            const auto equals = token.find('=');
+            const auto key = token.substr(0, equals);
+            const auto value = (equals == std::string::npos ? std::string() : token.substr(equals + 1));
+            if (key == "core" && !value.empty()) {
+                config.core_id_ = std::atoi(value.c_str());
+            } else if (key == "sched" && !value.empty()) {
+                config.sched_policy_ = StringToSchedPolicy(value);
+            } else if (key == "priority" && !value.empty()) {
+                config.priority_ = std::atoi(value.c_str());
+            } else if (key == "numa" && !value.empty()) {
+                config.numa_node_ = std::atoi(value.c_str());
+            } else if (key == "dedicated" && equals == std::string::npos) {
+                config.dedicated_ = true;
+            } else if (key == "wait" && StringToWaitPolicy(value) != WaitPolicy::INVALID) {
+                config.wait_policy_ = StringToWaitPolicy(value);
+            } else {
+                FATAL(location + " Invalid thread layout attribute:" + token);
+            }
+        }
+
+        const auto policy = SchedPolicyToNative(config.sched_policy_);
+        const auto num_cores = static_cast<int>(std::thread::hardware_concurrency());
+        if (config.sched_policy_ == SchedPolicy::INVALID || config.sched_policy_ == SchedPolicy::MAX) {
+            FATAL(location + " Invalid scheduling policy for:" + pattern);
+        } else if (config.priority_ < sched_get_priority_min(policy) ||
+                   config.priority_ > sched_get_priority_max(policy)) {
+            FATAL(location + " Invalid priority for " + SchedPolicyToString(config.sched_policy_) + ":" + pattern);
+        } else if (config.core_id_ < -1 || (num_cores != 0 && config.core_id_ >= num_cores)) {
+            FATAL(location + " Invalid core for:" + pattern);
+        } else if (config.dedicated_ && (config.core_id_ < 0 || pattern.ends_with('*'))) {
+            FATAL(location + " A dedicated thread needs a core and an exact name:" + pattern);
+        }
+
+        entries_.emplace_back(pattern, config);
+    }
+
+    auto Validate() const -> void {
+        std::string isolated;
+        std::getline(std::ifstream("/sys/devices/system/cpu/isolated"), isolated);
+        const auto isolated_cores = ParseCpuList(isolated);
+
+        for (const auto &[pattern, config] : entries_) {
+            if (config.core_id_ < 0) {
+                continue;
+            }
+
+            if (config.dedicated_) {
+                for (const auto &[other_pattern, other_config] : entries_) {
+                    if (other_pattern != pattern && other_config.core_id_ == config.core_id_) {
+                        FATAL("Thread layout puts " + other_pattern + " on the dedicated core of " + pattern);
+                    }
+                }
+                if (!isolated_cores.contains(config.core_id_)) {
+                    std::cerr << "Dedicated core " << config.core_id_ << " of " << pattern
+                              << " is not isolated through isolcpus." << '\n';
+                }
+            }
+
+            const auto core_node = NumaNodeOfCore(config.core_id_);
+            if (config.numa_node_ != NUMA_NODE_ANY && core_node != NUMA_NODE_ANY && config.numa_node_ != core_node) {
+                std::cerr << "NUMA node " << config.numa_node_ << " of " << pattern << " is not the node " << core_node
+                          << " of its core " << config.core_id_ << "." << '\n';
+            }
+        }
+    }
+};
+
+namespace internal {
+inline std::unique_ptr<const ThreadLayout> thread_layout;
+}  // namespace internal
+
+/*
+ * LoadThreadLayout loads the layout applied to the threads created afterwards from the file named by the THREAD_LAYOUT
+ * environment variable, if it is set. Expected to be called at the very start of main(), before any thread exists.
+ */
+inline auto LoadThreadLayout() {
+    const auto file_name = std::getenv("THREAD_LAYOUT");
+    if (file_name != nullptr && *file_name != '\0') {
+        internal::thread_layout = std::make_unique<const ThreadLayout>(file_name);
+        std::cout << "Loaded " << internal::thread_layout->ToString() << '\n';
+    }
+}
+
+// Config of the named thread in the loaded layout, or else one pinning it to default_core with default scheduling.
+inline auto GetThreadConfig(const std::string &thread_name, int default_core) noexcept {
+    const auto config = (internal::thread_layout != nullptr ? internal::thread_layout->Lookup(thread_name) : nullptr);
+    return (config != nullptr ? *config : ThreadConfig{.core_id_ = default_core});
+}
+
+}  // namespace common
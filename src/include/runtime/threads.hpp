@@ -1,6 +1,7 @@
 /*
  * threads.hpp
- * Utility functions for creating threads bound to a specific CPU core.
+ * Utility functions for creating threads bound to a specific CPU core, with the scheduling of their thread layout, and
+ * for stopping and joining them again.
  */
 
 #pragma once
@@ -8,9 +9,22 @@
 #include <sys/syscall.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
+#include <concepts>
+#include <cstring>
 #include <iostream>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <string_view>
 #include <thread>
+#include <vector>
+
+#include "runtime/huge_pages.hpp"
+#include "runtime/thread_layout.hpp"
 
 namespace common {
 
@@ -28,37 +42,184 @@ inline auto SetThreadCore(int core_id) noexcept {
 }
 
 /*
- * CreateAndStartThread creates a thread running the provided function and with the core affinity {core_id}. Blocks
- * until the thread either starts successfully or fails. Upon failure, nullptr is returned.
+ * SetThreadScheduling attempts to set the scheduling policy and priority of the calling thread. Real-time policies
+ * need CAP_SYS_NICE or a sufficient RLIMIT_RTPRIO. Returns 0 on success, else the error number.
+ */
+inline auto SetThreadScheduling(SchedPolicy policy, int priority) noexcept {
+    sched_param param{};
+    param.sched_priority = priority;
+    return pthread_setschedparam(pthread_self(), SchedPolicyToNative(policy), &param);
+}
+
+/*
+ * ManagedThread owns a thread started by CreateAndStartThread() and its stop source. Stopping is cooperative: the
+ * thread function receives a std::stop_token and is expected to return soon after a stop is requested. Destroying a
+ * ManagedThread requests a stop and joins the thread. Every ManagedThread is listed in the ThreadRegistry while it
+ * exists.
+ */
+class ManagedThread final {
+   public:
+    explicit ManagedThread(const std::string &name);
+
+    ~ManagedThread();
+
+    auto Name() const noexcept -> const std::string & { return NAME; }
+
+    auto RequestStop() noexcept { stop_source_.request_stop(); }
+
+    auto StopRequested() const noexcept { return stop_source_.stop_requested(); }
+
+    auto Join() noexcept {
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    ManagedThread() = delete;
+
+    ManagedThread(const ManagedThread &) = delete;
+
+    ManagedThread(const ManagedThread &&) = delete;
+
+    auto operator=(const ManagedThread &) -> ManagedThread & = delete;
+
+    auto operator=(const ManagedThread &&) -> ManagedThread & = delete;
+
+   private:
+    template <typename FuncType, typename... ArgsType>
+    friend auto CreateAndStartThread(int core_id, const std::string &name, FuncType &&func, ArgsType &&...args) noexcept
+        -> std::unique_ptr<ManagedThread>;
+
+    const std::string NAME;
+    std::stop_source stop_source_;
+    std::thread thread_;
+};
+
+/*
+ * ThreadRegistry lists the ManagedThreads of the process, so that shutdown can ask a whole group of them to stop at
+ * once before their owners join them one by one.
+ */
+class ThreadRegistry final {
+   public:
+    static auto Instance() noexcept -> ThreadRegistry & {
+        static ThreadRegistry registry;
+        return registry;
+    }
+
+    // Request a stop of every thread whose name starts with name_prefix.
+    auto RequestStopAll(std::string_view name_prefix) noexcept {
+        const std::lock_guard lock(mutex_);
+        for (auto thread : threads_) {
+            if (thread->Name().starts_with(name_prefix)) {
+                thread->RequestStop();
+            }
+        }
+    }
+
+    auto Names() const {
+        const std::lock_guard lock(mutex_);
+        std::vector<std::string> names;
+        for (auto thread : threads_) {
+            names.push_back(thread->Name());
+        }
+        return names;
+    }
+
+    // Deleted copy & move constructors and assignment-operators.
+    ThreadRegistry(const ThreadRegistry &) = delete;
+
+    ThreadRegistry(const ThreadRegistry &&) = delete;
+
+    auto operator=(const ThreadRegistry &) -> ThreadRegistry & = delete;
+
+    auto operator=(const ThreadRegistry &&) -> ThreadRegistry & = delete;
+
+   private:
+    friend class ManagedThread;
+
+    mutable std::mutex mutex_;
+    std::vector<ManagedThread *> threads_;
+
+    ThreadRegistry() = default;
+
+    auto Add(ManagedThread *thread) {
+        const std::lock_guard lock(mutex_);
+        threads_.push_back(thread);
+    }
+
+    auto Remove(ManagedThread *thread) {
+        const std::lock_guard lock(mutex_);
+        threads_.erase(std::find(threads_.begin(), threads_.end(), thread));
+    }
+};
+
+inline ManagedThread::ManagedThread(const std::string &name) : NAME(name) { ThreadRegistry::Instance().Add(this); }
+
+inline ManagedThread::~ManagedThread() {
+    RequestStop();
+    Join();
+    ThreadRegistry::Instance().Remove(this);
+}
+
+/*
+ * CreateAndStartThread creates a thread running the provided function and with the core affinity {core_id}, unless the
+ * loaded ThreadLayout has an entry for {name}, whose core, scheduling and NUMA node apply instead. HugePageArrays the
+ * thread creates are placed on the NUMA node of its config. The function gets the stop token of the thread as its first
+ * argument if it takes one.
+ *
+ * A thread whose scheduling cannot be set, e.g. for lack of the privilege to use a real-time policy, runs with the
+ * default scheduling instead, which is reported.
+ *
+ * Blocks until the thread either starts successfully or fails, which it learns through a latch the new thread counts
+ * down once it is set up. Upon failure to set its core affinity, nullptr is returned.
  */
 template <typename FuncType, typename... ArgsType>
 inline auto CreateAndStartThread(int core_id, const std::string &name, FuncType &&func, ArgsType &&...args) noexcept
-    -> std::thread * {
-    std::atomic<bool> running(false);
-    std::atomic<bool> failed(false);
-    auto thread_body = [&] {
-        if (core_id >= 0 && !SetThreadCore(core_id)) {
-            std::cerr << "Failed to set core affinity for " << name << " " << pthread_self() << " to " << core_id
-                      << '\n';
+    -> std::unique_ptr<ManagedThread> {
+    std::latch started(1);
+    bool failed = false;
+    auto config = GetThreadConfig(name, core_id);
+    auto thread = std::make_unique<ManagedThread>(name);
+    // Only the function and its arguments are used after the latch is counted down, so only they are captured by value.
+    auto thread_body = [&, stop_token = thread->stop_source_.get_token(), func = std::forward<FuncType>(func),
+                        ... args = std::forward<ArgsType>(args)]() mutable {
+        if (config.core_id_ >= 0 && !SetThreadCore(config.core_id_)) {
+            std::cerr << "Failed to set core affinity for " << name << " " << pthread_self() << " to "
+                      << config.core_id_ << '\n';
             failed = true;
+            started.count_down();
             return;
         }
-        std::cout << "Set core affinity for " << name << " " << pthread_self() << " to " << core_id << '\n';
-        running = true;
-        std::forward<FuncType>(func)((std::forward<ArgsType>(args))...);
+        if (config.sched_policy_ != SchedPolicy::OTHER) {
+            const auto error = SetThreadScheduling(config.sched_policy_, config.priority_);
+            if (error != 0) {
+                std::cerr << "Failed to set scheduling for " << name << " " << pthread_self() << " to "
+                          << config.ToString() << " error:" << std::strerror(error) << ", falling back to OTHER."
+                          << '\n';
+                config.sched_policy_ = SchedPolicy::OTHER;
+                config.priority_ = 0;
+            }
+        }
+        SetPreferredMemoryNode(config.MemoryNode());
+        std::cout << "Set core affinity for " << name << " " << pthread_self() << " to " << config.core_id_ << " "
+                  << config.ToString() << '\n';
+        started.count_down();
+
+        if constexpr (std::invocable<FuncType, std::stop_token, ArgsType...>) {
+            func(stop_token, std::move(args)...);
+        } else {
+            func(std::move(args)...);
+        }
     };
 
-    auto t = new std::thread(thread_body);  // NOLINT
-    while (!running && !failed) {
-        using namespace std::literals::chrono_literals;
-        std::this_thread::sleep_for(1s);
-    }
+    thread->thread_ = std::thread(std::move(thread_body));
+    started.wait();
     if (failed) {
-        t->join();
-        delete t;
-        t = nullptr;
+        thread->Join();
+        thread = nullptr;
     }
-    return t;
+    return thread;
 }
 
 }  // namespace common
@@ -0,0 +1,185 @@
+/*
+ * wait_strategy.hpp
+ * Defines how the run loop of a component waits while it has no work: by busy-spinning, by spinning and then yielding
+ * its core, or by spinning and then parking its thread until a producer rings its doorbell.
+ */
+
+#pragma once
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <thread>
+
+#include "common/time_utils.hpp"
+
+namespace common {
+
+enum class WaitPolicy : int8_t { INVALID = 0, BUSY_SPIN = 1, YIELD = 2, PARK = 3, MAX = 4 };
+
+inline auto WaitPolicyToString(WaitPolicy policy) -> std::string {
+    switch (policy) {
+        case WaitPolicy::BUSY_SPIN:
+            return "BUSY_SPIN";
+        case WaitPolicy::YIELD:
+            return "YIELD";
+        case WaitPolicy::PARK:
+            return "PARK";
+        case WaitPolicy::INVALID:
+            return "INVALID";
+        case WaitPolicy::MAX:
+            return "MAX";
+    }
+
+    return "UNKNOWN";
+}
+
+// Only names a real policy, INVALID for anything else, "INVALID" and "MAX" included.
+inline auto StringToWaitPolicy(const std::string &str) -> WaitPolicy {
+    for (auto i = static_cast<int>(WaitPolicy::INVALID) + 1; i < static_cast<int>(WaitPolicy::MAX); ++i) {
+        const auto policy = static_cast<WaitPolicy>(i);
+        if (WaitPolicyToString(policy) == str) {
+            return policy;
+        }
+    }
+
+    return WaitPolicy::INVALID;
+}
+
+// Hint to the CPU that the calling thread is spinning, which frees execution resources for a sibling hyper-thread.
+inline auto CpuRelax() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+/*
+ * Wakes up the thread parked on it by a WaitStrategy. Producers ring it after publishing work for that thread. Ringing
+ * costs a fence and, only while the thread is parked or about to park, a futex wake-up.
+ */
+class Doorbell final {
+   public:
+    Doorbell() = default;
+
+    auto Ring() noexcept {
+        // Pairs with the fence in WaitStrategy::Idle(): either the parking thread sees the work published before this
+        // call, or this call sees the thread and bumps the epoch it parks on.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters_.load(std::memory_order_relaxed) != 0) [[unlikely]] {
+            epoch_.fetch_add(1, std::memory_order_release);
+            syscall(SYS_futex, &epoch_, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+        }
+    }
+
+    // Deleted copy & move constructors and assignment-operators.
+    Doorbell(const Doorbell &) = delete;
+
+    Doorbell(const Doorbell &&) = delete;
+
+    auto operator=(const Doorbell &) -> Doorbell & = delete;
+
+    auto operator=(const Doorbell &&) -> Doorbell & = delete;
+
+   private:
+    friend class WaitStrategy;
+
+    std::atomic<uint32_t> epoch_ = {0};
+    std::atomic<uint32_t> waiters_ = {0};
+};
+
+/*
+ * Wait policy of a single run loop. The loop calls Idle() after every iteration that found no work and Reset() after
+ * every iteration that did.
+ *
+ * BUSY_SPIN never gives up the core. YIELD spins for SPIN_ITERATIONS idle iterations and then yields the core on every
+ * further one. PARK spins as long and then parks the thread on its doorbell until it is rung or park_timeout passes.
+ * The timeout bounds how late a parked loop notices work from sources that cannot ring, like sockets.
+ */
+class WaitStrategy final {
+   public:
+    static constexpr uint32_t SPIN_ITERATIONS = 1024;
+    static constexpr Nanos PARK_TIMEOUT = NANOS_TO_MILLIS;
+
+    explicit WaitStrategy(WaitPolicy policy, Nanos park_timeout = PARK_TIMEOUT)
+        : POLICY(policy),
+          PARK_TIMESPEC{.tv_sec = park_timeout / NANOS_TO_SECS, .tv_nsec = park_timeout % NANOS_TO_SECS} {}
+
+    auto Policy() const noexcept { return POLICY; }
+
+    // Doorbell for producers to ring after publishing work for this loop, nullptr unless the loop parks.
+    auto GetDoorbell() noexcept { return (POLICY == WaitPolicy::PARK ? &doorbell_ : nullptr); }
+
+    auto Reset() noexcept {
+        if (idle_iterations_ != 0) [[unlikely]] {
+            if (idle_iterations_ > SPIN_ITERATIONS) {
+                doorbell_.waiters_.fetch_sub(1, std::memory_order_relaxed);
+            }
+            idle_iterations_ = 0;
+        }
+    }
+
+    auto Idle() noexcept {
+        switch (POLICY) {
+            case WaitPolicy::YIELD:
+                if (idle_iterations_ < SPIN_ITERATIONS) {
+                    ++idle_iterations_;
+                    CpuRelax();
+                } else {
+                    std::this_thread::yield();
+                }
+                break;
+            case WaitPolicy::PARK:
+                if (idle_iterations_ < SPIN_ITERATIONS) {
+                    ++idle_iterations_;
+                    CpuRelax();
+                } else if (idle_iterations_ == SPIN_ITERATIONS) {
+                    // Announce the thread before parking and let the loop look for work once more, so that work
+                    // published before the producer could see the announcement is not missed.
+                    ++idle_iterations_;
+                    doorbell_.waiters_.fetch_add(1, std::memory_order_seq_cst);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    parked_epoch_ = doorbell_.epoch_.load(std::memory_order_acquire);
+                } else {
+                    syscall(SYS_futex, &doorbell_.epoch_, FUTEX_WAIT_PRIVATE, parked_epoch_, &PARK_TIMESPEC, nullptr,
+                            0);
+                    parked_epoch_ = doorbell_.epoch_.load(std::memory_order_acquire);
+                }
+                break;
+            case WaitPolicy::BUSY_SPIN:
+            case WaitPolicy::INVALID:
+            case WaitPolicy::MAX:
+                break;
+        }
+    }
+
+    // Deleted default, copy & move constructors and assignment-operators.
+    WaitStrategy() = delete;
+
+    WaitStrategy(const WaitStrategy &) = delete;
+
+    WaitStrategy(const WaitStrategy &&) = delete;
+
+    auto operator=(const WaitStrategy &) -> WaitStrategy & = delete;
+
+    auto operator=(const WaitStrategy &&) -> WaitStrategy & = delete;
+
+   private:
+    const WaitPolicy POLICY;
+    const timespec PARK_TIMESPEC;
+
+    // Consecutive iterations without work, one more than SPIN_ITERATIONS once the thread announced itself as waiter.
+    uint32_t idle_iterations_ = 0;
+    uint32_t parked_epoch_ = 0;
+
+    Doorbell doorbell_;
+};
+
+}  // namespace common
@@ -6,7 +6,7 @@
 
 #pragma once
 
-#include "common/perf_utils.hpp"
+#include "common/latency_histogram.hpp"
 #include "feature_engine.hpp"
 #include "logging/logger.hpp"
 #include "order_manager.hpp"
@@ -53,11 +53,13 @@ class LiquidityTaker {
             if (agg_qty_ratio >= threshold) {
                 START_MEASURE(trading_order_manager_move_orders);
                 if (market_update->side_ == common::Side::BUY) {
-                    order_manager_->MoveOrders(market_update->ticker_id_, bbo->ask_price_, common::PRICE_INVALID, clip);
+                    order_manager_->MoveOrders(market_update->ticker_id_, bbo->ask_price_, common::PRICE_INVALID, clip,
+                                               exchange::TimeInForce::IOC);
                 } else {
-                    order_manager_->MoveOrders(market_update->ticker_id_, common::PRICE_INVALID, bbo->bid_price_, clip);
+                    order_manager_->MoveOrders(market_update->ticker_id_, common::PRICE_INVALID, bbo->bid_price_, clip,
+                                               exchange::TimeInForce::IOC);
                 }
-                END_MEASURE(trading_order_manager_move_orders, (*logger_));
+                END_MEASURE(trading_order_manager_move_orders);
             }
         }
     }
@@ -67,7 +69,7 @@ class LiquidityTaker {
                      client_response->ToString().c_str());
         START_MEASURE(trading_order_manager_on_order_update);
         order_manager_->OnOrderUpdate(client_response);
-        END_MEASURE(trading_order_manager_on_order_update, (*logger_));
+        END_MEASURE(trading_order_manager_on_order_update);
     }
 
     // Deleted default, copy & move constructors and assignment-operators.
@@ -6,7 +6,7 @@
 
 #pragma once
 
-#include "common/perf_utils.hpp"
+#include "common/latency_histogram.hpp"
 #include "feature_engine.hpp"
 #include "logging/logger.hpp"
 #include "order_manager.hpp"
@@ -49,8 +49,8 @@ class MarketMaker {
             const auto ask_price = bbo->ask_price_ + (bbo->ask_price_ - fair_price >= threshold ? 0 : 1);
 
             START_MEASURE(trading_order_manager_move_orders);
-            order_manager_->MoveOrders(ticker_id, bid_price, ask_price, clip);
-            END_MEASURE(trading_order_manager_move_orders, (*logger_));
+            order_manager_->MoveOrders(ticker_id, bid_price, ask_price, clip, exchange::TimeInForce::GTC);
+            END_MEASURE(trading_order_manager_move_orders);
         }
     }
 
@@ -65,7 +65,7 @@ class MarketMaker {
 
         START_MEASURE(trading_order_manager_on_order_update);
         order_manager_->OnOrderUpdate(client_response);
-        END_MEASURE(trading_order_manager_on_order_update, (*logger_));
+        END_MEASURE(trading_order_manager_on_order_update);
     }
 
     // Deleted default, copy & move constructors and assignment-operators.
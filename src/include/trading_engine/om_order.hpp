@@ -12,7 +12,14 @@
 
 namespace trading {
 
-enum class OMOrderState : int8_t { INVALID = 0, PENDING_NEW = 1, LIVE = 2, PENDING_CANCEL = 3, DEAD = 4 };
+enum class OMOrderState : int8_t {
+    INVALID = 0,
+    PENDING_NEW = 1,
+    LIVE = 2,
+    PENDING_CANCEL = 3,
+    DEAD = 4,
+    PENDING_MODIFY = 5
+};
 
 inline auto OMOrderStateToString(OMOrderState side) -> std::string {
     switch (side) {
@@ -24,6 +31,8 @@ inline auto OMOrderStateToString(OMOrderState side) -> std::string {
             return "PENDING_CANCEL";
         case OMOrderState::DEAD:
             return "DEAD";
+        case OMOrderState::PENDING_MODIFY:
+            return "PENDING_MODIFY";
         case OMOrderState::INVALID:
             return "INVALID";
     }
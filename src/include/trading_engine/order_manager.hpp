@@ -6,9 +6,10 @@
 
 #pragma once
 
-#include "common/perf_utils.hpp"
+#include "common/latency_histogram.hpp"
 #include "logging/logger.hpp"
 #include "om_order.hpp"
+#include "order_gateway/client_request.hpp"
 #include "order_gateway/client_response.hpp"
 #include "risk_manager.hpp"
 
@@ -32,7 +33,8 @@ class OrderManager {
             case exchange::ClientResponseType::ACCEPTED: {
                 order->order_state_ = trading::OMOrderState::LIVE;
             } break;
-            case exchange::ClientResponseType::CANCELED: {
+            case exchange::ClientResponseType::CANCELED:
+            case exchange::ClientResponseType::NEW_REJECTED: {
                 order->order_state_ = OMOrderState::DEAD;
             } break;
             case exchange::ClientResponseType::FILLED: {
@@ -41,6 +43,28 @@ class OrderManager {
                     order->order_state_ = OMOrderState::DEAD;
                 }
             } break;
+            case exchange::ClientResponseType::MODIFIED: {
+                order->price_ = client_response->price_;
+                order->qty_ = client_response->leaves_qty_;
+                order->order_state_ = OMOrderState::LIVE;
+            } break;
+            case exchange::ClientResponseType::MODIFY_REJECTED: {
+                // A reject of an order that is still live, e.g. one asking for a price the exchange cannot hold,
+                // carries its market order id and leaves it as it was. Otherwise the order is no longer live on the
+                // exchange, e.g. it was filled before the modify got there, and the reject does not carry a side, so
+                // look the order up by its id.
+                const auto is_live = (client_response->market_order_id_ != common::ORDER_ID_INVALID);
+                for (auto &side_order : ticker_side_order_.at(client_response->ticker_id_)) {
+                    if (side_order.order_id_ == client_response->client_order_id_ &&
+                        side_order.order_state_ == OMOrderState::PENDING_MODIFY) {
+                        if (is_live) {
+                            side_order.price_ = client_response->price_;
+                            side_order.qty_ = client_response->leaves_qty_;
+                        }
+                        side_order.order_state_ = (is_live ? OMOrderState::LIVE : OMOrderState::DEAD);
+                    }
+                }
+            } break;
             case exchange::ClientResponseType::CANCEL_REJECTED:
             case exchange::ClientResponseType::INVALID: {
             } break;
@@ -48,18 +72,33 @@ class OrderManager {
     }
 
     void NewOrder(trading::OMOrder *order, common::TickerId ticker_id, common::Price price, common::Side side,
-                  common::Qty qty) noexcept;
+                  common::Qty qty, exchange::TimeInForce time_in_force) noexcept;
 
     void CancelOrder(trading::OMOrder *order) noexcept;
 
+    void ModifyOrder(trading::OMOrder *order, common::Price price, common::Qty qty) noexcept;
+
+    // Taker flows should use IOC or FOK orders, which never rest in the book and so never need to be moved or canceled.
     void MoveOrder(trading::OMOrder *order, common::TickerId ticker_id, common::Price price, common::Side side,
-                   common::Qty qty) noexcept {
+                   common::Qty qty, exchange::TimeInForce time_in_force) noexcept {
         switch (order->order_state_) {
             case OMOrderState::LIVE: {
-                if (order->price_ != price) {
-                    START_MEASURE(trading_order_manager_cancel_order);
-                    CancelOrder(order);
-                    END_MEASURE(trading_order_manager_cancel_order, (*logger_));
+                // A live IOC or FOK order has already been matched, its fills and cancel are on their way.
+                if (order->price_ != price && time_in_force == exchange::TimeInForce::GTC) {
+                    START_MEASURE(trading_risk_manager_check_pre_trade_risk);
+                    const auto risk_result = (price != common::PRICE_INVALID
+                                                  ? risk_manager_.CheckPreTradeRisk(ticker_id, side, qty)
+                                                  : RiskCheckResult::INVALID);
+                    END_MEASURE(trading_risk_manager_check_pre_trade_risk);
+                    if (risk_result == RiskCheckResult::ALLOWED) [[likely]] {
+                        START_MEASURE(trading_order_manager_modify_order);
+                        ModifyOrder(order, price, qty);
+                        END_MEASURE(trading_order_manager_modify_order);
+                    } else {
+                        START_MEASURE(trading_order_manager_cancel_order);
+                        CancelOrder(order);
+                        END_MEASURE(trading_order_manager_cancel_order);
+                    }
                 }
             } break;
             case OMOrderState::INVALID:
@@ -67,11 +106,11 @@ class OrderManager {
                 if (price != common::PRICE_INVALID) [[likely]] {
                     START_MEASURE(trading_risk_manager_check_pre_trade_risk);
                     const auto risk_result = risk_manager_.CheckPreTradeRisk(ticker_id, side, qty);
-                    END_MEASURE(trading_risk_manager_check_pre_trade_risk, (*logger_));
+                    END_MEASURE(trading_risk_manager_check_pre_trade_risk);
                     if (risk_result == RiskCheckResult::ALLOWED) [[likely]] {
                         START_MEASURE(trading_order_manager_new_order);
-                        NewOrder(order, ticker_id, price, side, qty);
-                        END_MEASURE(trading_order_manager_new_order, (*logger_));
+                        NewOrder(order, ticker_id, price, side, qty, time_in_force);
+                        END_MEASURE(trading_order_manager_new_order);
                     } else {
                         logger_->Log("%:% %() % Ticker:% Side:% Qty:% RiskCheckResult:%\n", __FILE__, __LINE__,
                                      __FUNCTION__, common::GetCurrentTimeStr(&time_str_),
@@ -82,24 +121,25 @@ class OrderManager {
             } break;
             case OMOrderState::PENDING_NEW:
             case OMOrderState::PENDING_CANCEL:
+            case OMOrderState::PENDING_MODIFY:
                 break;
         }
     }
 
-    auto MoveOrders(common::TickerId ticker_id, common::Price bid_price, common::Price ask_price,
-                    common::Qty clip) noexcept {
+    auto MoveOrders(common::TickerId ticker_id, common::Price bid_price, common::Price ask_price, common::Qty clip,
+                    exchange::TimeInForce time_in_force) noexcept {
         {
             auto bid_order = &(ticker_side_order_.at(ticker_id).at(common::SideToIndex(common::Side::BUY)));
             START_MEASURE(trading_order_manager_move_order);
-            MoveOrder(bid_order, ticker_id, bid_price, common::Side::BUY, clip);
-            END_MEASURE(trading_order_manager_move_order, (*logger_));
+            MoveOrder(bid_order, ticker_id, bid_price, common::Side::BUY, clip, time_in_force);
+            END_MEASURE(trading_order_manager_move_order);
         }
 
         {
             auto ask_order = &(ticker_side_order_.at(ticker_id).at(common::SideToIndex(common::Side::SELL)));
             START_MEASURE(trading_order_manager_move_order);
-            MoveOrder(ask_order, ticker_id, ask_price, common::Side::SELL, clip);
-            END_MEASURE(trading_order_manager_move_order, (*logger_));
+            MoveOrder(ask_order, ticker_id, ask_price, common::Side::SELL, clip, time_in_force);
+            END_MEASURE(trading_order_manager_move_order);
         }
     }
 
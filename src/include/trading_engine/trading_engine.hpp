@@ -3,9 +3,9 @@
 #include <functional>
 
 #include "common/integrity.hpp"
+#include "common/perf_utils.hpp"
 #include "feature_engine.hpp"
 #include "logging/logger.hpp"
-#include "common/time_utils.hpp"
 #include "market_data/market_update.hpp"
 #include "order_gateway/client_request.hpp"
 #include "order_gateway/client_response.hpp"
@@ -14,6 +14,7 @@
 #include "risk_manager.hpp"
 #include "runtime/lock_free_queue.hpp"
 #include "runtime/threads.hpp"
+#include "runtime/wait_strategy.hpp"
 #include "trading_order_book.hpp"
 
 namespace trading {
@@ -25,36 +26,47 @@ class TradingEngine {
    public:
     TradingEngine(common::ClientId client_id, common::AlgoType algo_type, const common::TradeEngineCfgMap &ticker_cfg,
                   exchange::ClientRequestLFQueue *client_requests, exchange::ClientResponseLFQueue *client_responses,
-                  exchange::MEMarketUpdateLFQueue *market_updates);
+                  exchange::MEMarketUpdateLFQueue *market_updates, common::WaitPolicy wait_policy);
 
     ~TradingEngine();
 
     void Start() {
-        run_ = true;
-        ASSERT(common::CreateAndStartThread(-1, "Trading/TradeEngine", [this] { Run(); }) != nullptr,
-               "Failed to start TradeEngine thread.");
+        thread_ =
+            common::CreateAndStartThread(-1, THREAD_NAME, [this](std::stop_token stop_token) { Run(stop_token); });
+        ASSERT(thread_ != nullptr, "Failed to start TradeEngine thread.");
     }
 
+    // Waits for the trade engine to consume every pending update before stopping it, unless it is stopped already.
+    // Only logs once the trade engine thread is gone, since its logger can only be used by one thread at a time.
     void Stop() {
-        while ((incoming_ogw_responses_->Size() != 0) || (incoming_md_updates_->Size() != 0)) {
-            logger_.Log("%:% %() % Sleeping till all updates are consumed ogw-size:% md-size:%\n", __FILE__, __LINE__,
-                        __FUNCTION__, common::GetCurrentTimeStr(&time_str_), incoming_ogw_responses_->Size(),
-                        incoming_md_updates_->Size());
+        if (thread_ == nullptr || thread_->StopRequested()) {
+            thread_ = nullptr;
+            return;
+        }
 
+        size_t num_sleeps = 0;
+        for (; (incoming_ogw_responses_->Size() != 0) || (incoming_md_updates_->Size() != 0); ++num_sleeps) {
             using namespace std::literals::chrono_literals;
             std::this_thread::sleep_for(10ms);
         }
 
+        thread_ = nullptr;
+
+        logger_.Log("%:% %() % Slept % times till all updates were consumed\n", __FILE__, __LINE__, __FUNCTION__,
+                    common::GetCurrentTimeStr(&time_str_), num_sleeps);
         logger_.Log("%:% %() % POSITIONS\n%\n", __FILE__, __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_),
                     position_keeper_.ToString());
-
-        run_ = false;
     }
 
-    void Run() noexcept;
+    void Run(std::stop_token stop_token) noexcept;
 
     void SendClientRequest(const exchange::MEClientRequest *client_request) noexcept;
 
+    // For a thread other than the trade engine's own, e.g. main() sending the orders of the RANDOM algorithm, for which
+    // the trade engine sends none itself. Logs to that thread's logger, as a logger only takes one thread's records.
+    void SendClientRequest(const exchange::MEClientRequest *client_request, common::Logger *logger,
+                           std::string *time_str) noexcept;
+
     void OnOrderBookUpdate(common::TickerId ticker_id, common::Price price, common::Side side,
                            TradingOrderBook *book) noexcept;
     void OnTradeUpdate(const exchange::MEMarketUpdate *market_update, TradingOrderBook *book) noexcept;
@@ -66,9 +78,9 @@ class TradingEngine {
     std::function<void(const exchange::MEMarketUpdate *market_update, TradingOrderBook *book)> algo_on_trade_update_;
     std::function<void(const exchange::MEClientResponse *client_response)> algo_on_order_update_;
 
-    auto InitLastEventTime() { last_event_time_ = common::GetCurrentNanos(); }
+    auto InitLastEventTime() { last_event_time_ = common::NowNanos(); }
 
-    auto SilentSeconds() { return (common::GetCurrentNanos() - last_event_time_) / common::NANOS_TO_SECS; }
+    auto SilentSeconds() { return (common::NowNanos() - last_event_time_) / common::NANOS_TO_SECS; }
 
     auto ClientId() const { return CLIENT_ID; }
 
@@ -84,6 +96,8 @@ class TradingEngine {
     auto operator=(const TradingEngine &&) -> TradingEngine & = delete;
 
    private:
+    static constexpr auto THREAD_NAME = "Trading/TradeEngine";
+
     const common::ClientId CLIENT_ID;
 
     TradingOrderBookMap ticker_order_book_;
@@ -93,7 +107,11 @@ class TradingEngine {
     exchange::MEMarketUpdateLFQueue *incoming_md_updates_ = nullptr;
 
     common::Nanos last_event_time_ = 0;
-    volatile bool run_ = false;
+    std::unique_ptr<common::ManagedThread> thread_;
+    common::WaitStrategy wait_strategy_;
+
+    // Stop token of the thread running Run(), which stops the requests from waiting for room in a full queue.
+    std::stop_token stop_token_;
 
     std::string time_str_;
     common::Logger logger_;
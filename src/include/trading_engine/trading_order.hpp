@@ -9,10 +9,10 @@
 
 #pragma once
 
-#include <array>
 #include <sstream>
 
 #include "common/types.hpp"
+#include "runtime/huge_pages.hpp"
 
 namespace trading {
 
@@ -59,12 +59,17 @@ struct TradingOrder {
     }
 };
 
-using OrderMap = std::array<TradingOrder *, common::ME_MAX_ORDER_IDS>;
+// Indexed by OrderId, sized to ME_MAX_ORDER_IDS by its owner.
+using OrderMap = common::HugePageArray<TradingOrder *>;
 
 struct TradingOrdersAtPrice {
     common::Side side_ = common::Side::INVALID;
     common::Price price_ = common::PRICE_INVALID;
 
+    // Aggregates of the orders at this price, maintained as orders are added, modified and removed.
+    common::Qty total_qty_ = 0;
+    size_t num_orders_ = 0;
+
     TradingOrder *first_mkt_order_ = nullptr;
 
     TradingOrdersAtPrice *prev_entry_ = nullptr;
@@ -85,6 +90,8 @@ struct TradingOrdersAtPrice {
         ss << "TradingOrdersAtPrice["
            << "side:" << common::SideToString(side_) << " "
            << "price:" << common::PriceToString(price_) << " "
+           << "qty:" << common::QtyToString(total_qty_) << " "
+           << "orders:" << num_orders_ << " "
            << "first_mkt_order:" << ((first_mkt_order_ != nullptr) ? first_mkt_order_->ToString() : "null") << " "
            << "prev:" << common::PriceToString((prev_entry_ != nullptr) ? prev_entry_->price_ : common::PRICE_INVALID)
            << " "
@@ -95,8 +102,6 @@ struct TradingOrdersAtPrice {
     }
 };
 
-using OrdersAtPriceMap = std::array<TradingOrdersAtPrice *, common::ME_MAX_PRICE_LEVELS>;
-
 // Best-Bid Offer data structure that tracks the best bid and ask offers and the quantities of these offers.
 struct BBO {
     common::Price bid_price_ = common::PRICE_INVALID, ask_price_ = common::PRICE_INVALID;
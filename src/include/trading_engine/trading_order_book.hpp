@@ -2,7 +2,8 @@
  * trading_order_book.hpp
  * Defines the trading engine's order book, the data structure responsible for either tracking the bid and ask orders
  * for a given instrument. Each side is a doubly linked-list of OrdersAtPrice, with the bid side sorted in descending
- * order and the ask side sorted in ascending order. The Order themselves are arranged in FIFO order.
+ * order and the ask side sorted in ascending order. The Order themselves are arranged in FIFO order. OrdersAtPrice are
+ * also indexed by price in a PriceLadder.
  */
 
 #pragma once
@@ -11,6 +12,7 @@
 #include "logging/logger.hpp"
 #include "market_data/market_update.hpp"
 #include "runtime/memory_pool.hpp"
+#include "runtime/price_ladder.hpp"
 #include "trading_engine/trading_order.hpp"
 
 namespace trading {
@@ -31,11 +33,7 @@ class TradingOrderBook final {
         if (update_bid) {
             if (bids_by_price_ != nullptr) {
                 bbo_.bid_price_ = bids_by_price_->price_;
-                bbo_.bid_qty_ = bids_by_price_->first_mkt_order_->qty_;
-                for (auto order = bids_by_price_->first_mkt_order_->next_order_;
-                     order != bids_by_price_->first_mkt_order_; order = order->next_order_) {
-                    bbo_.bid_qty_ += order->qty_;
-                }
+                bbo_.bid_qty_ = bids_by_price_->total_qty_;
             } else {
                 bbo_.bid_price_ = common::PRICE_INVALID;
                 bbo_.bid_qty_ = common::QTY_INVALID;
@@ -45,11 +43,7 @@ class TradingOrderBook final {
         if (update_ask) {
             if (asks_by_price_ != nullptr) {
                 bbo_.ask_price_ = asks_by_price_->price_;
-                bbo_.ask_qty_ = asks_by_price_->first_mkt_order_->qty_;
-                for (auto order = asks_by_price_->first_mkt_order_->next_order_;
-                     order != asks_by_price_->first_mkt_order_; order = order->next_order_) {
-                    bbo_.ask_qty_ += order->qty_;
-                }
+                bbo_.ask_qty_ = asks_by_price_->total_qty_;
             } else {
                 bbo_.ask_price_ = common::PRICE_INVALID;
                 bbo_.ask_qty_ = common::QTY_INVALID;
@@ -83,7 +77,7 @@ class TradingOrderBook final {
     TradingOrdersAtPrice *bids_by_price_ = nullptr;
     TradingOrdersAtPrice *asks_by_price_ = nullptr;
 
-    OrdersAtPriceMap price_orders_at_price_;
+    common::PriceLadder<TradingOrdersAtPrice> price_ladder_;
 
     common::MemoryPool<TradingOrder> order_pool_;
 
@@ -93,66 +87,35 @@ class TradingOrderBook final {
     common::Logger *logger_ = nullptr;
 
    private:
-    auto PriceToIndex(common::Price price) const noexcept { return (price % common::ME_MAX_PRICE_LEVELS); }
-
     auto GetOrdersAtPrice(common::Price price) const noexcept -> TradingOrdersAtPrice * {
-        return price_orders_at_price_.at(PriceToIndex(price));
+        return price_ladder_.Find(price);
     }
 
     void AddOrdersAtPrice(TradingOrdersAtPrice *new_orders_at_price) noexcept {
-        price_orders_at_price_.at(PriceToIndex(new_orders_at_price->price_)) = new_orders_at_price;
+        const auto side = new_orders_at_price->side_;
+        price_ladder_.Insert(side, new_orders_at_price->price_, new_orders_at_price);
 
-        const auto best_orders_by_price =
-            (new_orders_at_price->side_ == common::Side::BUY ? bids_by_price_ : asks_by_price_);
+        auto &best_orders_by_price = (side == common::Side::BUY ? bids_by_price_ : asks_by_price_);
         if (best_orders_by_price == nullptr) [[unlikely]] {
-            (new_orders_at_price->side_ == common::Side::BUY ? bids_by_price_ : asks_by_price_) = new_orders_at_price;
+            best_orders_by_price = new_orders_at_price;
             new_orders_at_price->prev_entry_ = new_orders_at_price->next_entry_ = new_orders_at_price;
-        } else {
-            auto target = best_orders_by_price;
-            bool add_after =
-                ((new_orders_at_price->side_ == common::Side::SELL && new_orders_at_price->price_ > target->price_) ||
-                 (new_orders_at_price->side_ == common::Side::BUY && new_orders_at_price->price_ < target->price_));
-            if (add_after) {
-                target = target->next_entry_;
-                add_after =
-                    ((new_orders_at_price->side_ == common::Side::SELL &&
-                      new_orders_at_price->price_ > target->price_) ||
-                     (new_orders_at_price->side_ == common::Side::BUY && new_orders_at_price->price_ < target->price_));
-            }
-            while (add_after && target != best_orders_by_price) {
-                add_after =
-                    ((new_orders_at_price->side_ == common::Side::SELL &&
-                      new_orders_at_price->price_ > target->price_) ||
-                     (new_orders_at_price->side_ == common::Side::BUY && new_orders_at_price->price_ < target->price_));
-                if (add_after) {
-                    target = target->next_entry_;
-                }
-            }
+            return;
+        }
 
-            if (add_after) {  // add new_orders_at_price after target.
-                if (target == best_orders_by_price) {
-                    target = best_orders_by_price->prev_entry_;
-                }
-                new_orders_at_price->prev_entry_ = target;
-                target->next_entry_->prev_entry_ = new_orders_at_price;
-                new_orders_at_price->next_entry_ = target->next_entry_;
-                target->next_entry_ = new_orders_at_price;
-            } else {  // add new_orders_at_price before target.
-                new_orders_at_price->prev_entry_ = target->prev_entry_;
-                new_orders_at_price->next_entry_ = target;
-                target->prev_entry_->next_entry_ = new_orders_at_price;
-                target->prev_entry_ = new_orders_at_price;
-
-                if ((new_orders_at_price->side_ == common::Side::BUY &&
-                     new_orders_at_price->price_ > best_orders_by_price->price_) ||
-                    (new_orders_at_price->side_ == common::Side::SELL &&
-                     new_orders_at_price->price_ < best_orders_by_price->price_)) {
-                    target->next_entry_ =
-                        (target->next_entry_ == best_orders_by_price ? new_orders_at_price : target->next_entry_);
-                    (new_orders_at_price->side_ == common::Side::BUY ? bids_by_price_ : asks_by_price_) =
-                        new_orders_at_price;
-                }
-            }
+        // Insert after the closest more aggressive level, or after the least aggressive one if this is the new best.
+        auto target = price_ladder_.NextBetter(side, new_orders_at_price->price_);
+        const auto is_new_best = (target == nullptr);
+        if (is_new_best) {
+            target = best_orders_by_price->prev_entry_;
+        }
+
+        new_orders_at_price->prev_entry_ = target;
+        new_orders_at_price->next_entry_ = target->next_entry_;
+        target->next_entry_->prev_entry_ = new_orders_at_price;
+        target->next_entry_ = new_orders_at_price;
+
+        if (is_new_best) {
+            best_orders_by_price = new_orders_at_price;
         }
     }
 
@@ -173,7 +136,7 @@ class TradingOrderBook final {
             orders_at_price->prev_entry_ = orders_at_price->next_entry_ = nullptr;
         }
 
-        price_orders_at_price_.at(PriceToIndex(price)) = nullptr;
+        price_ladder_.Erase(side, price);
 
         orders_at_price_pool_.Deallocate(orders_at_price);
     }
@@ -193,6 +156,9 @@ class TradingOrderBook final {
                 orders_at_price->first_mkt_order_ = order_after;
             }
 
+            orders_at_price->total_qty_ -= order->qty_;
+            --orders_at_price->num_orders_;
+
             order->prev_order_ = order->next_order_ = nullptr;
         }
 
@@ -201,16 +167,15 @@ class TradingOrderBook final {
     }
 
     void AddOrder(TradingOrder *order) noexcept {
-        const auto orders_at_price = GetOrdersAtPrice(order->price_);
+        auto orders_at_price = GetOrdersAtPrice(order->price_);
 
         if (orders_at_price == nullptr) {
             order->next_order_ = order->prev_order_ = order;
 
-            auto new_orders_at_price =
-                orders_at_price_pool_.Allocate(order->side_, order->price_, order, nullptr, nullptr);
-            AddOrdersAtPrice(new_orders_at_price);
+            orders_at_price = orders_at_price_pool_.Allocate(order->side_, order->price_, order, nullptr, nullptr);
+            AddOrdersAtPrice(orders_at_price);
         } else {
-            auto first_order = ((orders_at_price != nullptr) ? orders_at_price->first_mkt_order_ : nullptr);
+            auto first_order = orders_at_price->first_mkt_order_;
 
             first_order->prev_order_->next_order_ = order;
             order->prev_order_ = first_order->prev_order_;
@@ -218,6 +183,9 @@ class TradingOrderBook final {
             first_order->prev_order_ = order;
         }
 
+        orders_at_price->total_qty_ += order->qty_;
+        ++orders_at_price->num_orders_;
+
         oid_to_order_.at(order->order_id_) = order;
     }
 };
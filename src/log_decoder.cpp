@@ -0,0 +1,58 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common/integrity.hpp"
+#include "logging/log_record.hpp"
+
+// ./log_decoder BINARY_LOG
+// Formats a log written by a Logger with LOG_FORMAT=BINARY, e.g. trading_engine_1.log.bin, into the text the Logger
+// would have written with LOG_FORMAT=TEXT, on stdout. The log has to be decoded on a machine with the same endianness
+// and type sizes as the one that wrote it.
+auto main(int argc, char **argv) -> int {
+    if (argc != 2) {
+        FATAL("USAGE log_decoder BINARY_LOG");
+    }
+
+    std::ifstream file(argv[1], std::ios::binary);
+    if (!file) {
+        FATAL("Unable to open log:" + std::string(argv[1]));
+    }
+
+    char magic[sizeof(common::LOG_FILE_MAGIC)];
+    if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, common::LOG_FILE_MAGIC, sizeof(magic)) != 0) {
+        FATAL("Not a binary log:" + std::string(argv[1]));
+    }
+
+    std::ios::sync_with_stdio(false);
+    std::unordered_map<uint64_t, std::string> formats;
+    std::vector<std::byte> body;
+    common::LogRecordHeader header;
+    while (file.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+        if (header.size_ < sizeof(header)) {
+            FATAL("Corrupt record in:" + std::string(argv[1]));
+        }
+        body.resize(header.size_ - sizeof(header));
+        if (!file.read(reinterpret_cast<char *>(body.data()), static_cast<std::streamsize>(body.size()))) {
+            // The process writing the log did not get to finish the record.
+            std::cerr << "Truncated record at the end of:" << argv[1] << '\n';
+            break;
+        }
+
+        if (header.num_args_ == common::LOG_FORMAT_RECORD) {
+            formats[header.format_id_].assign(reinterpret_cast<const char *>(body.data()), body.size());
+            continue;
+        }
+
+        const auto format = formats.find(header.format_id_);
+        if (format == formats.end() || !common::FormatLogRecord(std::cout, format->second, body)) {
+            FATAL("Corrupt record in:" + std::string(argv[1]));
+        }
+    }
+
+    return 0;
+}
@@ -1,40 +1,60 @@
 #include "market_data/market_data_consumer.hpp"
 
+#include "common/latency_histogram.hpp"
 #include "common/perf_utils.hpp"
 
 namespace trading {
 MarketDataConsumer::MarketDataConsumer(common::ClientId client_id, exchange::MEMarketUpdateLFQueue *market_updates,
                                        const std::string &iface,
                                        const std::string &snapshot_ip,  // NOLINT
-                                       int snapshot_port, const std::string &incremental_ip, int incremental_port)
+                                       int snapshot_port, const std::string &incremental_ip, int incremental_port,
+                                       common::WaitPolicy wait_policy, common::Transport transport)
     : incoming_md_updates_(market_updates),
-      run_(false),  // NOLINT
+      wait_strategy_(common::GetThreadConfig(THREAD_NAME, -1).WaitPolicyOr(wait_policy)),
       logger_("trading_market_data_consumer_" + std::to_string(client_id) + ".log"),
       incremental_mcast_socket_(logger_),
       snapshot_mcast_socket_(logger_),
       IFACE(iface),
       SNAPSHOT_IP(snapshot_ip),
-      SNAPSHOT_PORT(snapshot_port) {
+      SNAPSHOT_PORT(snapshot_port),
+      TRANSPORT(transport) {
     auto recv_callback = [this](auto socket) { RecvCallback(socket); };
 
-    incremental_mcast_socket_.recv_callback_ = recv_callback;
-    ASSERT(incremental_mcast_socket_.Init(incremental_ip, iface, incremental_port, /*is_listening*/ true) >= 0,
-           "Unable to create incremental mcast socket. error:" + std::string(std::strerror(errno)));
+    // Updates published before the consumer opened the stream are recovered from the snapshot stream, like those
+    // multicast before it joined.
+    if (TRANSPORT == common::Transport::SHM) {
+        if (!shm_incremental_.Open(common::SHM_MD_INCREMENTAL)) {
+            FATAL("Unable to open shared memory incremental stream:" + std::string(common::SHM_MD_INCREMENTAL) +
+                  " error:" + std::string(std::strerror(errno)));
+        }
+        shm_incremental_read_index_ = shm_incremental_.WriteIndex();
+    } else {
+        incremental_mcast_socket_.recv_callback_ = recv_callback;
+        ASSERT(incremental_mcast_socket_.Init(incremental_ip, iface, incremental_port, /*is_listening*/ true) >= 0,
+               "Unable to create incremental mcast socket. error:" + std::string(std::strerror(errno)));
 
-    ASSERT(incremental_mcast_socket_.Join(incremental_ip),
-           "Join failed on:" + std::to_string(incremental_mcast_socket_.socket_fd_) +
-               " error:" + std::string(std::strerror(errno)));
+        ASSERT(incremental_mcast_socket_.Join(incremental_ip),
+               "Join failed on:" + std::to_string(incremental_mcast_socket_.socket_fd_) +
+                   " error:" + std::string(std::strerror(errno)));
+    }
 
     snapshot_mcast_socket_.recv_callback_ = recv_callback;
 }
 
 // Main loop for this thread - reads and processes messages from the multicast sockets - the heavy lifting is in the
 // recvCallback() and checkSnapshotSync() methods.
-void MarketDataConsumer::Run() noexcept {
+void MarketDataConsumer::Run(std::stop_token stop_token) noexcept {
     logger_.Log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_));
-    while (run_) {
-        incremental_mcast_socket_.SendAndRecv();
-        snapshot_mcast_socket_.SendAndRecv();
+    stop_token_ = stop_token;
+    while (!stop_token.stop_requested()) {
+        const auto incremental_received =
+            (TRANSPORT == common::Transport::SHM ? RecvShm() : incremental_mcast_socket_.SendAndRecv());
+        const auto snapshot_received = snapshot_mcast_socket_.SendAndRecv();
+        if (incremental_received || snapshot_received) {
+            wait_strategy_.Reset();
+        } else {
+            wait_strategy_.Idle();
+        }
     }
 }
 
@@ -142,10 +162,14 @@ void MarketDataConsumer::CheckSnapshotSync() {
     }
 
     for (const auto &itr : final_events) {
-        auto next_write = incoming_md_updates_->GetNextToWriteTo();
+        auto next_write = incoming_md_updates_->GetNextToWriteTo(stop_token_);
+        if (next_write == nullptr) [[unlikely]] {
+            return;  // stopping, and the trade engine may not read any more updates.
+        }
         *next_write = itr;
-        incoming_md_updates_->UpdateWriteIndex();
+        incoming_md_updates_->AdvanceWriteIndex();
     }
+    incoming_md_updates_->PublishWriteIndex();
 
     logger_.Log("%:% %() % Recovered % snapshot and % incremental orders.\n", __FILE__, __LINE__, __FUNCTION__,
                 common::GetCurrentTimeStr(&time_str_), snapshot_queued_msgs_.size() - 2, num_incrementals);
@@ -200,45 +224,70 @@ void MarketDataConsumer::RecvCallback(common::McastSocket *socket) noexcept {
         size_t i = 0;
         for (; i + sizeof(exchange::MDPMarketUpdate) <= socket->next_rcv_valid_index_;
              i += sizeof(exchange::MDPMarketUpdate)) {
-            auto request = reinterpret_cast<const exchange::MDPMarketUpdate *>(socket->inbound_data_.data() + i);
-            logger_.Log("%:% %() % Received % socket len:% %\n", __FILE__, __LINE__, __FUNCTION__,
-                        common::GetCurrentTimeStr(&time_str_), (is_snapshot ? "snapshot" : "incremental"),
-                        sizeof(exchange::MDPMarketUpdate), request->ToString());
-
-            const bool already_in_recovery = in_recovery_;
-            in_recovery_ = (already_in_recovery || request->seq_num_ != next_exp_inc_seq_num_);
-
-            if (in_recovery_) [[unlikely]] {
-                if (!already_in_recovery)
-                    [[unlikely]] {  // if we just entered recovery, start the snapshot synchonization process by
-                                    // subscribing to the snapshot multicast stream.
-                    logger_.Log("%:% %() % Packet drops on % socket. SeqNum expected:% received:%\n", __FILE__,
-                                __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_),
-                                (is_snapshot ? "snapshot" : "incremental"), next_exp_inc_seq_num_, request->seq_num_);
-                    StartSnapshotSync();
-                }
-
-                QueueMessage(is_snapshot, request);  // queue up the market data update message and check if snapshot
-                                                     // recovery / synchronization can be completed successfully.
-            } else if (!is_snapshot) {  // not in recovery and received a packet in the correct order and without gaps,
-                                        // process it.
-                logger_.Log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_),
-                            request->ToString());
-
-                ++next_exp_inc_seq_num_;
-
-                auto next_write = incoming_md_updates_->GetNextToWriteTo();
-                *next_write = request->me_market_update_;
-                incoming_md_updates_->UpdateWriteIndex();
-                TTT_MEASURE(t8_market_data_consumer_lf_queue_write, logger_);
-            }
+            OnMarketUpdate(is_snapshot,
+                           reinterpret_cast<const exchange::MDPMarketUpdate *>(socket->inbound_data_.data() + i));
         }
+        // Every update of the datagrams read in one go is handed to the trade engine at once.
+        incoming_md_updates_->PublishWriteIndex();
 
         // Shift down leftover bytes to the start of inbound_data_.
         memcpy(socket->inbound_data_.data(), socket->inbound_data_.data() + i, socket->next_rcv_valid_index_ - i);
         socket->next_rcv_valid_index_ -= i;
     }
-    END_MEASURE(trading_market_data_consumer_recv_callback, logger_);
+    END_MEASURE(trading_market_data_consumer_recv_callback);
+}
+
+auto MarketDataConsumer::RecvShm() noexcept -> bool {
+    exchange::MDPMarketUpdate update;
+    if (!shm_incremental_.Read(&shm_incremental_read_index_, &update)) {
+        return false;
+    }
+
+    START_MEASURE(trading_market_data_consumer_recv_shm);
+    do {
+        TTT_MEASURE(t7_market_data_consumer_udp_read, logger_);
+        OnMarketUpdate(false, &update);
+    } while (shm_incremental_.Read(&shm_incremental_read_index_, &update));
+    incoming_md_updates_->PublishWriteIndex();
+    END_MEASURE(trading_market_data_consumer_recv_shm);
+    return true;
+}
+
+void MarketDataConsumer::OnMarketUpdate(bool is_snapshot, const exchange::MDPMarketUpdate *request) noexcept {
+    logger_.Log("%:% %() % Received % socket len:% %\n", __FILE__, __LINE__, __FUNCTION__,
+                common::GetCurrentTimeStr(&time_str_), (is_snapshot ? "snapshot" : "incremental"),
+                sizeof(exchange::MDPMarketUpdate), request->ToString());
+
+    const bool already_in_recovery = in_recovery_;
+    in_recovery_ = (already_in_recovery || request->seq_num_ != next_exp_inc_seq_num_);
+
+    if (in_recovery_) [[unlikely]] {
+        if (!already_in_recovery) [[unlikely]] {  // if we just entered recovery, start the snapshot synchonization
+                                                  // process by subscribing to the snapshot multicast stream.
+            logger_.Log("%:% %() % Packet drops on % socket. SeqNum expected:% received:%\n", __FILE__, __LINE__,
+                        __FUNCTION__, common::GetCurrentTimeStr(&time_str_), (is_snapshot ? "snapshot" : "incremental"),
+                        next_exp_inc_seq_num_, request->seq_num_);
+            StartSnapshotSync();
+        }
+
+        QueueMessage(is_snapshot, request);  // queue up the market data update message and check if snapshot
+                                             // recovery / synchronization can be completed successfully.
+    } else if (!is_snapshot) {  // not in recovery and received a packet in the correct order and without gaps, process
+                                // it.
+        logger_.Log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_),
+                    request->ToString());
+
+        ++next_exp_inc_seq_num_;
+
+        auto next_write = incoming_md_updates_->GetNextToWriteTo(stop_token_);
+        if (next_write == nullptr) [[unlikely]] {
+            return;  // stopping, and the trade engine may not read any more updates.
+        }
+        *next_write = request->me_market_update_;
+        TRACE_HOP(*next_write, MDC_UPDATE_RECV);
+        incoming_md_updates_->AdvanceWriteIndex();
+        TTT_MEASURE(t8_market_data_consumer_lf_queue_write, logger_);
+    }
 }
 
 }  // namespace trading
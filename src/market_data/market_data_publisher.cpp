@@ -1,51 +1,94 @@
 #include "market_data/market_data_publisher.hpp"
 
+#include "common/latency_histogram.hpp"
 #include "common/perf_utils.hpp"
 
 namespace exchange {
 
-MarketDataPublisher::MarketDataPublisher(MEMarketUpdateLFQueue *market_updates, const std::string &iface,
+MarketDataPublisher::MarketDataPublisher(ShardChannels *shard_channels, const std::string &iface,
                                          const std::string &snapshot_ip, int snapshot_port,
-                                         const std::string &incremental_ip, int incremental_port)
-    : outgoing_md_updates_(market_updates),
-      snapshot_md_updates_(common::ME_MAX_MARKET_UPDATES),
-      run_(false),  // NOLINT
+                                         const std::string &incremental_ip, int incremental_port,
+                                         common::WaitPolicy wait_policy, common::Transport transport)
+    : outgoing_md_updates_(shard_channels, &ShardChannel::market_updates_),
+      md_updates_(common::ME_MAX_MARKET_UPDATES, NUM_MD_READERS),
+      wait_strategy_(common::GetThreadConfig(THREAD_NAME, -1).WaitPolicyOr(wait_policy)),
       logger_("exchange_market_data_publisher.log"),
-      incremental_socket_(logger_) {
+      incremental_socket_(logger_),
+      TRANSPORT(transport) {
     ASSERT(incremental_socket_.Init(incremental_ip, iface, incremental_port, /*is_listening*/ false) >= 0,
            "Unable to create incremental mcast socket. error:" + std::string(std::strerror(errno)));
-    snapshot_synthesizer_ = new SnapshotSynthesizer(&snapshot_md_updates_, iface, snapshot_ip, snapshot_port);
+    if (TRANSPORT == common::Transport::SHM) {
+        if (!shm_incremental_.Create(common::SHM_MD_INCREMENTAL, common::ME_MAX_MARKET_UPDATES)) {
+            FATAL("Unable to create shared memory incremental stream:" + std::string(common::SHM_MD_INCREMENTAL) +
+                  " error:" + std::string(std::strerror(errno)));
+        }
+    }
+    snapshot_synthesizer_ =
+        new SnapshotSynthesizer(&md_updates_, MD_READER_SNAPSHOT, iface, snapshot_ip, snapshot_port);
 }
 
-void MarketDataPublisher::Run() noexcept {
+void MarketDataPublisher::Run(std::stop_token stop_token) noexcept {
     logger_.Log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_));
-    while (run_) {
-        for (auto market_update = outgoing_md_updates_->GetNextToRead();
-             (outgoing_md_updates_->Size() != 0) && (market_update != nullptr);
-             market_update = outgoing_md_updates_->GetNextToRead()) {
+    while (!stop_token.stop_requested()) {
+        size_t num_sent = 0;
+        for (auto market_update = outgoing_md_updates_.GetNextToRead(); market_update != nullptr;
+             market_update = outgoing_md_updates_.GetNextToRead()) {
             TTT_MEASURE(t5_market_data_publisher_lf_queue_read, logger_);
 
-            logger_.Log("%:% %() % Sending seq:% %\n", __FILE__, __LINE__, __FUNCTION__,
-                        common::GetCurrentTimeStr(&time_str_), next_inc_seq_num_, market_update->ToString().c_str());
+            auto next_write = md_updates_.GetNextToWriteTo();
+            next_write->seq_num_ = next_inc_seq_num_;
+            next_write->me_market_update_ = *market_update;
+            TRACE_HOP(next_write->me_market_update_, MDP_UPDATE_SEND);
+            outgoing_md_updates_.UpdateReadIndex();
+
+            logger_.Log("%:% %() % Sending %\n", __FILE__, __LINE__, __FUNCTION__,
+                        common::GetCurrentTimeStr(&time_str_), next_write->ToString().c_str());
 
             START_MEASURE(exchange_mcast_socket_send);
-            // Sends an MDPMarketUpdate as its components (a sequence number followed by an MEMarketUpdate).
-            incremental_socket_.Send(&next_inc_seq_num_, sizeof(next_inc_seq_num_));
-            incremental_socket_.Send(market_update, sizeof(MEMarketUpdate));
-            END_MEASURE(exchange_mcast_socket_send, logger_);
+            incremental_socket_.Send(next_write, sizeof(MDPMarketUpdate));
+            END_MEASURE(exchange_mcast_socket_send);
 
-            outgoing_md_updates_->UpdateReadIndex();
-            TTT_MEASURE(t6_market_data_publisher_udp_write, logger_);
+            if (TRANSPORT == common::Transport::SHM) {
+                START_MEASURE(exchange_shm_incremental_send);
+                *shm_incremental_.GetNextToWriteTo() = *next_write;
+                shm_incremental_.AdvanceWriteIndex();
+                END_MEASURE(exchange_shm_incremental_send);
+            }
 
-            auto next_write = snapshot_md_updates_.GetNextToWriteTo();
-            next_write->seq_num_ = next_inc_seq_num_;
-            next_write->me_market_update_ = *market_update;
-            snapshot_md_updates_.UpdateWriteIndex();
+            TTT_MEASURE(t6_market_data_publisher_udp_write, logger_);
 
+            md_updates_.AdvanceWriteIndex();
             ++next_inc_seq_num_;
+            ++num_sent;
+        }
+        if (num_sent != 0) {
+            md_updates_.PublishWriteIndex();
+            if (TRANSPORT == common::Transport::SHM) {
+                shm_incremental_.PublishWriteIndex();
+            }
+            CheckMarketUpdateReaders();
         }
 
         incremental_socket_.SendAndRecv();
+
+        // The matching engine shards do not ring, so when parked the loop wakes up after the park timeout.
+        if (num_sent == 0) {
+            wait_strategy_.Idle();
+        } else {
+            wait_strategy_.Reset();
+        }
+    }
+}
+
+void MarketDataPublisher::CheckMarketUpdateReaders() noexcept {
+    const auto slowest_reader = md_updates_.SlowestReader();
+    const auto lag = md_updates_.Lag(slowest_reader);
+    const auto lagging = (lag > md_updates_.Capacity() / 2);
+    if (lagging != md_reader_lagging_) [[unlikely]] {
+        md_reader_lagging_ = lagging;
+        logger_.Log("%:% %() % Market update reader:% is % updates behind, % of %.\n", __FILE__, __LINE__,
+                    __FUNCTION__, common::GetCurrentTimeStr(&time_str_), slowest_reader, lag,
+                    lagging ? "more than half" : "back under half", md_updates_.Capacity());
     }
 }
 
@@ -1,11 +1,15 @@
 #include "market_data/snapshot_synthesizer.hpp"
 
+#include "common/perf_utils.hpp"
+
 namespace exchange {
 
-SnapshotSynthesizer::SnapshotSynthesizer(MDPMarketUpdateLFQueue *market_updates, const std::string &iface,
-                                         const std::string &snapshot_ip, int snapshot_port)
-    : snapshot_md_updates_(market_updates),
+SnapshotSynthesizer::SnapshotSynthesizer(MDPMarketUpdateBroadcastQueue *market_updates, size_t reader,
+                                         const std::string &iface, const std::string &snapshot_ip, int snapshot_port)
+    : md_updates_(market_updates),
+      md_reader_(reader),
       logger_("exchange_snapshot_synthesizer.log"),
+      wait_strategy_(common::GetThreadConfig(THREAD_NAME, -1).WaitPolicyOr(common::WaitPolicy::PARK)),
       snapshot_socket_(logger_),
       order_pool_(common::ME_MAX_ORDER_IDS) {
     ASSERT(snapshot_socket_.Init(snapshot_ip, iface, snapshot_port, /*is_listening*/ false) >= 0,
@@ -18,12 +22,11 @@ SnapshotSynthesizer::SnapshotSynthesizer(MDPMarketUpdateLFQueue *market_updates,
 SnapshotSynthesizer::~SnapshotSynthesizer() { Stop(); }
 
 void SnapshotSynthesizer::Start() {
-    run_ = true;
-    ASSERT(common::CreateAndStartThread(-1, "exchange/SnapshotSynthesizer", [this]() { Run(); }) != nullptr,
-           "Failed to start SnapshotSynthesizer thread.");
+    thread_ = common::CreateAndStartThread(-1, THREAD_NAME, [this](std::stop_token stop_token) { Run(stop_token); });
+    ASSERT(thread_ != nullptr, "Failed to start SnapshotSynthesizer thread.");
 }
 
-void SnapshotSynthesizer::Stop() { run_ = false; }
+void SnapshotSynthesizer::Stop() { thread_ = nullptr; }
 
 auto SnapshotSynthesizer::AddToSnapshot(const MDPMarketUpdate *market_update) {
     const auto &me_market_update = market_update->me_market_update_;
@@ -43,6 +46,7 @@ auto SnapshotSynthesizer::AddToSnapshot(const MDPMarketUpdate *market_update) {
 
             order->qty_ = me_market_update.qty_;
             order->price_ = me_market_update.price_;
+            order->priority_ = me_market_update.priority_;
         } break;
         case MarketUpdateType::CANCEL: {
             auto order = orders->at(me_market_update.order_id_);
@@ -110,24 +114,32 @@ auto SnapshotSynthesizer::PublishSnapshot() {
                 common::GetCurrentTimeStr(&time_str_), snapshot_size - 1);
 }
 
-void SnapshotSynthesizer::Run() {
+void SnapshotSynthesizer::Run(std::stop_token stop_token) {
     logger_.Log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_));
-    while (run_) {
-        for (auto market_update = snapshot_md_updates_->GetNextToRead();
-             (snapshot_md_updates_->Size() != 0) && (market_update != nullptr);
-             market_update = snapshot_md_updates_->GetNextToRead()) {
-            logger_.Log("%:% %() % Processing %\n", __FILE__, __LINE__, __FUNCTION__,
-                        common::GetCurrentTimeStr(&time_str_), market_update->ToString().c_str());
-
-            AddToSnapshot(market_update);
-
-            snapshot_md_updates_->UpdateReadIndex();
+    while (!stop_token.stop_requested()) {
+        auto idle = true;
+        for (auto market_updates = md_updates_->GetAllToRead(md_reader_); !market_updates.empty();
+             market_updates = md_updates_->GetAllToRead(md_reader_)) {
+            idle = false;
+            for (const auto &market_update : market_updates) {
+                logger_.Log("%:% %() % Processing %\n", __FILE__, __LINE__, __FUNCTION__,
+                            common::GetCurrentTimeStr(&time_str_), market_update.ToString().c_str());
+
+                AddToSnapshot(&market_update);
+            }
+            md_updates_->UpdateReadIndex(md_reader_, market_updates.size());
         }
 
-        if (common::GetCurrentNanos() - last_snapshot_time_ > 60 * common::NANOS_TO_SECS) {
-            last_snapshot_time_ = common::GetCurrentNanos();
+        if (const auto now = common::NowNanos(); now - last_snapshot_time_ > 60 * common::NANOS_TO_SECS) {
+            last_snapshot_time_ = now;
             PublishSnapshot();
         }
+
+        if (idle) {
+            wait_strategy_.Idle();
+        } else {
+            wait_strategy_.Reset();
+        }
     }
 }
 
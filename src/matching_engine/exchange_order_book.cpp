@@ -1,6 +1,6 @@
 #include "matching_engine/exchange_order_book.hpp"
 
-#include "common/perf_utils.hpp"
+#include "common/latency_histogram.hpp"
 #include "matching_engine/matching_engine.hpp"
 
 namespace exchange {
@@ -9,19 +9,22 @@ ExchangeOrderBook::ExchangeOrderBook(common::TickerId ticker_id, common::Logger
                                      MatchingEngine *matching_engine)
     : ticker_id_(ticker_id),
       matching_engine_(matching_engine),
+      cid_oid_to_order_(common::ME_MAX_ORDER_IDS),
       orders_at_price_pool_(common::ME_MAX_PRICE_LEVELS),
-      order_pool_(common::ME_MAX_ORDER_IDS),
+      order_pool_(common::ME_MAX_ORDER_IDS / ME_ORDER_POOL_CHUNKS, ME_ORDER_POOL_CHUNKS),
       logger_(logger) {}
 
 ExchangeOrderBook::~ExchangeOrderBook() {
     logger_->Log("%:% %() % ExchangeOrderBook\n%\n", __FILE__, __LINE__, __FUNCTION__,
                  common::GetCurrentTimeStr(&time_str_), ToString(false, true));
+    logger_->Log("%:% %() % Ticker:% order pool:% orders at price pool:%\n", __FILE__, __LINE__, __FUNCTION__,
+                 common::GetCurrentTimeStr(&time_str_), common::TickerIdToString(ticker_id_),
+                 order_pool_.Stats().ToString(), orders_at_price_pool_.Stats().ToString());
 
     matching_engine_ = nullptr;
     bids_by_price_ = asks_by_price_ = nullptr;
-    for (auto &itr : cid_oid_to_order_) {
-        itr.fill(nullptr);
-    }
+    cid_oid_to_order_.Clear();
+    cid_side_orders_ = {};
 }
 
 auto ExchangeOrderBook::Match(common::TickerId ticker_id, common::ClientId client_id, common::Side side,
@@ -33,6 +36,7 @@ auto ExchangeOrderBook::Match(common::TickerId ticker_id, common::ClientId clien
 
     *leaves_qty -= fill_qty;
     order->qty_ -= fill_qty;
+    GetOrdersAtPrice(order->price_)->total_qty_ -= fill_qty;
 
     client_response_ = {.type_ = ClientResponseType::FILLED,
                         .client_id_ = client_id,
@@ -78,7 +82,7 @@ auto ExchangeOrderBook::Match(common::TickerId ticker_id, common::ClientId clien
 
         START_MEASURE(exchange_me_order_book_remove_order);
         RemoveOrder(order);
-        END_MEASURE(exchange_me_order_book_remove_order, (*logger_));
+        END_MEASURE(exchange_me_order_book_remove_order);
     } else {
         // Upon partial execution, send a MODIFY message as well.
         market_update_ = {.type_ = MarketUpdateType::MODIFY,
@@ -94,9 +98,14 @@ auto ExchangeOrderBook::Match(common::TickerId ticker_id, common::ClientId clien
 
 auto ExchangeOrderBook::CheckForMatch(common::ClientId client_id, common::OrderId client_order_id,
                                       common::TickerId ticker_id, common::Side side, common::Price price,
-                                      common::Qty qty, common::Qty new_market_order_id) noexcept {
+                                      common::Qty qty, common::Qty new_market_order_id,
+                                      TimeInForce time_in_force) noexcept {
     auto leaves_qty = qty;
 
+    if (time_in_force == TimeInForce::FOK && !CanFullyMatch(side, price, qty)) {
+        return leaves_qty;
+    }
+
     if (side == common::Side::BUY) {
         while ((leaves_qty != 0) && (asks_by_price_ != nullptr)) {
             const auto ask_itr = asks_by_price_->first_order_;
@@ -106,7 +115,7 @@ auto ExchangeOrderBook::CheckForMatch(common::ClientId client_id, common::OrderI
 
             START_MEASURE(exchange_me_order_book_match);
             Match(ticker_id, client_id, side, client_order_id, new_market_order_id, ask_itr, &leaves_qty);
-            END_MEASURE(exchange_me_order_book_match, (*logger_));
+            END_MEASURE(exchange_me_order_book_match);
         }
     }
     if (side == common::Side::SELL) {
@@ -118,7 +127,7 @@ auto ExchangeOrderBook::CheckForMatch(common::ClientId client_id, common::OrderI
 
             START_MEASURE(exchange_me_order_book_match);
             Match(ticker_id, client_id, side, client_order_id, new_market_order_id, bid_itr, &leaves_qty);
-            END_MEASURE(exchange_me_order_book_match, (*logger_));
+            END_MEASURE(exchange_me_order_book_match);
         }
     }
 
@@ -126,7 +135,22 @@ auto ExchangeOrderBook::CheckForMatch(common::ClientId client_id, common::OrderI
 }
 
 void ExchangeOrderBook::Add(common::ClientId client_id, common::OrderId client_order_id, common::TickerId ticker_id,
-                            common::Side side, common::Price price, common::Qty qty) noexcept {
+                            common::Side side, common::Price price, common::Qty qty,
+                            TimeInForce time_in_force) noexcept {
+    if (!IsValidTimeInForce(time_in_force) || !price_ladder_.CanHold(price)) [[unlikely]] {
+        client_response_ = {.type_ = ClientResponseType::NEW_REJECTED,
+                            .client_id_ = client_id,
+                            .ticker_id_ = ticker_id,
+                            .client_order_id_ = client_order_id,
+                            .market_order_id_ = common::ORDER_ID_INVALID,
+                            .side_ = side,
+                            .price_ = price,
+                            .exec_qty_ = common::QTY_INVALID,
+                            .leaves_qty_ = qty};
+        matching_engine_->SendClientResponse(&client_response_);
+        return;
+    }
+
     const auto new_market_order_id = GenerateNewMarketOrderId();
     client_response_ = {.type_ = ClientResponseType::ACCEPTED,
                         .client_id_ = client_id,
@@ -140,17 +164,29 @@ void ExchangeOrderBook::Add(common::ClientId client_id, common::OrderId client_o
     matching_engine_->SendClientResponse(&client_response_);
 
     START_MEASURE(exchange_me_order_book_check_for_match);
-    const auto leaves_qty = CheckForMatch(client_id, client_order_id, ticker_id, side, price, qty, new_market_order_id);
-    END_MEASURE(exchange_me_order_book_check_for_match, (*logger_));
+    const auto leaves_qty =
+        CheckForMatch(client_id, client_order_id, ticker_id, side, price, qty, new_market_order_id, time_in_force);
+    END_MEASURE(exchange_me_order_book_check_for_match);
 
-    if (leaves_qty != 0) [[likely]] {
+    if (leaves_qty != 0 && time_in_force != TimeInForce::GTC) {
+        client_response_ = {.type_ = ClientResponseType::CANCELED,
+                            .client_id_ = client_id,
+                            .ticker_id_ = ticker_id,
+                            .client_order_id_ = client_order_id,
+                            .market_order_id_ = new_market_order_id,
+                            .side_ = side,
+                            .price_ = price,
+                            .exec_qty_ = common::QTY_INVALID,
+                            .leaves_qty_ = leaves_qty};
+        matching_engine_->SendClientResponse(&client_response_);
+    } else if (leaves_qty != 0) [[likely]] {
         const auto priority = GetNextPriority(price);
 
         auto order = order_pool_.Allocate(ticker_id, client_id, client_order_id, new_market_order_id, side, price,
                                           leaves_qty, priority, nullptr, nullptr);
         START_MEASURE(exchange_me_order_book_add_order);
         AddOrder(order);
-        END_MEASURE(exchange_me_order_book_add_order, (*logger_));
+        END_MEASURE(exchange_me_order_book_add_order);
 
         market_update_ = {.type_ = MarketUpdateType::ADD,
                           .order_id_ = new_market_order_id,
@@ -163,15 +199,36 @@ void ExchangeOrderBook::Add(common::ClientId client_id, common::OrderId client_o
     }
 }
 
+auto ExchangeOrderBook::CancelOrder(ExchangeOrder *order) noexcept {
+    client_response_ = {.type_ = ClientResponseType::CANCELED,
+                        .client_id_ = order->client_id_,
+                        .ticker_id_ = ticker_id_,
+                        .client_order_id_ = order->client_order_id_,
+                        .market_order_id_ = order->market_order_id_,
+                        .side_ = order->side_,
+                        .price_ = order->price_,
+                        .exec_qty_ = common::QTY_INVALID,
+                        .leaves_qty_ = order->qty_};
+    market_update_ = {.type_ = MarketUpdateType::CANCEL,
+                      .order_id_ = order->market_order_id_,
+                      .ticker_id_ = ticker_id_,
+                      .side_ = order->side_,
+                      .price_ = order->price_,
+                      .qty_ = 0,
+                      .priority_ = order->priority_};
+
+    START_MEASURE(exchange_me_order_book_remove_order);
+    RemoveOrder(order);
+    END_MEASURE(exchange_me_order_book_remove_order);
+
+    matching_engine_->SendMarketUpdate(&market_update_);
+    matching_engine_->SendClientResponse(&client_response_);
+}
+
 void ExchangeOrderBook::Cancel(common::ClientId client_id, common::OrderId order_id,
                                common::TickerId ticker_id) noexcept {
-    auto is_cancelable = (client_id < cid_oid_to_order_.size());
-    ExchangeOrder *exchange_order = nullptr;
-    if (is_cancelable) [[likely]] {
-        auto &co_itr = cid_oid_to_order_.at(client_id);
-        exchange_order = co_itr.at(order_id);
-        is_cancelable = (exchange_order != nullptr);
-    }
+    auto exchange_order = cid_oid_to_order_.Find(client_id, order_id);
+    const auto is_cancelable = (exchange_order != nullptr);
 
     if (!is_cancelable) [[unlikely]] {
         client_response_ = {.type_ = ClientResponseType::CANCEL_REJECTED,
@@ -183,32 +240,170 @@ void ExchangeOrderBook::Cancel(common::ClientId client_id, common::OrderId order
                             .price_ = common::PRICE_INVALID,
                             .exec_qty_ = common::QTY_INVALID,
                             .leaves_qty_ = common::QTY_INVALID};
-    } else {
-        client_response_ = {.type_ = ClientResponseType::CANCELED,
+        matching_engine_->SendClientResponse(&client_response_);
+        return;
+    }
+
+    CancelOrder(exchange_order);
+}
+
+void ExchangeOrderBook::MassCancel(common::ClientId client_id, common::Side side) noexcept {
+    if (client_id >= cid_side_orders_.size()) [[unlikely]] {
+        return;  // no such client, so no orders of it either.
+    }
+
+    for (const auto cancel_side : {common::Side::BUY, common::Side::SELL}) {
+        if (side != common::Side::INVALID && side != cancel_side) {
+            continue;
+        }
+
+        // Removing the first order of the list makes the next one the first.
+        const auto &first_order = cid_side_orders_[client_id][common::SideToIndex(cancel_side)];
+        while (first_order != nullptr) {
+            CancelOrder(first_order);
+        }
+    }
+}
+
+void ExchangeOrderBook::Modify(common::ClientId client_id, common::OrderId order_id, common::TickerId ticker_id,
+                               common::Price price, common::Qty qty) noexcept {
+    auto exchange_order = cid_oid_to_order_.Find(client_id, order_id);
+    const auto is_modifiable = (exchange_order != nullptr && qty != 0 &&
+                                (price == exchange_order->price_ || price_ladder_.CanHold(price)));
+
+    if (!is_modifiable) [[unlikely]] {
+        // A reject of an order that is still live carries the order as it is, so the client can tell it is not gone.
+        const auto is_live = (exchange_order != nullptr);
+        client_response_ = {.type_ = ClientResponseType::MODIFY_REJECTED,
                             .client_id_ = client_id,
                             .ticker_id_ = ticker_id,
                             .client_order_id_ = order_id,
-                            .market_order_id_ = exchange_order->market_order_id_,
-                            .side_ = exchange_order->side_,
-                            .price_ = exchange_order->price_,
+                            .market_order_id_ = is_live ? exchange_order->market_order_id_ : common::ORDER_ID_INVALID,
+                            .side_ = is_live ? exchange_order->side_ : common::Side::INVALID,
+                            .price_ = is_live ? exchange_order->price_ : common::PRICE_INVALID,
                             .exec_qty_ = common::QTY_INVALID,
-                            .leaves_qty_ = exchange_order->qty_};
-        market_update_ = {.type_ = MarketUpdateType::CANCEL,
-                          .order_id_ = exchange_order->market_order_id_,
-                          .ticker_id_ = ticker_id,
-                          .side_ = exchange_order->side_,
-                          .price_ = exchange_order->price_,
-                          .qty_ = 0,
-                          .priority_ = exchange_order->priority_};
+                            .leaves_qty_ = is_live ? exchange_order->qty_ : common::QTY_INVALID};
+        matching_engine_->SendClientResponse(&client_response_);
+        return;
+    }
 
+    client_response_ = {.type_ = ClientResponseType::MODIFIED,
+                        .client_id_ = client_id,
+                        .ticker_id_ = ticker_id,
+                        .client_order_id_ = order_id,
+                        .market_order_id_ = exchange_order->market_order_id_,
+                        .side_ = exchange_order->side_,
+                        .price_ = price,
+                        .exec_qty_ = 0,
+                        .leaves_qty_ = qty};
+    matching_engine_->SendClientResponse(&client_response_);
+
+    if (price == exchange_order->price_ && qty <= exchange_order->qty_) {
+        GetOrdersAtPrice(price)->total_qty_ -= (exchange_order->qty_ - qty);
+        exchange_order->qty_ = qty;
+    } else {
         START_MEASURE(exchange_me_order_book_remove_order);
-        RemoveOrder(exchange_order);
-        END_MEASURE(exchange_me_order_book_remove_order, (*logger_));
+        DetachOrder(exchange_order);
+        END_MEASURE(exchange_me_order_book_remove_order);
+
+        START_MEASURE(exchange_me_order_book_check_for_match);
+        const auto leaves_qty = CheckForMatch(client_id, order_id, ticker_id, exchange_order->side_, price, qty,
+                                              exchange_order->market_order_id_, TimeInForce::GTC);
+        END_MEASURE(exchange_me_order_book_check_for_match);
+
+        if (leaves_qty == 0) [[unlikely]] {
+            // Fully executed on arrival at the new price, remove it from the price level it was last published at.
+            market_update_ = {.type_ = MarketUpdateType::CANCEL,
+                              .order_id_ = exchange_order->market_order_id_,
+                              .ticker_id_ = ticker_id,
+                              .side_ = exchange_order->side_,
+                              .price_ = exchange_order->price_,
+                              .qty_ = 0,
+                              .priority_ = exchange_order->priority_};
+
+            ReleaseOrder(exchange_order);
+
+            matching_engine_->SendMarketUpdate(&market_update_);
+            return;
+        }
+
+        exchange_order->price_ = price;
+        exchange_order->qty_ = leaves_qty;
+        exchange_order->priority_ = GetNextPriority(price);
+
+        START_MEASURE(exchange_me_order_book_add_order);
+        AddOrder(exchange_order);
+        END_MEASURE(exchange_me_order_book_add_order);
+    }
+
+    market_update_ = {.type_ = MarketUpdateType::MODIFY,
+                      .order_id_ = exchange_order->market_order_id_,
+                      .ticker_id_ = ticker_id,
+                      .side_ = exchange_order->side_,
+                      .price_ = exchange_order->price_,
+                      .qty_ = exchange_order->qty_,
+                      .priority_ = exchange_order->priority_};
+    matching_engine_->SendMarketUpdate(&market_update_);
+}
+
+void ExchangeOrderBook::WriteCheckpoint(std::vector<char> *checkpoint) const noexcept {
+    const auto append = [checkpoint](const auto &value) {
+        const auto bytes = reinterpret_cast<const char *>(&value);
+        checkpoint->insert(checkpoint->end(), bytes, bytes + sizeof(value));
+    };
+
+    BookCheckpointHeader book_header{.ticker_id_ = ticker_id_,
+                                     .next_market_order_id_ = next_market_order_id_,
+                                     .num_orders_ = 0};
+    ForEachOrdersAtPrice(
+        [&](const OrdersAtPrice *orders_at_price) { book_header.num_orders_ += orders_at_price->num_orders_; });
+    append(book_header);
+
+    ForEachOrdersAtPrice([&](const OrdersAtPrice *orders_at_price) {
+        auto order = orders_at_price->first_order_;
+        do {
+            const OrderCheckpoint order_checkpoint{.client_id_ = order->client_id_,
+                                                   .client_order_id_ = order->client_order_id_,
+                                                   .market_order_id_ = order->market_order_id_,
+                                                   .side_ = order->side_,
+                                                   .price_ = order->price_,
+                                                   .qty_ = order->qty_,
+                                                   .priority_ = order->priority_};
+            append(order_checkpoint);
+            order = order->next_order_;
+        } while (order != orders_at_price->first_order_);
+    });
+}
 
+auto ExchangeOrderBook::RestoreCheckpoint(const char *data) noexcept -> const char * {
+    ASSERT(cid_oid_to_order_.Size() == 0, "Restoring a checkpoint into a non-empty order book.");
+
+    const auto book_header = reinterpret_cast<const BookCheckpointHeader *>(data);
+    if (book_header->ticker_id_ != ticker_id_) [[unlikely]] {
+        FATAL("Checkpoint of ticker:" + common::TickerIdToString(book_header->ticker_id_) +
+              " restored into order book of ticker:" + common::TickerIdToString(ticker_id_));
+    }
+    next_market_order_id_ = book_header->next_market_order_id_;
+
+    auto order_checkpoint = reinterpret_cast<const OrderCheckpoint *>(data + sizeof(BookCheckpointHeader));
+    for (size_t i = 0; i < book_header->num_orders_; ++i, ++order_checkpoint) {
+        auto order = order_pool_.Allocate(ticker_id_, order_checkpoint->client_id_, order_checkpoint->client_order_id_,
+                                          order_checkpoint->market_order_id_, order_checkpoint->side_,
+                                          order_checkpoint->price_, order_checkpoint->qty_,
+                                          order_checkpoint->priority_, nullptr, nullptr);
+        AddOrder(order);
+
+        market_update_ = {.type_ = MarketUpdateType::ADD,
+                          .order_id_ = order->market_order_id_,
+                          .ticker_id_ = ticker_id_,
+                          .side_ = order->side_,
+                          .price_ = order->price_,
+                          .qty_ = order->qty_,
+                          .priority_ = order->priority_};
         matching_engine_->SendMarketUpdate(&market_update_);
     }
 
-    matching_engine_->SendClientResponse(&client_response_);
+    return reinterpret_cast<const char *>(order_checkpoint);
 }
 
 auto ExchangeOrderBook::ToString(bool detailed, bool validity_check) const -> std::string {
@@ -217,20 +412,10 @@ auto ExchangeOrderBook::ToString(bool detailed, bool validity_check) const -> st
     auto printer = [&](std::stringstream &ss, OrdersAtPrice *itr, common::Side side, common::Price &last_price,
                        bool sanity_check) {
         char buf[4096];
-        common::Qty qty = 0;
-        size_t num_orders = 0;
-
-        for (auto o_itr = itr->first_order_;; o_itr = o_itr->next_order_) {
-            qty += o_itr->qty_;
-            ++num_orders;
-            if (o_itr->next_order_ == itr->first_order_) {
-                break;
-            }
-        }
         sprintf(buf, " <px:%3s p:%3s n:%3s> %-3s @ %-5s(%-4s)", common::PriceToString(itr->price_).c_str(),
                 common::PriceToString(itr->prev_entry_->price_).c_str(),
                 common::PriceToString(itr->next_entry_->price_).c_str(), common::PriceToString(itr->price_).c_str(),
-                common::QtyToString(qty).c_str(), std::to_string(num_orders).c_str());
+                common::QtyToString(itr->total_qty_).c_str(), std::to_string(itr->num_orders_).c_str());
         ss << buf;
         for (auto o_itr = itr->first_order_;; o_itr = o_itr->next_order_) {
             if (detailed) {
@@ -252,6 +437,20 @@ auto ExchangeOrderBook::ToString(bool detailed, bool validity_check) const -> st
         ss << std::endl;  // NOLINT
 
         if (sanity_check) {
+            common::Qty qty = 0;
+            size_t num_orders = 0;
+            for (auto o_itr = itr->first_order_;; o_itr = o_itr->next_order_) {
+                qty += o_itr->qty_;
+                ++num_orders;
+                if (o_itr->next_order_ == itr->first_order_) {
+                    break;
+                }
+            }
+            if (qty != itr->total_qty_ || num_orders != itr->num_orders_) {
+                FATAL("Level aggregates do not match its orders qty:" + common::QtyToString(qty) +
+                      " orders:" + std::to_string(num_orders) + " itr:" + itr->ToString());
+            }
+
             if ((side == common::Side::SELL && last_price >= itr->price_) ||
                 (side == common::Side::BUY && last_price <= itr->price_)) {
                 FATAL("Bids/Asks not sorted by ascending/descending prices last:" + common::PriceToString(last_price) +
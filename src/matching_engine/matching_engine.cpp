@@ -1,25 +1,46 @@
 #include "matching_engine/matching_engine.hpp"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
 namespace exchange {
 
-MatchingEngine::MatchingEngine(ClientRequestLFQueue *client_requests, ClientResponseLFQueue *client_responses,
-                               MEMarketUpdateLFQueue *market_updates)
-    : incoming_requests_(client_requests),
-      outgoing_ogw_responses_(client_responses),
-      outgoing_md_updates_(market_updates),
-      logger_("exchange_matching_engine.log") {
+MatchingEngine::MatchingEngine(size_t shard_id, int core_id, ShardChannels *shard_channels,
+                               common::WaitPolicy wait_policy)
+    : SHARD_ID(shard_id),
+      CORE_ID(core_id),
+      THREAD_NAME("exchange/MatchingEngine/" + std::to_string(shard_id)),
+      CHECKPOINT_FILE("exchange_matching_engine_" + std::to_string(shard_id) + ".checkpoint"),
+      shard_channels_(shard_channels),
+      incoming_requests_(&shard_channels->Shard(shard_id)->requests_),
+      outgoing_ogw_responses_(&shard_channels->Shard(shard_id)->client_responses_),
+      outgoing_md_updates_(&shard_channels->Shard(shard_id)->market_updates_),
+      done_seq_num_(&shard_channels->Shard(shard_id)->done_seq_num_),
+      wait_strategy_(common::GetThreadConfig(THREAD_NAME, core_id).WaitPolicyOr(wait_policy)),
+      logger_("exchange_matching_engine_" + std::to_string(shard_id) + ".log") {
+    // The order books are built here but used by the matching engine thread, so place them on the NUMA node of that
+    // thread rather than on the one of the constructing thread.
+    common::MemoryNodeScope memory_node_scope(common::GetThreadConfig(THREAD_NAME, core_id).MemoryNode());
     for (size_t i = 0; i < ticker_order_book_.size(); ++i) {
-        ticker_order_book_[i] = new ExchangeOrderBook(i, &logger_, this);
+        ticker_order_book_[i] =
+            (shard_channels->ShardIdForTicker(i) == shard_id ? new ExchangeOrderBook(i, &logger_, this) : nullptr);
     }
+    shard_channels->Shard(shard_id)->doorbell_ = wait_strategy_.GetDoorbell();
 }
 
 MatchingEngine::~MatchingEngine() {
-    run_ = false;
-
-    using namespace std::literals::chrono_literals;
-    std::this_thread::sleep_for(1s);
+    Stop();
 
+    shard_channels_ = nullptr;
     incoming_requests_ = nullptr;
+    done_seq_num_ = nullptr;
     outgoing_ogw_responses_ = nullptr;
     outgoing_md_updates_ = nullptr;
 
@@ -30,11 +51,150 @@ MatchingEngine::~MatchingEngine() {
 }
 
 void MatchingEngine::Start() {
-    run_ = true;
-    ASSERT(common::CreateAndStartThread(-1, "exchange/MatchingEngine", [this]() { Run(); }) != nullptr,
-           "Failed to start MatchingEngine thread.");
+    checkpoint_thread_ = common::CreateAndStartThread(
+        -1, "exchange/CheckpointWriter/" + std::to_string(SHARD_ID),
+        [this](std::stop_token stop_token) { RunCheckpointWriter(stop_token); });
+    ASSERT(checkpoint_thread_ != nullptr, "Failed to start CheckpointWriter thread.");
+
+    thread_ =
+        common::CreateAndStartThread(CORE_ID, THREAD_NAME, [this](std::stop_token stop_token) { Run(stop_token); });
+    ASSERT(thread_ != nullptr, "Failed to start MatchingEngine thread.");
+}
+
+void MatchingEngine::Stop() {
+    thread_ = nullptr;
+    checkpoint_thread_ = nullptr;
+}
+
+auto MatchingEngine::WriteCheckpoint(size_t journal_position) noexcept -> bool {
+    if (checkpoint_pending_.load(std::memory_order_acquire)) [[unlikely]] {
+        logger_.Log("%:% %() % Skipping checkpoint at journal position:%, the previous one is still being written.\n",
+                    __FILE__, __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_), journal_position);
+        return false;
+    }
+
+    START_MEASURE(exchange_me_write_checkpoint);
+    CheckpointHeader header{.journal_position_ = journal_position, .num_books_ = 0};
+    for (const auto order_book : ticker_order_book_) {
+        header.num_books_ += (order_book != nullptr);
+    }
+    const auto header_bytes = reinterpret_cast<const char *>(&header);
+    checkpoint_.assign(header_bytes, header_bytes + sizeof(header));
+    for (const auto order_book : ticker_order_book_) {
+        if (order_book != nullptr) {
+            order_book->WriteCheckpoint(&checkpoint_);
+        }
+    }
+    {
+        const std::lock_guard lock(checkpoint_mutex_);
+        checkpoint_pending_.store(true, std::memory_order_release);
+    }
+    checkpoint_cv_.notify_one();
+    END_MEASURE(exchange_me_write_checkpoint);
+
+    logger_.Log("%:% %() % Checkpoint at journal position:% of % bytes handed to the checkpoint thread.\n", __FILE__,
+                __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_), journal_position, checkpoint_.size());
+    return true;
+}
+
+void MatchingEngine::RunCheckpointWriter(std::stop_token stop_token) noexcept {
+    while (!stop_token.stop_requested()) {
+        bool checkpoint_pending = false;
+        {
+            std::unique_lock lock(checkpoint_mutex_);
+            checkpoint_pending = checkpoint_cv_.wait_for(lock, stop_token, SPARE_CHUNK_POLL_INTERVAL, [this] {
+                return checkpoint_pending_.load(std::memory_order_acquire);
+            });
+        }
+
+        for (const auto order_book : ticker_order_book_) {
+            if (order_book != nullptr) {
+                order_book->PrepareSpareChunks();
+            }
+        }
+
+        if (checkpoint_pending) {
+            if (!CommitCheckpoint()) {
+                std::cerr << "Failed to write checkpoint file:" << CHECKPOINT_FILE
+                          << " error:" << std::strerror(errno) << '\n';
+            }
+            checkpoint_pending_.store(false, std::memory_order_release);
+        }
+    }
+}
+
+auto MatchingEngine::CommitCheckpoint() const noexcept -> bool {
+    const auto tmp_file = CHECKPOINT_FILE + ".tmp";
+    auto file = std::fopen(tmp_file.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+
+    auto ok = (std::fwrite(checkpoint_.data(), 1, checkpoint_.size(), file) == checkpoint_.size());
+    ok = ok && (std::fflush(file) == 0) && (fsync(fileno(file)) == 0);
+    ok = (std::fclose(file) == 0) && ok;
+
+    // Replay resumes after the journal position of the checkpoint, so the journal has to hold every request up to it
+    // before the checkpoint can replace the previous one.
+    const auto journal = shard_channels_->journal_;
+    ok = ok && (journal == nullptr || journal->SyncToDisk());
+    ok = ok && (std::rename(tmp_file.c_str(), CHECKPOINT_FILE.c_str()) == 0);
+    return ok;
+}
+
+auto MatchingEngine::RestoreCheckpoint() noexcept -> bool {
+    const auto fd = open(CHECKPOINT_FILE.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) < sizeof(CheckpointHeader)) {
+        FATAL("Invalid checkpoint file:" + CHECKPOINT_FILE);
+    }
+    const auto file_size = static_cast<size_t>(file_stat.st_size);
+
+    // A single read-only mapping of the whole file; the orders are copied straight from it into the order books.
+    const auto mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        FATAL("Failed to map checkpoint file:" + CHECKPOINT_FILE + " error:" + std::string(std::strerror(errno)));
+    }
+    const auto data_begin = static_cast<const char *>(mapping);
+    const auto data_end = data_begin + file_size;
+
+    const auto header = reinterpret_cast<const CheckpointHeader *>(data_begin);
+    if (header->magic_ != CheckpointHeader::CHECKPOINT_MAGIC) {
+        FATAL("Invalid checkpoint file:" + CHECKPOINT_FILE);
+    }
+
+    auto data = data_begin + sizeof(CheckpointHeader);
+    for (size_t i = 0; i < header->num_books_; ++i) {
+        const auto book_header = reinterpret_cast<const BookCheckpointHeader *>(data);
+        if (data + sizeof(BookCheckpointHeader) > data_end ||
+            data + sizeof(BookCheckpointHeader) + book_header->num_orders_ * sizeof(OrderCheckpoint) > data_end) {
+            FATAL("Truncated checkpoint file:" + CHECKPOINT_FILE);
+        }
+
+        const auto ticker_id = book_header->ticker_id_;
+        if (ticker_id >= ticker_order_book_.size() || ticker_order_book_[ticker_id] == nullptr) {
+            FATAL("Checkpoint file:" + CHECKPOINT_FILE + " holds ticker:" + common::TickerIdToString(ticker_id) +
+                  " which shard:" + std::to_string(SHARD_ID) + " does not own.");
+        }
+        data = ticker_order_book_[ticker_id]->RestoreCheckpoint(data);
+    }
+    PublishOutputs();
+
+    shard_channels_->Shard(SHARD_ID)->restored_journal_position_ = header->journal_position_;
+
+    logger_.Log("%:% %() % Restored checkpoint:% at journal position:%\n", __FILE__, __LINE__, __FUNCTION__,
+                common::GetCurrentTimeStr(&time_str_), CHECKPOINT_FILE, header->journal_position_);
+
+    munmap(mapping, file_size);
+    close(fd);
+
+    return true;
 }
 
-void MatchingEngine::Stop() { run_ = false; }
+void MatchingEngine::DiscardCheckpoint() noexcept { std::remove(CHECKPOINT_FILE.c_str()); }
 
 }  // namespace exchange
@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#include "matching_engine/matching_engine.hpp"
+#include "order_gateway/request_journal.hpp"
+
+namespace {
+
+// Price around which the synthetic books are built.
+constexpr common::Price MID_PRICE = 10000;
+
+// Orders resting at every price level of the initial synthetic books.
+constexpr size_t ORDERS_PER_LEVEL = 4;
+
+// Number of clients the synthetic orders are spread over.
+constexpr common::ClientId NUM_CLIENTS = 16;
+
+// Requests are reported under their type, and NEW requests that traded are reported apart from the ones that only
+// rested, since matching is a different code path.
+enum class RequestKind : size_t { NEW = 0, NEW_MATCHED = 1, CANCEL = 2, MODIFY = 3, MASS_CANCEL = 4, MAX = 5 };
+
+constexpr const char *REQUEST_KIND_NAMES[] = {"NEW", "NEW_MATCHED", "CANCEL", "MODIFY", "MASS_CANCEL"};
+
+enum class PriceDistribution { UNIFORM, NORMAL };
+
+struct SyntheticCfg {
+    size_t num_requests_ = 1000 * 1000;
+
+    // Number of price levels on each side of the initial books. Passive orders are placed within this many ticks of
+    // MID_PRICE.
+    size_t book_depth_ = 64;
+
+    // Fractions of the requests that are cancels and that are marketable new orders. The remaining requests are new
+    // orders that rest in the book, except for a fixed share of modifies.
+    double cancel_ratio_ = 0.4;
+    double marketable_ratio_ = 0.1;
+
+    // Distribution of the distance of passive orders from MID_PRICE.
+    PriceDistribution price_distribution_ = PriceDistribution::UNIFORM;
+};
+
+// Share of the requests that modify a live order.
+constexpr double MODIFY_RATIO = 0.05;
+
+/*
+ * Generates a synthetic request stream over every ticker. The generator keeps track of the orders it created so that
+ * cancels and modifies target orders that were sent before; some of those will have traded already, which the matching
+ * engine rejects just as it would in production.
+ */
+class SyntheticStream final {
+   public:
+    explicit SyntheticStream(const SyntheticCfg &cfg) : cfg_(cfg), rng_(42) {}
+
+    // Orders that build the initial books, book_depth_ levels of ORDERS_PER_LEVEL orders on each side of every ticker.
+    auto InitialBook() -> std::vector<exchange::MEClientRequest> {
+        std::vector<exchange::MEClientRequest> requests;
+        for (common::TickerId ticker_id = 0; ticker_id < common::ME_MAX_TICKERS; ++ticker_id) {
+            for (size_t level = 1; level <= cfg_.book_depth_; ++level) {
+                for (size_t i = 0; i < ORDERS_PER_LEVEL; ++i) {
+                    const auto offset = static_cast<common::Price>(level);
+                    requests.push_back(NewOrder(ticker_id, common::Side::BUY, MID_PRICE - offset, RandomQty()));
+                    requests.push_back(NewOrder(ticker_id, common::Side::SELL, MID_PRICE + offset, RandomQty()));
+                }
+            }
+        }
+        return requests;
+    }
+
+    auto Requests() -> std::vector<exchange::MEClientRequest> {
+        std::vector<exchange::MEClientRequest> requests;
+        requests.reserve(cfg_.num_requests_);
+
+        std::uniform_real_distribution<double> kind_dist(0.0, 1.0);
+        while (requests.size() < cfg_.num_requests_) {
+            const auto ticker_id = static_cast<common::TickerId>(rng_() % common::ME_MAX_TICKERS);
+            const auto side = (rng_() % 2 ? common::Side::BUY : common::Side::SELL);
+            const auto kind = kind_dist(rng_);
+
+            if (kind < cfg_.cancel_ratio_ && !live_orders_.empty()) {
+                const auto order = TakeLiveOrder();
+                requests.push_back({.type_ = exchange::ClientRequestType::CANCEL,
+                                    .client_id_ = order.client_id_,
+                                    .ticker_id_ = order.ticker_id_,
+                                    .order_id_ = order.order_id_,
+                                    .side_ = common::Side::INVALID,
+                                    .price_ = common::PRICE_INVALID,
+                                    .qty_ = common::QTY_INVALID,
+                                    .time_in_force_ = exchange::TimeInForce::GTC});
+            } else if (kind < cfg_.cancel_ratio_ + MODIFY_RATIO && !live_orders_.empty()) {
+                const auto &order = live_orders_[rng_() % live_orders_.size()];
+                requests.push_back({.type_ = exchange::ClientRequestType::MODIFY,
+                                    .client_id_ = order.client_id_,
+                                    .ticker_id_ = order.ticker_id_,
+                                    .order_id_ = order.order_id_,
+                                    .side_ = order.side_,
+                                    .price_ = PassivePrice(order.side_),
+                                    .qty_ = RandomQty(),
+                                    .time_in_force_ = exchange::TimeInForce::GTC});
+            } else if (kind < cfg_.cancel_ratio_ + MODIFY_RATIO + cfg_.marketable_ratio_) {
+                // Crosses the spread by up to a few ticks, so it trades with one or a few levels.
+                const auto offset = static_cast<common::Price>(rng_() % 4);
+                requests.push_back(
+                    NewOrder(ticker_id, side, (side == common::Side::BUY ? MID_PRICE + offset : MID_PRICE - offset),
+                             RandomQty()));
+            } else {
+                requests.push_back(NewOrder(ticker_id, side, PassivePrice(side), RandomQty()));
+            }
+        }
+        return requests;
+    }
+
+   private:
+    struct LiveOrder {
+        common::ClientId client_id_ = common::CLIENT_ID_INVALID;
+        common::TickerId ticker_id_ = common::TICKER_ID_INVALID;
+        common::OrderId order_id_ = common::ORDER_ID_INVALID;
+        common::Side side_ = common::Side::INVALID;
+    };
+
+    const SyntheticCfg cfg_;
+    std::mt19937_64 rng_;
+
+    common::OrderId next_order_id_ = 1;
+    std::vector<LiveOrder> live_orders_;
+
+    auto RandomQty() -> common::Qty { return static_cast<common::Qty>(1 + rng_() % 100); }
+
+    auto PassivePrice(common::Side side) -> common::Price {
+        double distance = 0;
+        if (cfg_.price_distribution_ == PriceDistribution::UNIFORM) {
+            distance = std::uniform_real_distribution<double>(1.0, static_cast<double>(cfg_.book_depth_) + 1.0)(rng_);
+        } else {
+            distance = 1.0 + std::abs(std::normal_distribution<double>(0.0, cfg_.book_depth_ / 3.0)(rng_));
+        }
+        const auto offset =
+            std::min(static_cast<common::Price>(distance), static_cast<common::Price>(cfg_.book_depth_));
+        return (side == common::Side::BUY ? MID_PRICE - offset : MID_PRICE + offset);
+    }
+
+    auto NewOrder(common::TickerId ticker_id, common::Side side, common::Price price, common::Qty qty)
+        -> exchange::MEClientRequest {
+        const auto client_id = static_cast<common::ClientId>(rng_() % NUM_CLIENTS);
+        const auto order_id = next_order_id_++;
+        live_orders_.push_back(
+            {.client_id_ = client_id, .ticker_id_ = ticker_id, .order_id_ = order_id, .side_ = side});
+        return {.type_ = exchange::ClientRequestType::NEW,
+                .client_id_ = client_id,
+                .ticker_id_ = ticker_id,
+                .order_id_ = order_id,
+                .side_ = side,
+                .price_ = price,
+                .qty_ = qty,
+                .time_in_force_ = exchange::TimeInForce::GTC};
+    }
+
+    auto TakeLiveOrder() -> LiveOrder {
+        const auto index = rng_() % live_orders_.size();
+        const auto order = live_orders_[index];
+        live_orders_[index] = live_orders_.back();
+        live_orders_.pop_back();
+        return order;
+    }
+};
+
+/*
+ * Feeds requests straight into a single matching engine shard that owns every ticker, on the calling thread, and
+ * records the latency of each ProcessClientRequest() call. The shard outputs are drained after every request, outside
+ * of the measured time.
+ */
+class Benchmark final {
+   public:
+    Benchmark() : shard_channels_(1), matching_engine_(0, -1, &shard_channels_, common::WaitPolicy::BUSY_SPIN) {
+        for (auto &latencies : latencies_) {
+            latencies.reserve(1024 * 1024);
+        }
+    }
+
+    // Process requests without recording their latencies, e.g. to build the initial books.
+    auto Load(const std::vector<exchange::MEClientRequest> &requests) noexcept {
+        for (const auto &request : requests) {
+            matching_engine_.ProcessClientRequest(&request);
+            matching_engine_.PublishOutputs();
+            DrainOutputs();
+        }
+    }
+
+    auto Run(const exchange::MEClientRequest &request) noexcept {
+        const auto start = common::CycleCountStart();
+        matching_engine_.ProcessClientRequest(&request);
+        matching_engine_.PublishOutputs();
+        const auto end = common::CycleCountEnd();
+
+        const auto num_trades = DrainOutputs();
+        auto kind = RequestKind::MAX;
+        switch (request.type_) {
+            case exchange::ClientRequestType::NEW:
+                kind = (num_trades != 0 ? RequestKind::NEW_MATCHED : RequestKind::NEW);
+                break;
+            case exchange::ClientRequestType::CANCEL:
+                kind = RequestKind::CANCEL;
+                break;
+            case exchange::ClientRequestType::MODIFY:
+                kind = RequestKind::MODIFY;
+                break;
+            case exchange::ClientRequestType::MASS_CANCEL:
+                kind = RequestKind::MASS_CANCEL;
+                break;
+            case exchange::ClientRequestType::CHECKPOINT:
+            case exchange::ClientRequestType::INVALID:
+                return;
+        }
+        latencies_[static_cast<size_t>(kind)].push_back(common::CyclesToNanos(end - start));
+    }
+
+    auto Report() noexcept {
+        std::printf("%-12s %10s %14s %10s %10s %10s %10s\n", "request", "count", "ops/sec", "p50(ns)", "p99(ns)",
+                    "p99.9(ns)", "max(ns)");
+
+        common::Nanos total_nanos = 0;
+        size_t total_count = 0;
+        for (size_t kind = 0; kind < static_cast<size_t>(RequestKind::MAX); ++kind) {
+            auto &latencies = latencies_[kind];
+            if (latencies.empty()) {
+                continue;
+            }
+            std::sort(latencies.begin(), latencies.end());
+
+            common::Nanos nanos = 0;
+            for (const auto latency : latencies) {
+                nanos += latency;
+            }
+            total_nanos += nanos;
+            total_count += latencies.size();
+
+            std::printf("%-12s %10zu %14.0f %10ld %10ld %10ld %10ld\n", REQUEST_KIND_NAMES[kind], latencies.size(),
+                        OpsPerSec(latencies.size(), nanos), Percentile(latencies, 0.5), Percentile(latencies, 0.99),
+                        Percentile(latencies, 0.999), latencies.back());
+        }
+        std::printf("%-12s %10zu %14.0f\n", "ALL", total_count, OpsPerSec(total_count, total_nanos));
+    }
+
+   private:
+    exchange::ShardChannels shard_channels_;
+    exchange::MatchingEngine matching_engine_;
+
+    std::array<std::vector<common::Nanos>, static_cast<size_t>(RequestKind::MAX)> latencies_;
+
+    // Returns the number of trades published since the last call.
+    auto DrainOutputs() noexcept -> size_t {
+        auto shard = shard_channels_.Shard(0);
+        for (auto responses = shard->client_responses_.GetAllToRead(); !responses.empty();
+             responses = shard->client_responses_.GetAllToRead()) {
+            shard->client_responses_.UpdateReadIndex(responses.size());
+        }
+
+        size_t num_trades = 0;
+        for (auto updates = shard->market_updates_.GetAllToRead(); !updates.empty();
+             updates = shard->market_updates_.GetAllToRead()) {
+            for (const auto &update : updates) {
+                num_trades += (update.value_.type_ == exchange::MarketUpdateType::TRADE);
+            }
+            shard->market_updates_.UpdateReadIndex(updates.size());
+        }
+        return num_trades;
+    }
+
+    static auto Percentile(const std::vector<common::Nanos> &sorted_latencies, double percentile) -> common::Nanos {
+        const auto index = static_cast<size_t>(percentile * static_cast<double>(sorted_latencies.size()));
+        return sorted_latencies[std::min(index, sorted_latencies.size() - 1)];
+    }
+
+    static auto OpsPerSec(size_t count, common::Nanos nanos) -> double {
+        return (nanos != 0 ? static_cast<double>(count) * common::NANOS_TO_SECS / static_cast<double>(nanos) : 0.0);
+    }
+};
+
+auto StringToPriceDistribution(const std::string &str) -> PriceDistribution {
+    if (str == "NORMAL") {
+        return PriceDistribution::NORMAL;
+    }
+    if (str != "UNIFORM") {
+        FATAL("Unknown price distribution:" + str);
+    }
+    return PriceDistribution::UNIFORM;
+}
+
+}  // namespace
+
+// ./matching_engine_benchmark SYNTHETIC [NUM_REQUESTS [BOOK_DEPTH [CANCEL_RATIO [MARKETABLE_RATIO
+// [PRICE_DISTRIBUTION]]]]]
+// ./matching_engine_benchmark JOURNAL JOURNAL_FILE
+// Measures MatchingEngine::ProcessClientRequest() on a synthetic request stream, or on the requests recorded in a
+// request journal of exchange_main, and reports the throughput and latency percentiles per request type.
+// PRICE_DISTRIBUTION is UNIFORM or NORMAL and applies to the distance of passive orders from the mid price. The
+// measured latencies include the logging the matching engine does, as they do in production.
+auto main(int argc, char **argv) -> int {
+    const std::string mode = (argc > 1 ? argv[1] : "");
+    if (mode != "SYNTHETIC" && !(mode == "JOURNAL" && argc > 2)) {
+        FATAL(
+            "USAGE matching_engine_benchmark SYNTHETIC [NUM_REQUESTS [BOOK_DEPTH [CANCEL_RATIO [MARKETABLE_RATIO "
+            "[PRICE_DISTRIBUTION]]]]] | JOURNAL JOURNAL_FILE");
+    }
+
+    common::CalibrateCycleClock();
+    std::vector<exchange::MEClientRequest> requests;
+    Benchmark benchmark;
+
+    if (mode == "SYNTHETIC") {
+        SyntheticCfg cfg;
+        cfg.num_requests_ = (argc > 2 ? std::strtoul(argv[2], nullptr, 10) : cfg.num_requests_);
+        cfg.book_depth_ = (argc > 3 ? std::strtoul(argv[3], nullptr, 10) : cfg.book_depth_);
+        cfg.cancel_ratio_ = (argc > 4 ? std::atof(argv[4]) : cfg.cancel_ratio_);
+        cfg.marketable_ratio_ = (argc > 5 ? std::atof(argv[5]) : cfg.marketable_ratio_);
+        cfg.price_distribution_ = (argc > 6 ? StringToPriceDistribution(argv[6]) : cfg.price_distribution_);
+        if (cfg.book_depth_ == 0 || cfg.cancel_ratio_ < 0 || cfg.marketable_ratio_ < 0 ||
+            cfg.cancel_ratio_ + MODIFY_RATIO + cfg.marketable_ratio_ > 1.0) {
+            FATAL("BOOK_DEPTH must be positive and CANCEL_RATIO + MARKETABLE_RATIO must be within [0, " +
+                  std::to_string(1.0 - MODIFY_RATIO) + "]");
+        }
+
+        std::printf("SYNTHETIC requests:%zu depth:%zu cancel_ratio:%.3f marketable_ratio:%.3f distribution:%s\n",
+                    cfg.num_requests_, cfg.book_depth_, cfg.cancel_ratio_, cfg.marketable_ratio_,
+                    (cfg.price_distribution_ == PriceDistribution::UNIFORM ? "UNIFORM" : "NORMAL"));
+
+        SyntheticStream stream(cfg);
+        benchmark.Load(stream.InitialBook());
+        requests = stream.Requests();
+    } else {
+        const exchange::RequestJournal journal(argv[2], exchange::JournalOpenMode::READ_ONLY);
+        requests.reserve(journal.Size());
+        for (size_t i = 0; i < journal.Size(); ++i) {
+            requests.push_back(journal.At(i)->request_);
+        }
+        std::printf("JOURNAL file:%s requests:%zu\n", argv[2], requests.size());
+    }
+
+    for (const auto &request : requests) {
+        benchmark.Run(request);
+    }
+    benchmark.Report();
+
+    return 0;
+}
@@ -6,10 +6,23 @@ namespace common {
 
 // Add and remove socket file descriptors to and from the EPOLL list.
 auto TCPServer::AddToEpollList(TCPSocket *socket) {
-    epoll_event ev{.events = EPOLLET | EPOLLIN, .data = {reinterpret_cast<void *>(socket)}};
+    epoll_event ev{.events = EPOLLET | EPOLLIN | EPOLLRDHUP, .data = {reinterpret_cast<void *>(socket)}};
     return epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, socket->socket_fd_, &ev) == 0;
 }
 
+// Read whatever the peer sent before hanging up if receive is true, report the disconnect, then forget and close the
+// socket.
+void TCPServer::Disconnect(TCPSocket *socket, bool receive) noexcept {
+    socket->SendAndRecv(receive);
+    disconnect_callback_(socket, GetCurrentNanos());
+
+    std::erase(receive_sockets_, socket);
+    std::erase(send_sockets_, socket);
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, socket->socket_fd_, nullptr);
+    close(socket->socket_fd_);
+    delete socket;  // NOLINT
+}
+
 // Start listening for connections on the provided interface and port.
 void TCPServer::Listen(const std::string &iface, int port) {
     epoll_fd_ = epoll_create(1);
@@ -23,24 +36,27 @@ void TCPServer::Listen(const std::string &iface, int port) {
 }
 
 // Publish outgoing data from the send buffer and read incoming data from the receive buffer.
-void TCPServer::SendAndRecv() noexcept {
+auto TCPServer::SendAndRecv(bool receive) noexcept -> bool {
     auto recv = false;
 
-    std::ranges::for_each(receive_sockets_, [&recv](auto socket) { recv |= socket->SendAndRecv(); });
+    std::ranges::for_each(receive_sockets_, [&recv, receive](auto socket) { recv |= socket->SendAndRecv(receive); });
 
     if (recv) {  // There were some events and they have all been dispatched, inform listener.
         recv_finished_callback_();
     }
 
     std::ranges::for_each(send_sockets_, [](auto socket) { socket->SendAndRecv(); });
+
+    return recv;
 }
 
 // Check for new connections or dead connections and update containers that track the sockets.
-void TCPServer::Poll() noexcept {
+void TCPServer::Poll(bool receive) noexcept {
     const int max_events = 1 + send_sockets_.size() + receive_sockets_.size();
 
     const int n = epoll_wait(epoll_fd_, events_, max_events, 0);
     bool have_new_connection = false;
+    std::vector<TCPSocket *> disconnected_sockets;
     for (int i = 0; i < n; ++i) {
         const auto &event = events_[i];
         auto socket = reinterpret_cast<TCPSocket *>(event.data.ptr);
@@ -68,15 +84,19 @@ void TCPServer::Poll() noexcept {
             }
         }
 
-        if ((event.events & (EPOLLERR | EPOLLHUP)) != 0) {
-            logger_.Log("%:% %() % EPOLLERR socket:%\n", __FILE__, __LINE__, __FUNCTION__,
+        if ((event.events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) != 0 && socket != &listener_socket_) {
+            logger_.Log("%:% %() % EPOLLERR/EPOLLHUP socket:%\n", __FILE__, __LINE__, __FUNCTION__,
                         common::GetCurrentTimeStr(&time_str_), socket->socket_fd_);
-            if (std::ranges::find(receive_sockets_, socket) == std::ranges::end(receive_sockets_)) {
-                receive_sockets_.push_back(socket);
-            }
+            disconnected_sockets.push_back(socket);
         }
     }
 
+    // Prune dead connections once every event has been looked at, since deleting a socket invalidates its events.
+    if (!disconnected_sockets.empty()) [[unlikely]] {
+        std::ranges::for_each(disconnected_sockets, [this, receive](auto socket) { Disconnect(socket, receive); });
+        recv_finished_callback_();
+    }
+
     // Accept a new connection, create a TCPSocket and add it to our containers.
     while (have_new_connection) {
         logger_.Log("%:% %() % have_new_connection\n", __FILE__, __LINE__, __FUNCTION__,
@@ -1,5 +1,7 @@
 #include "network/tcp_socket.hpp"
 
+#include "common/perf_utils.hpp"
+
 namespace common {
 
 // Create TCPSocket with provided attributes to either listen-on / connect-to.
@@ -22,7 +24,7 @@ auto TCPSocket::Connect(const std::string &ip, const std::string &iface, int por
 
 // Called to publish outgoing data from the buffers as well as check for and callback if data is available in the read
 // buffers.
-auto TCPSocket::SendAndRecv() noexcept -> bool {
+auto TCPSocket::SendAndRecv(bool receive) noexcept -> bool {
     char ctrl[CMSG_SPACE(sizeof(struct timeval))];
     auto cmsg = reinterpret_cast<struct cmsghdr *>(&ctrl);
 
@@ -37,7 +39,7 @@ auto TCPSocket::SendAndRecv() noexcept -> bool {
                .msg_flags = 0};
 
     // Non-blocking call to read available data.
-    const auto read_size = recvmsg(socket_fd_, &msg, MSG_DONTWAIT);
+    const auto read_size = (receive ? recvmsg(socket_fd_, &msg, MSG_DONTWAIT) : 0);
     if (read_size > 0) {
         next_rcv_valid_index_ += read_size;
 
@@ -50,7 +52,7 @@ auto TCPSocket::SendAndRecv() noexcept -> bool {
                           time_kernel.tv_usec * NANOS_TO_MICROS;  // convert timestamp to nanoseconds.
         }
 
-        const auto user_time = GetCurrentNanos();
+        const auto user_time = GetCurrentNanos();  // the kernel time is read from the system clock, too.
 
         logger_.Log("%:% %() % read socket:% len:% utime:% ktime:% diff:%\n", __FILE__, __LINE__, __FUNCTION__,
                     GetCurrentTimeStr(&time_str_), socket_fd_, next_rcv_valid_index_, user_time, kernel_time,
@@ -1,5 +1,8 @@
 #include "order_gateway/gateway_client.hpp"
 
+#include <unistd.h>
+
+#include "common/latency_histogram.hpp"
 #include "common/perf_utils.hpp"
 
 namespace trading {
@@ -8,41 +11,91 @@ GatewayClient::GatewayClient(common::ClientId client_id, exchange::ClientRequest
                              exchange::ClientResponseLFQueue *client_responses,
                              std::string ip,            // NOLINT
                              const std::string &iface,  // NOLINT
-                             int port)
+                             int port, common::WaitPolicy wait_policy, common::Transport transport)
     : CLIENT_ID(client_id),
       ip_(ip),  // NOLINT
       IFACE(iface),
       PORT(port),
+      TRANSPORT(transport),
       outgoing_requests_(client_requests),
       incoming_responses_(client_responses),
+      wait_strategy_(common::GetThreadConfig(THREAD_NAME, -1).WaitPolicyOr(wait_policy)),
       logger_("trading_order_gateway_" + std::to_string(client_id) + ".log"),
       tcp_socket_(logger_) {
     tcp_socket_.recv_callback_ = [this](auto socket, auto rx_time) { RecvCallback(socket, rx_time); };
+    outgoing_requests_->SetDoorbell(wait_strategy_.GetDoorbell());
 }
 
 // Main thread loop - sends out client requests to the exchange and reads and dispatches incoming client responses.
-void GatewayClient::Run() noexcept {
+void GatewayClient::Run(std::stop_token stop_token) noexcept {
     logger_.Log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_));
-    while (run_) {
-        tcp_socket_.SendAndRecv();
-
-        for (auto client_request = outgoing_requests_->GetNextToRead(); client_request != nullptr;
-             client_request = outgoing_requests_->GetNextToRead()) {
-            TTT_MEASURE(t11_order_gateway_lf_queue_read, logger_);
-
-            logger_.Log("%:% %() % Sending cid:% seq:% %\n", __FILE__, __LINE__, __FUNCTION__,
-                        common::GetCurrentTimeStr(&time_str_), CLIENT_ID, next_outgoing_seq_num_,
-                        client_request->ToString());
-            START_MEASURE(trading_tcp_socket_send);
-            tcp_socket_.Send(&next_outgoing_seq_num_, sizeof(next_outgoing_seq_num_));
-            tcp_socket_.Send(client_request, sizeof(exchange::MEClientRequest));
-            END_MEASURE(trading_tcp_socket_send, logger_);
-            outgoing_requests_->UpdateReadIndex();
-            TTT_MEASURE(t12_order_gateway_tcp_write, logger_);
-
-            next_outgoing_seq_num_++;
+    stop_token_ = stop_token;
+    while (!stop_token.stop_requested()) {
+        auto idle = (TRANSPORT == common::Transport::SHM ? !RecvShm() : !tcp_socket_.SendAndRecv());
+        // Only checked once every response is read, as the exchange writes none after dropping the session.
+        if (TRANSPORT == common::Transport::SHM && idle &&
+            shm_session_->dropped_connects_.load(std::memory_order_acquire) == shm_connects_) [[unlikely]] {
+            logger_.Log("%:% %() % Shared memory session:% dropped by the exchange, which cancelled its orders.\n",
+                        __FILE__, __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_), shm_connects_);
+            ConnectShm();
+        }
+
+        auto session_full = false;
+        for (auto client_requests = outgoing_requests_->GetAllToRead(); !client_requests.empty() && !session_full;
+             client_requests = outgoing_requests_->GetAllToRead()) {
+            idle = false;
+            size_t num_sent = 0;
+            for (const auto &client_request : client_requests) {
+                TTT_MEASURE(t11_order_gateway_lf_queue_read, logger_);
+                if (!SendClientRequest(client_request)) [[unlikely]] {
+                    session_full = true;
+                    break;
+                }
+                TTT_MEASURE(t12_order_gateway_tcp_write, logger_);
+                ++num_sent;
+            }
+            outgoing_requests_->UpdateReadIndex(num_sent);
+        }
+        if (TRANSPORT == common::Transport::SHM) {
+            shm_requests_.PublishWriteIndex();
+        }
+
+        // Requests buffered above are only sent by the next SendAndRecv(), so the loop never waits right after them.
+        if (idle) {
+            wait_strategy_.Idle();
+        } else {
+            wait_strategy_.Reset();
+        }
+    }
+}
+
+auto GatewayClient::SendClientRequest(const exchange::MEClientRequest &client_request) noexcept -> bool {
+    exchange::OMClientRequest *shm_request = nullptr;
+    if (TRANSPORT == common::Transport::SHM) {
+        shm_request = shm_requests_.GetNextToWriteTo();
+        if (shm_request == nullptr) [[unlikely]] {  // the requests are sent once the exchange catches up.
+            return false;
         }
     }
+
+    logger_.Log("%:% %() % Sending cid:% seq:% %\n", __FILE__, __LINE__, __FUNCTION__,
+                common::GetCurrentTimeStr(&time_str_), CLIENT_ID, next_outgoing_seq_num_, client_request.ToString());
+    TRACE_HOP(client_request, GW_REQUEST_SEND);
+    if (shm_request != nullptr) {
+        START_MEASURE(trading_shm_session_send);
+        shm_request->seq_num_ = next_outgoing_seq_num_;
+        shm_request->me_client_request_ = client_request;
+        shm_requests_.AdvanceWriteIndex();
+        END_MEASURE(trading_shm_session_send);
+    } else {
+        START_MEASURE(trading_tcp_socket_send);
+        tcp_socket_.Send(&next_outgoing_seq_num_, sizeof(next_outgoing_seq_num_));
+        tcp_socket_.Send(&client_request, sizeof(exchange::MEClientRequest));
+        END_MEASURE(trading_tcp_socket_send);
+    }
+
+    next_outgoing_seq_num_++;
+    return true;
 }
 
 // Callback when an incoming client response is read, we perform some checks and forward it to the lock free queue
@@ -58,36 +111,113 @@ void GatewayClient::RecvCallback(common::TCPSocket *socket, common::Nanos rx_tim
         size_t i = 0;
         for (; i + sizeof(exchange::OMClientResponse) <= socket->next_rcv_valid_index_;
              i += sizeof(exchange::OMClientResponse)) {
-            auto response = reinterpret_cast<const exchange::OMClientResponse *>(socket->inbound_data_.data() + i);
-            logger_.Log("%:% %() % Received %\n", __FILE__, __LINE__, __FUNCTION__,
-                        common::GetCurrentTimeStr(&time_str_), response->ToString());
-
-            if (response->me_client_response_.client_id_ !=
-                CLIENT_ID) {  // this should never happen unless there is a bug at the exchange.
-                logger_.Log("%:% %() % ERROR Incorrect client id. ClientId expected:% received:%.\n", __FILE__,
-                            __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_), CLIENT_ID,
-                            response->me_client_response_.client_id_);
-                continue;
-            }
-            if (response->seq_num_ != next_exp_seq_num_) {  // this should never happen since we use a reliable TCP
-                                                            // protocol, unless there is a bug at the exchange.
-                logger_.Log("%:% %() % ERROR Incorrect sequence number. ClientId:%. SeqNum expected:% received:%.\n",
-                            __FILE__, __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_), CLIENT_ID,
-                            next_exp_seq_num_, response->seq_num_);
-                continue;
-            }
-
-            ++next_exp_seq_num_;
-
-            auto next_write = incoming_responses_->GetNextToWriteTo();
-            *next_write = response->me_client_response_;
-            incoming_responses_->UpdateWriteIndex();
-            TTT_MEASURE(t8t_order_gateway_lf_queue_write, logger_);
+            OnClientResponse(reinterpret_cast<const exchange::OMClientResponse *>(socket->inbound_data_.data() + i));
         }
+        incoming_responses_->PublishWriteIndex();
         memcpy(socket->inbound_data_.data(), socket->inbound_data_.data() + i, socket->next_rcv_valid_index_ - i);
         socket->next_rcv_valid_index_ -= i;
     }
-    END_MEASURE(trading_order_gateway_recv_callback, logger_);
+    END_MEASURE(trading_order_gateway_recv_callback);
+}
+
+auto GatewayClient::RecvShm() noexcept -> bool {
+    auto response = shm_responses_.GetNextToRead();
+    if (response == nullptr) {
+        return false;
+    }
+
+    START_MEASURE(trading_order_gateway_recv_shm);
+    for (; response != nullptr; response = shm_responses_.GetNextToRead()) {
+        TTT_MEASURE(t7t_order_gateway_tcp_read, logger_);
+        OnClientResponse(response);
+        shm_responses_.UpdateReadIndex();
+    }
+    incoming_responses_->PublishWriteIndex();
+    END_MEASURE(trading_order_gateway_recv_shm);
+    return true;
+}
+
+void GatewayClient::OnClientResponse(const exchange::OMClientResponse *response) noexcept {
+    logger_.Log("%:% %() % Received %\n", __FILE__, __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_),
+                response->ToString());
+
+    if (response->me_client_response_.client_id_ !=
+        CLIENT_ID) {  // this should never happen unless there is a bug at the exchange.
+        logger_.Log("%:% %() % ERROR Incorrect client id. ClientId expected:% received:%.\n", __FILE__, __LINE__,
+                    __FUNCTION__, common::GetCurrentTimeStr(&time_str_), CLIENT_ID,
+                    response->me_client_response_.client_id_);
+        return;
+    }
+    if (response->seq_num_ != next_exp_seq_num_) {  // this should never happen since sessions are reliable, unless
+                                                    // there is a bug at the exchange.
+        logger_.Log("%:% %() % ERROR Incorrect sequence number. ClientId:%. SeqNum expected:% received:%.\n", __FILE__,
+                    __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_), CLIENT_ID, next_exp_seq_num_,
+                    response->seq_num_);
+        return;
+    }
+
+    ++next_exp_seq_num_;
+
+    auto next_write = incoming_responses_->GetNextToWriteTo(stop_token_);
+    if (next_write == nullptr) [[unlikely]] {
+        return;  // stopping, and the trade engine may not read any more responses.
+    }
+    *next_write = response->me_client_response_;
+    TRACE_HOP(*next_write, GW_RESPONSE_RECV);
+    incoming_responses_->AdvanceWriteIndex();
+    TTT_MEASURE(t8t_order_gateway_lf_queue_write, logger_);
+}
+
+// The rings of the session are created before it is registered, so the order server finds them once it sees it. The
+// rings of the previous session are removed, in case the client died before it could disconnect it, or the exchange
+// dropped it. A new session starts over at sequence number 1 both ways.
+void GatewayClient::ConnectShm() {
+    if (!shm_sessions_.Open(common::SHM_ORDER_SESSIONS) || shm_sessions_.Size() < sizeof(common::ShmSessionTable)) {
+        FATAL("Unable to open shared memory sessions:" + std::string(common::SHM_ORDER_SESSIONS) +
+              " error:" + std::string(std::strerror(errno)));
+    }
+    auto table = static_cast<common::ShmSessionTable *>(shm_sessions_.Data());
+    if (table->magic_.load(std::memory_order_acquire) != common::ShmSessionTable::MAGIC ||
+        CLIENT_ID >= common::ME_MAX_NUM_CLIENTS) {
+        FATAL("Unable to register shared memory session for ClientId:" + std::to_string(CLIENT_ID));
+    }
+
+    shm_session_ = &table->sessions_[CLIENT_ID];
+    const auto connects = shm_session_->connects_.load(std::memory_order_acquire) + 1;
+    common::SharedMemory::Unlink(common::ShmRequestRingName(CLIENT_ID, connects - 1));
+    common::SharedMemory::Unlink(common::ShmResponseRingName(CLIENT_ID, connects - 1));
+    const auto request_ring = common::ShmRequestRingName(CLIENT_ID, connects);
+    const auto response_ring = common::ShmResponseRingName(CLIENT_ID, connects);
+    if (!shm_requests_.Create(request_ring, common::ME_MAX_CLIENT_UPDATES) ||
+        !shm_responses_.Create(response_ring, common::ME_MAX_CLIENT_UPDATES)) {
+        FATAL("Unable to create shared memory session rings:" + request_ring + " " + response_ring +
+              " error:" + std::string(std::strerror(errno)));
+    }
+    shm_connects_ = connects;
+    next_outgoing_seq_num_ = 1;
+    next_exp_seq_num_ = 1;
+
+    shm_session_->pid_.store(getpid(), std::memory_order_release);
+    shm_session_->connects_.store(connects, std::memory_order_release);
+    shm_session_->connected_.store(true, std::memory_order_release);
+    table->changes_.fetch_add(1, std::memory_order_release);
+
+    logger_.Log("%:% %() % Connected shared memory session:% cid:%\n", __FILE__, __LINE__, __FUNCTION__,
+                common::GetCurrentTimeStr(&time_str_), connects, CLIENT_ID);
+}
+
+void GatewayClient::DisconnectShm() noexcept {
+    if (shm_session_ == nullptr) {
+        return;
+    }
+
+    shm_session_->connected_.store(false, std::memory_order_release);
+    static_cast<common::ShmSessionTable *>(shm_sessions_.Data())->changes_.fetch_add(1, std::memory_order_release);
+    shm_session_ = nullptr;
+
+    shm_requests_.Close();
+    shm_responses_.Close();
+    shm_sessions_.Close();
 }
 
 }  // namespace trading
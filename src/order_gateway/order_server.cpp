@@ -1,37 +1,184 @@
 #include "order_gateway/order_server.hpp"
 
+#include <signal.h>
+
 namespace exchange {
-OrderServer::OrderServer(ClientRequestLFQueue *client_requests, ClientResponseLFQueue *client_responses,
-                         const std::string &iface, int port)  // NOLINT
+OrderServer::OrderServer(ShardChannels *shard_channels, const std::string &iface, int port,  // NOLINT
+                         const std::string &journal_file, bool replay_journal, common::WaitPolicy wait_policy,
+                         common::Transport transport)
     : IFACE(iface),
       PORT(port),
-      outgoing_responses_(client_responses),
+      TRANSPORT(transport),
+      outgoing_responses_(shard_channels, &ShardChannel::client_responses_),
+      wait_strategy_(common::GetThreadConfig(THREAD_NAME, -1).WaitPolicyOr(wait_policy)),
       logger_("exchange_order_server.log"),
       tcp_server_(logger_),
-      fifo_sequencer_(client_requests, &logger_) {
+      fifo_sequencer_(shard_channels, &logger_, journal_file, replay_journal) {
     cid_next_outgoing_seq_num_.fill(1);
     cid_next_exp_seq_num_.fill(1);
     cid_tcp_socket_.fill(nullptr);
+    shm_client_ids_.reserve(common::ME_MAX_NUM_CLIENTS);
+    stalled_sockets_.reserve(common::ME_MAX_NUM_CLIENTS);
 
     tcp_server_.recv_callback_ = [this](auto socket, auto rx_time) { RecvCallback(socket, rx_time); };
     tcp_server_.recv_finished_callback_ = [this]() { RecvFinishedCallback(); };
+    tcp_server_.disconnect_callback_ = [this](auto socket, auto rx_time) { DisconnectCallback(socket, rx_time); };
 }
 
-OrderServer::~OrderServer() {
-    Stop();
-
-    using namespace std::literals::chrono_literals;
-    std::this_thread::sleep_for(1s);
-}
+OrderServer::~OrderServer() { Stop(); }
 
 void OrderServer::Start() {
-    run_ = true;
     tcp_server_.Listen(IFACE, PORT);
 
-    ASSERT(common::CreateAndStartThread(-1, "exchange/OrderServer", [this]() { Run(); }) != nullptr,
-           "Failed to start OrderServer thread.");
+    if (TRANSPORT == common::Transport::SHM) {
+        if (!shm_sessions_.Create(common::SHM_ORDER_SESSIONS, sizeof(common::ShmSessionTable))) {
+            FATAL("Unable to create shared memory sessions:" + std::string(common::SHM_ORDER_SESSIONS) +
+                  " error:" + std::string(std::strerror(errno)));
+        }
+        static_cast<common::ShmSessionTable *>(shm_sessions_.Data())
+            ->magic_.store(common::ShmSessionTable::MAGIC, std::memory_order_release);
+    }
+
+    thread_ = common::CreateAndStartThread(-1, THREAD_NAME, [this](std::stop_token stop_token) { Run(stop_token); });
+    ASSERT(thread_ != nullptr, "Failed to start OrderServer thread.");
+}
+
+void OrderServer::Stop() { thread_ = nullptr; }
+
+void OrderServer::ReplayJournal() noexcept {
+    fifo_sequencer_.ReplayJournal([this]() {
+        while (outgoing_responses_.GetNextToRead() != nullptr) {
+            outgoing_responses_.UpdateReadIndex();
+        }
+    });
+}
+
+auto OrderServer::PollShmSessions() noexcept -> bool {
+    auto table = static_cast<common::ShmSessionTable *>(shm_sessions_.Data());
+    auto changed = false;
+    const auto changes = table->changes_.load(std::memory_order_acquire);
+    if (changes != shm_sessions_changes_) [[unlikely]] {
+        shm_sessions_changes_ = changes;
+        for (common::ClientId client_id = 0; client_id < common::ME_MAX_NUM_CLIENTS; ++client_id) {
+            const auto &session = table->sessions_[client_id];
+            const auto connected = session.connected_.load(std::memory_order_acquire);
+            const auto connects = session.connects_.load(std::memory_order_acquire);
+            auto &rings = cid_shm_session_[client_id];
+            if (rings.requests_.IsOpen() && (!connected || connects != rings.connects_)) {
+                DisconnectShmSession(client_id, common::NowNanos());
+                changed = true;
+            }
+            if (connected && !rings.requests_.IsOpen() &&
+                connects != session.dropped_connects_.load(std::memory_order_acquire)) {
+                ConnectShmSession(client_id, connects);
+            }
+        }
+    }
+
+    const auto now = common::NowNanos();
+    if (now - shm_sessions_checked_at_ >= SHM_LIVENESS_INTERVAL) [[unlikely]] {
+        shm_sessions_checked_at_ = now;
+        // Backwards, as dropping a session removes it from shm_client_ids_.
+        for (auto i = shm_client_ids_.size(); i-- > 0;) {
+            const auto client_id = shm_client_ids_[i];
+            if (kill(table->sessions_[client_id].pid_.load(std::memory_order_acquire), 0) != 0 && errno == ESRCH) {
+                logger_.Log("%:% %() % ClientId:% of shared memory session:% is gone.\n", __FILE__, __LINE__,
+                            __FUNCTION__, common::GetCurrentTimeStr(&time_str_), client_id,
+                            cid_shm_session_[client_id].connects_);
+                DropShmSession(client_id, now);
+                changed = true;
+            }
+        }
+    }
+
+    // A request the sequencer has no room for stays in its ring, and is read again once the sequencer has room.
+    auto received = false;
+    auto sequencer_full = false;
+    for (const auto client_id : shm_client_ids_) {
+        auto &rings = cid_shm_session_[client_id];
+        for (auto request = rings.requests_.GetNextToRead(); request != nullptr;
+             request = rings.requests_.GetNextToRead()) {
+            TTT_MEASURE(t1_order_server_tcp_read, logger_);
+            received = true;
+            // Sequenced together with the receive times of TCP requests, which the kernel reads from the system clock.
+            const auto rx_time = common::GetCurrentNanos();
+            logger_.Log("%:% %() % Received %\n", __FILE__, __LINE__, __FUNCTION__,
+                        common::GetCurrentTimeStr(&time_str_), request->ToString());
+
+            auto &next_exp_seq_num = cid_next_exp_seq_num_[client_id];
+            if (request->me_client_request_.type_ == ClientRequestType::CHECKPOINT ||
+                request->me_client_request_.client_id_ != client_id) [[unlikely]] {
+                logger_.Log("%:% %() % Dropping request of another client or internal from ClientId:%\n", __FILE__,
+                            __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_), client_id);
+            } else if (request->seq_num_ != next_exp_seq_num) [[unlikely]] {
+                logger_.Log("%:% %() % Incorrect sequence number. ClientId:% SeqNum expected:% received:%\n", __FILE__,
+                            __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_), client_id,
+                            next_exp_seq_num, request->seq_num_);
+            } else {
+                START_MEASURE(exchange_fifo_sequencer_add_client_request);
+                sequencer_full = !fifo_sequencer_.AddClientRequest(rx_time, request->me_client_request_);
+                END_MEASURE(exchange_fifo_sequencer_add_client_request);
+                if (sequencer_full) [[unlikely]] {
+                    break;
+                }
+                ++next_exp_seq_num;
+            }
+            rings.requests_.UpdateReadIndex();
+        }
+        if (sequencer_full) [[unlikely]] {
+            break;
+        }
+    }
+
+    if (received || changed) {
+        RecvFinishedCallback();
+    }
+    return received;
+}
+
+void OrderServer::ConnectShmSession(common::ClientId client_id, uint64_t connects) noexcept {
+    if (cid_tcp_socket_[client_id] != nullptr) [[unlikely]] {
+        logger_.Log("%:% %() % Ignoring shared memory session:% of ClientId:% connected on socket:%\n", __FILE__,
+                    __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_), connects, client_id,
+                    cid_tcp_socket_[client_id]->socket_fd_);
+        return;
+    }
+
+    auto &rings = cid_shm_session_[client_id];
+    if (!rings.requests_.Open(common::ShmRequestRingName(client_id, connects)) ||
+        !rings.responses_.Open(common::ShmResponseRingName(client_id, connects))) {
+        // The client already went away again, or it is not a client of this exchange.
+        logger_.Log("%:% %() % Unable to open shared memory session:% of ClientId:% error:%\n", __FILE__, __LINE__,
+                    __FUNCTION__, common::GetCurrentTimeStr(&time_str_), connects, client_id, std::strerror(errno));
+        rings.requests_.Close();
+        rings.responses_.Close();
+        return;
+    }
+    rings.connects_ = connects;
+    shm_client_ids_.push_back(client_id);
+
+    logger_.Log("%:% %() % ClientId:% connected shared memory session:%\n", __FILE__, __LINE__, __FUNCTION__,
+                common::GetCurrentTimeStr(&time_str_), client_id, connects);
 }
 
-void OrderServer::Stop() { run_ = false; }
+void OrderServer::DropShmSession(common::ClientId client_id, common::Nanos rx_time) noexcept {
+    static_cast<common::ShmSessionTable *>(shm_sessions_.Data())
+        ->sessions_[client_id]
+        .dropped_connects_.store(cid_shm_session_[client_id].connects_, std::memory_order_release);
+    DisconnectShmSession(client_id, rx_time);
+}
+
+void OrderServer::DisconnectShmSession(common::ClientId client_id, common::Nanos rx_time) noexcept {
+    logger_.Log("%:% %() % ClientId:% disconnected shared memory session:%\n", __FILE__, __LINE__, __FUNCTION__,
+                common::GetCurrentTimeStr(&time_str_), client_id, cid_shm_session_[client_id].connects_);
+
+    MassCancel(client_id, rx_time);
+
+    std::erase(shm_client_ids_, client_id);
+    cid_shm_session_[client_id].requests_.Close();
+    cid_shm_session_[client_id].responses_.Close();
+    cid_next_exp_seq_num_[client_id] = 1;
+    cid_next_outgoing_seq_num_[client_id] = 1;
+}
 
 }  // namespace exchange
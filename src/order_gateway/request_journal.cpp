@@ -0,0 +1,132 @@
+#include "order_gateway/request_journal.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace exchange {
+
+RequestJournal::RequestJournal(const std::string &file_path, JournalOpenMode mode)
+    : FILE_PATH(file_path), READ_ONLY(mode == JournalOpenMode::READ_ONLY) {
+    const auto flags = (READ_ONLY ? O_RDONLY : O_RDWR | O_CREAT | (mode == JournalOpenMode::CREATE ? O_TRUNC : 0));
+    fd_ = open(FILE_PATH.c_str(), flags, 0644);
+    if (fd_ < 0) {
+        FATAL("Failed to open request journal:" + FILE_PATH + " error:" + std::string(std::strerror(errno)));
+    }
+
+    if (READ_ONLY) {
+        // The file is mapped as it is, however far it was allocated.
+        struct stat file_stat {};
+        if (fstat(fd_, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) < sizeof(JournalHeader)) {
+            FATAL("Invalid request journal:" + FILE_PATH);
+        }
+        mapping_size_ = static_cast<size_t>(file_stat.st_size);
+    } else {
+        mapping_size_ = sizeof(JournalHeader) + ME_JOURNAL_GROWTH_RECORDS * sizeof(JournalRecord);
+        Allocate();
+    }
+
+    auto mapping = mmap(nullptr, mapping_size_, (READ_ONLY ? PROT_READ : PROT_READ | PROT_WRITE), MAP_SHARED, fd_, 0);
+    if (mapping == MAP_FAILED) {
+        FATAL("Failed to map request journal:" + FILE_PATH + " error:" + std::string(std::strerror(errno)));
+    }
+    mapping_ = static_cast<char *>(mapping);
+    header_ = reinterpret_cast<JournalHeader *>(mapping_);
+    records_ = reinterpret_cast<JournalRecord *>(mapping_ + sizeof(JournalHeader));
+
+    if (READ_ONLY) {
+        if (header_->magic_ != JOURNAL_MAGIC || header_->record_size_ != sizeof(JournalRecord) ||
+            sizeof(JournalHeader) + header_->num_records_ * sizeof(JournalRecord) > mapping_size_) {
+            FATAL("Request journal:" + FILE_PATH + " has an incompatible format.");
+        }
+        next_record_index_ = synced_record_index_ = header_->num_records_;
+        return;
+    }
+
+    if (header_->magic_ == 0) {  // new journal.
+        *header_ = JournalHeader{.magic_ = JOURNAL_MAGIC,
+                                 .record_size_ = sizeof(JournalRecord),
+                                 .max_records_ = ME_JOURNAL_GROWTH_RECORDS,
+                                 .num_records_ = 0};
+    } else if (header_->magic_ != JOURNAL_MAGIC || header_->record_size_ != sizeof(JournalRecord) ||
+               header_->max_records_ < ME_JOURNAL_GROWTH_RECORDS || header_->num_records_ > header_->max_records_) {
+        FATAL("Request journal:" + FILE_PATH + " has an incompatible format.");
+    } else if (header_->max_records_ > ME_JOURNAL_GROWTH_RECORDS) {  // grown before.
+        Grow(header_->max_records_);
+    }
+
+    next_record_index_ = synced_record_index_ = header_->num_records_;
+    prefaulted_offset_ = (RecordsEndOffset() + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    PrefaultAhead();
+}
+
+RequestJournal::~RequestJournal() {
+    if (!READ_ONLY) {
+        Sync(true);
+    }
+
+    munmap(mapping_, mapping_size_);
+    close(fd_);
+
+    mapping_ = nullptr;
+    header_ = nullptr;
+    records_ = nullptr;
+}
+
+void RequestJournal::PrefaultAhead() noexcept {
+    // The pages ahead hold no records yet, so their contents do not matter; writing them makes the kernel set up a
+    // writable mapping for them now rather than on the next appends.
+    const auto target_offset = std::min(RecordsEndOffset() + PREFAULT_BYTES, mapping_size_);
+    for (; prefaulted_offset_ < target_offset; prefaulted_offset_ += PAGE_SIZE) {
+        *static_cast<volatile char *>(mapping_ + prefaulted_offset_) = 0;
+    }
+}
+
+void RequestJournal::Sync(bool wait) noexcept {
+    // msync() wants a page aligned start, and the header changes with every commit.
+    const auto end_offset = RecordsEndOffset();
+    const auto start_offset = sizeof(JournalHeader) + synced_record_index_ * sizeof(JournalRecord);
+    msync(mapping_, PAGE_SIZE, wait ? MS_SYNC : MS_ASYNC);
+    if (end_offset > start_offset) {
+        const auto aligned_start_offset = start_offset / PAGE_SIZE * PAGE_SIZE;
+        msync(mapping_ + aligned_start_offset, end_offset - aligned_start_offset, wait ? MS_SYNC : MS_ASYNC);
+    }
+    synced_record_index_ = next_record_index_;
+}
+
+auto RequestJournal::SyncToDisk() const noexcept -> bool {
+    // Unlike msync() of the mapping, which Grow() may move meanwhile, syncing the file covers the pages written through
+    // the mapping and only needs fd_.
+    return (fdatasync(fd_) == 0);
+}
+
+void RequestJournal::Grow(size_t max_records) noexcept {
+    const auto mapping_size = sizeof(JournalHeader) + max_records * sizeof(JournalRecord);
+    const auto old_mapping_size = mapping_size_;
+    mapping_size_ = mapping_size;
+    Allocate();
+
+    auto mapping = mremap(mapping_, old_mapping_size, mapping_size, MREMAP_MAYMOVE);
+    if (mapping == MAP_FAILED) {
+        FATAL("Failed to grow the mapping of request journal:" + FILE_PATH +
+              " error:" + std::string(std::strerror(errno)));
+    }
+    mapping_ = static_cast<char *>(mapping);
+    header_ = reinterpret_cast<JournalHeader *>(mapping_);
+    records_ = reinterpret_cast<JournalRecord *>(mapping_ + sizeof(JournalHeader));
+    header_->max_records_ = max_records;
+}
+
+void RequestJournal::Allocate() noexcept {
+    const auto err = posix_fallocate(fd_, 0, static_cast<off_t>(mapping_size_));
+    if (err != 0) {
+        FATAL("Failed to allocate request journal:" + FILE_PATH + " error:" + std::string(std::strerror(err)));
+    }
+}
+
+}  // namespace exchange
@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "common/integrity.hpp"
+#include "common/trace.hpp"
+
+namespace {
+
+constexpr auto NUM_HOPS = static_cast<size_t>(common::TraceHop::MAX);
+
+// A trace as logged by the trade engine: what the message was and when it passed each hop.
+struct Trace {
+    std::string description_;
+    std::array<common::Nanos, NUM_HOPS> hops_ = {};
+};
+
+// Parses "... TRACE <description> hops:<t0>,<t1>,...", returns false for every other line.
+auto ParseTrace(const std::string &line, Trace *trace) -> bool {
+    const auto start = line.find(" TRACE ");
+    const auto hops = line.find(" hops:", start);
+    if (start == std::string::npos || hops == std::string::npos) {
+        return false;
+    }
+
+    trace->description_ = line.substr(start + 7, hops - start - 7);
+    const char *pos = line.c_str() + hops + 6;
+    for (size_t i = 0; i < NUM_HOPS; ++i) {
+        char *end = nullptr;
+        trace->hops_[i] = std::strtoll(pos, &end, 10);
+        if (end == pos) {
+            return false;
+        }
+        pos = (*end == ',' ? end + 1 : end);
+    }
+    return true;
+}
+
+auto Percentile(const std::vector<common::Nanos> &sorted_latencies, double percentile) -> common::Nanos {
+    const auto index = static_cast<size_t>(percentile * static_cast<double>(sorted_latencies.size()));
+    return sorted_latencies[std::min(index, sorted_latencies.size() - 1)];
+}
+
+}  // namespace
+
+// ./trace_report TRADING_ENGINE_LOG...
+// Breaks down the tick-to-trade traces logged by trading engines built with VOTS_TRACING hop by hop. Prints, for every
+// response and market update that traces back to a request of the client, how long it took to get from each hop it
+// passed to the next one, followed by latency percentiles per hop over all of them. Hops are timed with NowNanos() in
+// the process they happen in, so hops in different processes only compare as well as the clocks of the processes are
+// calibrated and anchored to the system clock.
+auto main(int argc, char **argv) -> int {
+    if (argc < 2) {
+        FATAL("USAGE trace_report TRADING_ENGINE_LOG...");
+    }
+
+    // Latencies of getting to each hop from the one the message passed before it, and from the origin of the trace.
+    std::array<std::vector<common::Nanos>, NUM_HOPS> hop_latencies;
+    std::array<std::vector<common::Nanos>, NUM_HOPS> total_latencies;
+
+    for (auto i = 1; i < argc; ++i) {
+        std::ifstream file(argv[i]);
+        if (!file) {
+            FATAL("Unable to open log:" + std::string(argv[i]));
+        }
+
+        std::string line;
+        Trace trace;
+        while (std::getline(file, line)) {
+            if (!ParseTrace(line, &trace)) {
+                continue;
+            }
+
+            std::printf("%s\n", trace.description_.c_str());
+            size_t previous = 0;
+            for (size_t hop = 1; hop < NUM_HOPS; ++hop) {
+                if (trace.hops_[hop] == 0) {
+                    continue;
+                }
+                const auto latency = trace.hops_[hop] - trace.hops_[previous];
+                const auto total = trace.hops_[hop] - trace.hops_[0];
+                std::printf("    %-24s %+12ld %12ld\n",
+                            common::TraceHopToString(static_cast<common::TraceHop>(hop)).c_str(), latency, total);
+                hop_latencies[hop].push_back(latency);
+                total_latencies[hop].push_back(total);
+                previous = hop;
+            }
+        }
+    }
+
+    std::printf("\n%-24s %10s %10s %10s %10s %12s %12s\n", "hop", "count", "p50(ns)", "p90(ns)", "p99(ns)", "max(ns)",
+                "p50 total(ns)");
+    for (size_t hop = 1; hop < NUM_HOPS; ++hop) {
+        auto &latencies = hop_latencies[hop];
+        auto &totals = total_latencies[hop];
+        if (latencies.empty()) {
+            continue;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        std::sort(totals.begin(), totals.end());
+        std::printf("%-24s %10zu %10ld %10ld %10ld %12ld %12ld\n",
+                    common::TraceHopToString(static_cast<common::TraceHop>(hop)).c_str(), latencies.size(),
+                    Percentile(latencies, 0.5), Percentile(latencies, 0.9), Percentile(latencies, 0.99),
+                    latencies.back(), Percentile(totals, 0.5));
+    }
+
+    return 0;
+}
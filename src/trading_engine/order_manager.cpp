@@ -5,14 +5,15 @@
 namespace trading {
 
 void OrderManager::NewOrder(OMOrder *order, common::TickerId ticker_id, common::Price price, common::Side side,
-                            common::Qty qty) noexcept {
+                            common::Qty qty, exchange::TimeInForce time_in_force) noexcept {
     const exchange::MEClientRequest new_request{.type_ = exchange::ClientRequestType::NEW,
                                                 .client_id_ = trading_engine_->ClientId(),
                                                 .ticker_id_ = ticker_id,
                                                 .order_id_ = next_order_id_,
                                                 .side_ = side,
                                                 .price_ = price,
-                                                .qty_ = qty};
+                                                .qty_ = qty,
+                                                .time_in_force_ = time_in_force};
     trading_engine_->SendClientRequest(&new_request);
 
     *order = {.ticker_id_ = ticker_id,
@@ -43,4 +44,20 @@ void OrderManager::CancelOrder(OMOrder *order) noexcept {
                  common::GetCurrentTimeStr(&time_str_), cancel_request.ToString().c_str(), order->ToString().c_str());
 }
 
+void OrderManager::ModifyOrder(OMOrder *order, common::Price price, common::Qty qty) noexcept {
+    const exchange::MEClientRequest modify_request{.type_ = exchange::ClientRequestType::MODIFY,
+                                                   .client_id_ = trading_engine_->ClientId(),
+                                                   .ticker_id_ = order->ticker_id_,
+                                                   .order_id_ = order->order_id_,
+                                                   .side_ = order->side_,
+                                                   .price_ = price,
+                                                   .qty_ = qty};
+    trading_engine_->SendClientRequest(&modify_request);
+
+    order->order_state_ = OMOrderState::PENDING_MODIFY;
+
+    logger_->Log("%:% %() % Sent modify % for %\n", __FILE__, __LINE__, __FUNCTION__,
+                 common::GetCurrentTimeStr(&time_str_), modify_request.ToString().c_str(), order->ToString().c_str());
+}
+
 }  // namespace trading
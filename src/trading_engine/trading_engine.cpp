@@ -1,5 +1,6 @@
 #include "trading_engine/trading_engine.hpp"
 
+#include "common/latency_histogram.hpp"
 #include "common/perf_utils.hpp"
 #include "trading_engine/liquidity_taker.hpp"
 #include "trading_engine/market_maker.hpp"
@@ -10,20 +11,26 @@ TradingEngine::TradingEngine(common::ClientId client_id, common::AlgoType algo_t
                              const common::TradeEngineCfgMap &ticker_cfg,
                              exchange::ClientRequestLFQueue *client_requests,
                              exchange::ClientResponseLFQueue *client_responses,
-                             exchange::MEMarketUpdateLFQueue *market_updates)
+                             exchange::MEMarketUpdateLFQueue *market_updates, common::WaitPolicy wait_policy)
     : CLIENT_ID(client_id),
       outgoing_ogw_requests_(client_requests),
       incoming_ogw_responses_(client_responses),
       incoming_md_updates_(market_updates),
+      wait_strategy_(common::GetThreadConfig(THREAD_NAME, -1).WaitPolicyOr(wait_policy)),
       logger_("trading_engine_" + std::to_string(client_id) + ".log"),
       feature_engine_(&logger_),
       position_keeper_(&logger_),
       order_manager_(&logger_, this, risk_manager_),
       risk_manager_(&position_keeper_, ticker_cfg) {
+    // The order books are built here but used by the trade engine thread, so place them on the NUMA node of that thread
+    // rather than on the one of the constructing thread.
+    common::MemoryNodeScope memory_node_scope(common::GetThreadConfig(THREAD_NAME, -1).MemoryNode());
     for (size_t i = 0; i < ticker_order_book_.size(); ++i) {
         ticker_order_book_[i] = new TradingOrderBook(i, &logger_);
         ticker_order_book_[i]->SetTradingEngine(this);
     }
+    incoming_ogw_responses_->SetDoorbell(wait_strategy_.GetDoorbell());
+    incoming_md_updates_->SetDoorbell(wait_strategy_.GetDoorbell());
 
     algo_on_order_book_update_ = [this](auto ticker_id, auto price, auto side, auto book) {
         DefaultAlgoOnOrderBookUpdate(ticker_id, price, side, book);
@@ -45,10 +52,7 @@ TradingEngine::TradingEngine(common::ClientId client_id, common::AlgoType algo_t
 }
 
 TradingEngine::~TradingEngine() {
-    run_ = false;
-
-    using namespace std::literals::chrono_literals;
-    std::this_thread::sleep_for(1s);
+    thread_ = nullptr;
 
     delete mm_algo_;
     mm_algo_ = nullptr;
@@ -66,39 +70,82 @@ TradingEngine::~TradingEngine() {
 }
 
 void TradingEngine::SendClientRequest(const exchange::MEClientRequest *client_request) noexcept {
-    logger_.Log("%:% %() % Sending %\n", __FILE__, __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_),
+    SendClientRequest(client_request, &logger_, &time_str_);
+}
+
+void TradingEngine::SendClientRequest(const exchange::MEClientRequest *client_request, common::Logger *logger,
+                                      std::string *time_str) noexcept {
+    logger->Log("%:% %() % Sending %\n", __FILE__, __LINE__, __FUNCTION__, common::GetCurrentTimeStr(time_str),
                 client_request->ToString().c_str());
-    auto next_write = outgoing_ogw_requests_->GetNextToWriteTo();
+    auto next_write = outgoing_ogw_requests_->GetNextToWriteTo(stop_token_);
+    if (next_write == nullptr) [[unlikely]] {
+        return;  // stopping, and the order gateway may not read any more requests.
+    }
     *next_write = *client_request;
+    TRACE_START(*next_write, TE_REQUEST_SEND);
     outgoing_ogw_requests_->UpdateWriteIndex();
-    TTT_MEASURE(t10_trade_engine_lf_queue_write, logger_);
+    TTT_MEASURE(t10_trade_engine_lf_queue_write, (*logger));
 }
 
-void TradingEngine::Run() noexcept {
+void TradingEngine::Run(std::stop_token stop_token) noexcept {
     logger_.Log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_));
-    while (run_) {
-        for (auto client_response = incoming_ogw_responses_->GetNextToRead(); client_response != nullptr;
-             client_response = incoming_ogw_responses_->GetNextToRead()) {
-            TTT_MEASURE(t9t_trade_engine_lf_queue_read, logger_);
-
-            logger_.Log("%:% %() % Processing %\n", __FILE__, __LINE__, __FUNCTION__,
-                        common::GetCurrentTimeStr(&time_str_), client_response->ToString().c_str());
-            OnOrderUpdate(client_response);
-            incoming_ogw_responses_->UpdateReadIndex();
-            last_event_time_ = common::GetCurrentNanos();
+    stop_token_ = stop_token;
+    while (!stop_token.stop_requested()) {
+        auto idle = true;
+        for (auto client_responses = incoming_ogw_responses_->GetAllToRead(); !client_responses.empty();
+             client_responses = incoming_ogw_responses_->GetAllToRead()) {
+            idle = false;
+            for (const auto &client_response : client_responses) {
+                TTT_MEASURE(t9t_trade_engine_lf_queue_read, logger_);
+
+                logger_.Log("%:% %() % Processing %\n", __FILE__, __LINE__, __FUNCTION__,
+                            common::GetCurrentTimeStr(&time_str_), client_response.ToString().c_str());
+#if defined(VOTS_TRACING)
+                TRACE_HOP(client_response, TE_RESPONSE_RECV);
+                if (client_response.trace_.Passed(common::TraceHop::TE_REQUEST_SEND)) {
+                    logger_.Log("%:% %() % TRACE RESPONSE client:% coid:% type:% hops:%\n", __FILE__, __LINE__,
+                                __FUNCTION__, common::GetCurrentTimeStr(&time_str_), client_response.client_id_,
+                                client_response.client_order_id_,
+                                exchange::ClientResponseTypeToString(client_response.type_),
+                                client_response.trace_.ToString());
+                }
+#endif
+                OnOrderUpdate(&client_response);
+                last_event_time_ = common::NowNanos();
+            }
+            incoming_ogw_responses_->UpdateReadIndex(client_responses.size());
+        }
+
+        for (auto market_updates = incoming_md_updates_->GetAllToRead(); !market_updates.empty();
+             market_updates = incoming_md_updates_->GetAllToRead()) {
+            idle = false;
+            for (const auto &market_update : market_updates) {
+                TTT_MEASURE(t9_trade_engine_lf_queue_read, logger_);
+
+                logger_.Log("%:% %() % Processing %\n", __FILE__, __LINE__, __FUNCTION__,
+                            common::GetCurrentTimeStr(&time_str_), market_update.ToString().c_str());
+                ASSERT(market_update.ticker_id_ < ticker_order_book_.size(),
+                       "Unknown ticker-id on update:" + market_update.ToString());
+#if defined(VOTS_TRACING)
+                TRACE_HOP(market_update, TE_UPDATE_RECV);
+                // Updates caused by the requests of other clients carry hops stamped by the processes of those clients.
+                if (market_update.trace_.client_id_ == CLIENT_ID) {
+                    logger_.Log("%:% %() % TRACE UPDATE ticker:% oid:% type:% hops:%\n", __FILE__, __LINE__,
+                                __FUNCTION__, common::GetCurrentTimeStr(&time_str_), market_update.ticker_id_,
+                                market_update.order_id_, exchange::MarketUpdateTypeToString(market_update.type_),
+                                market_update.trace_.ToString());
+                }
+#endif
+                ticker_order_book_[market_update.ticker_id_]->OnMarketUpdate(&market_update);
+                last_event_time_ = common::NowNanos();
+            }
+            incoming_md_updates_->UpdateReadIndex(market_updates.size());
         }
 
-        for (auto market_update = incoming_md_updates_->GetNextToRead(); market_update != nullptr;
-             market_update = incoming_md_updates_->GetNextToRead()) {
-            TTT_MEASURE(t9_trade_engine_lf_queue_read, logger_);
-
-            logger_.Log("%:% %() % Processing %\n", __FILE__, __LINE__, __FUNCTION__,
-                        common::GetCurrentTimeStr(&time_str_), market_update->ToString().c_str());
-            ASSERT(market_update->ticker_id_ < ticker_order_book_.size(),
-                   "Unknown ticker-id on update:" + market_update->ToString());
-            ticker_order_book_[market_update->ticker_id_]->OnMarketUpdate(market_update);
-            incoming_md_updates_->UpdateReadIndex();
-            last_event_time_ = common::GetCurrentNanos();
+        if (idle) {
+            wait_strategy_.Idle();
+        } else {
+            wait_strategy_.Reset();
         }
     }
 }
@@ -111,15 +158,15 @@ void TradingEngine::OnOrderBookUpdate(common::TickerId ticker_id, common::Price
 
     START_MEASURE(trading_position_keeper_update_bbo);
     position_keeper_.UpdateBbo(ticker_id, book->GetBbo());
-    END_MEASURE(trading_position_keeper_update_bbo, logger_);
+    END_MEASURE(trading_position_keeper_update_bbo);
 
     START_MEASURE(trading_feature_engine_on_order_book_update);
     feature_engine_.OnOrderBookUpdate(ticker_id, price, side, book);
-    END_MEASURE(trading_feature_engine_on_order_book_update, logger_);
+    END_MEASURE(trading_feature_engine_on_order_book_update);
 
     START_MEASURE(trading_trade_engine_algo_on_order_book_update);
     algo_on_order_book_update_(ticker_id, price, side, book);
-    END_MEASURE(trading_trade_engine_algo_on_order_book_update, logger_);
+    END_MEASURE(trading_trade_engine_algo_on_order_book_update);
 }
 
 void TradingEngine::OnTradeUpdate(const exchange::MEMarketUpdate *market_update, TradingOrderBook *book) noexcept {
@@ -128,11 +175,11 @@ void TradingEngine::OnTradeUpdate(const exchange::MEMarketUpdate *market_update,
 
     START_MEASURE(trading_feature_engine_on_trade_update);
     feature_engine_.OnTradeUpdate(market_update, book);
-    END_MEASURE(trading_feature_engine_on_trade_update, logger_);
+    END_MEASURE(trading_feature_engine_on_trade_update);
 
     START_MEASURE(trading_trade_engine_algo_on_trade_update);
     algo_on_trade_update_(market_update, book);
-    END_MEASURE(trading_trade_engine_algo_on_trade_update, logger_);
+    END_MEASURE(trading_trade_engine_algo_on_trade_update);
 }
 
 void TradingEngine::OnOrderUpdate(const exchange::MEClientResponse *client_response) noexcept {
@@ -142,12 +189,12 @@ void TradingEngine::OnOrderUpdate(const exchange::MEClientResponse *client_respo
     if (client_response->type_ == exchange::ClientResponseType::FILLED) [[unlikely]] {
         START_MEASURE(trading_position_keeper_add_fill);
         position_keeper_.AddFill(client_response);
-        END_MEASURE(trading_position_keeper_add_fill, logger_);
+        END_MEASURE(trading_position_keeper_add_fill);
     }
 
     START_MEASURE(trading_trade_engine_algo_on_order_update);
     algo_on_order_update_(client_response);
-    END_MEASURE(trading_trade_engine_algo_on_order_update, logger_);
+    END_MEASURE(trading_trade_engine_algo_on_order_update);
 }
 
 }  // namespace trading
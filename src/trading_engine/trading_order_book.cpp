@@ -1,12 +1,13 @@
 #include "trading_engine/trading_order_book.hpp"
 
-#include "common/perf_utils.hpp"
+#include "common/latency_histogram.hpp"
 #include "trading_engine/trading_engine.hpp"
 
 namespace trading {
 
 TradingOrderBook::TradingOrderBook(common::TickerId ticker_id, common::Logger *logger)
     : TICKER_ID(ticker_id),
+      oid_to_order_(common::ME_MAX_ORDER_IDS),
       orders_at_price_pool_(common::ME_MAX_PRICE_LEVELS),
       order_pool_(common::ME_MAX_ORDER_IDS),
       logger_(logger) {}
@@ -14,6 +15,9 @@ TradingOrderBook::TradingOrderBook(common::TickerId ticker_id, common::Logger *l
 TradingOrderBook::~TradingOrderBook() {
     logger_->Log("%:% %() % OrderBook\n%\n", __FILE__, __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_),
                  ToString(false, true));
+    logger_->Log("%:% %() % Ticker:% order pool:% orders at price pool:%\n", __FILE__, __LINE__, __FUNCTION__,
+                 common::GetCurrentTimeStr(&time_str_), common::TickerIdToString(TICKER_ID),
+                 order_pool_.Stats().ToString(), orders_at_price_pool_.Stats().ToString());
 
     trade_engine_ = nullptr;
     bids_by_price_ = asks_by_price_ = nullptr;
@@ -22,10 +26,10 @@ TradingOrderBook::~TradingOrderBook() {
 
 // Process market data update and update the limit order book.
 void TradingOrderBook::OnMarketUpdate(const exchange::MEMarketUpdate *market_update) noexcept {
-    const auto bid_updated = ((bids_by_price_ != nullptr) && market_update->side_ == common::Side::BUY &&
-                              market_update->price_ >= bids_by_price_->price_);
-    const auto ask_updated = ((asks_by_price_ != nullptr) && market_update->side_ == common::Side::SELL &&
-                              market_update->price_ <= asks_by_price_->price_);
+    auto bid_updated = ((bids_by_price_ != nullptr) && market_update->side_ == common::Side::BUY &&
+                        market_update->price_ >= bids_by_price_->price_);
+    auto ask_updated = ((asks_by_price_ != nullptr) && market_update->side_ == common::Side::SELL &&
+                        market_update->price_ <= asks_by_price_->price_);
 
     switch (market_update->type_) {
         case exchange::MarketUpdateType::ADD: {
@@ -33,17 +37,34 @@ void TradingOrderBook::OnMarketUpdate(const exchange::MEMarketUpdate *market_upd
                                               market_update->qty_, market_update->priority_, nullptr, nullptr);
             START_MEASURE(trading_market_order_book_add_order);
             AddOrder(order);
-            END_MEASURE(trading_market_order_book_add_order, (*logger_));
+            END_MEASURE(trading_market_order_book_add_order);
         } break;
         case exchange::MarketUpdateType::MODIFY: {
             auto order = oid_to_order_.at(market_update->order_id_);
-            order->qty_ = market_update->qty_;
+            if (order->price_ == market_update->price_ && order->priority_ == market_update->priority_) {
+                auto orders_at_price = GetOrdersAtPrice(order->price_);
+                orders_at_price->total_qty_ = orders_at_price->total_qty_ - order->qty_ + market_update->qty_;
+                order->qty_ = market_update->qty_;
+            } else {  // the order lost its queue priority and was re-queued, possibly at another price.
+                START_MEASURE(trading_market_order_book_remove_order);
+                RemoveOrder(order);
+                END_MEASURE(trading_market_order_book_remove_order);
+
+                order = order_pool_.Allocate(market_update->order_id_, market_update->side_, market_update->price_,
+                                             market_update->qty_, market_update->priority_, nullptr, nullptr);
+                START_MEASURE(trading_market_order_book_add_order);
+                AddOrder(order);
+                END_MEASURE(trading_market_order_book_add_order);
+
+                // The order might have left the top of the book.
+                (market_update->side_ == common::Side::BUY ? bid_updated : ask_updated) = true;
+            }
         } break;
         case exchange::MarketUpdateType::CANCEL: {
             auto order = oid_to_order_.at(market_update->order_id_);
             START_MEASURE(trading_market_order_book_remove_order);
             RemoveOrder(order);
-            END_MEASURE(trading_market_order_book_remove_order, (*logger_));
+            END_MEASURE(trading_market_order_book_remove_order);
         } break;
         case exchange::MarketUpdateType::TRADE: {
             trade_engine_->OnTradeUpdate(market_update, this);
@@ -59,20 +80,26 @@ void TradingOrderBook::OnMarketUpdate(const exchange::MEMarketUpdate *market_upd
             oid_to_order_.fill(nullptr);
 
             if (bids_by_price_ != nullptr) {
-                for (auto bid = bids_by_price_->next_entry_; bid != bids_by_price_; bid = bid->next_entry_) {
+                // A deallocated block no longer holds its links, so step past it first.
+                for (auto bid = bids_by_price_->next_entry_; bid != bids_by_price_;) {
+                    const auto next_bid = bid->next_entry_;
                     orders_at_price_pool_.Deallocate(bid);
+                    bid = next_bid;
                 }
                 orders_at_price_pool_.Deallocate(bids_by_price_);
             }
 
             if (asks_by_price_ != nullptr) {
-                for (auto ask = asks_by_price_->next_entry_; ask != asks_by_price_; ask = ask->next_entry_) {
+                for (auto ask = asks_by_price_->next_entry_; ask != asks_by_price_;) {
+                    const auto next_ask = ask->next_entry_;
                     orders_at_price_pool_.Deallocate(ask);
+                    ask = next_ask;
                 }
                 orders_at_price_pool_.Deallocate(asks_by_price_);
             }
 
             bids_by_price_ = asks_by_price_ = nullptr;
+            price_ladder_.Clear();
         } break;
         case exchange::MarketUpdateType::INVALID:
         case exchange::MarketUpdateType::SNAPSHOT_START:
@@ -82,7 +109,7 @@ void TradingOrderBook::OnMarketUpdate(const exchange::MEMarketUpdate *market_upd
 
     START_MEASURE(trading_market_order_book_update_bbo);
     UpdateBbo(bid_updated, ask_updated);
-    END_MEASURE(trading_market_order_book_update_bbo, (*logger_));
+    END_MEASURE(trading_market_order_book_update_bbo);
 
     logger_->Log("%:% %() % % %", __FILE__, __LINE__, __FUNCTION__, common::GetCurrentTimeStr(&time_str_),
                  market_update->ToString(), bbo_.ToString());
@@ -96,20 +123,10 @@ auto TradingOrderBook::ToString(bool detailed, bool validity_check) const -> std
     auto printer = [&](std::stringstream &ss, TradingOrdersAtPrice *itr, common::Side side, common::Price &last_price,
                        bool sanity_check) {
         char buf[4096];
-        common::Qty qty = 0;
-        size_t num_orders = 0;
-
-        for (auto o_itr = itr->first_mkt_order_;; o_itr = o_itr->next_order_) {
-            qty += o_itr->qty_;
-            ++num_orders;
-            if (o_itr->next_order_ == itr->first_mkt_order_) {
-                break;
-            }
-        }
         sprintf(buf, " <px:%3s p:%3s n:%3s> %-3s @ %-5s(%-4s)", common::PriceToString(itr->price_).c_str(),
                 common::PriceToString(itr->prev_entry_->price_).c_str(),
                 common::PriceToString(itr->next_entry_->price_).c_str(), common::PriceToString(itr->price_).c_str(),
-                common::QtyToString(qty).c_str(), std::to_string(num_orders).c_str());
+                common::QtyToString(itr->total_qty_).c_str(), std::to_string(itr->num_orders_).c_str());
         ss << buf;
         for (auto o_itr = itr->first_mkt_order_;; o_itr = o_itr->next_order_) {
             if (detailed) {
@@ -131,6 +148,20 @@ auto TradingOrderBook::ToString(bool detailed, bool validity_check) const -> std
         ss << std::endl;  // NOLINT
 
         if (sanity_check) {
+            common::Qty qty = 0;
+            size_t num_orders = 0;
+            for (auto o_itr = itr->first_mkt_order_;; o_itr = o_itr->next_order_) {
+                qty += o_itr->qty_;
+                ++num_orders;
+                if (o_itr->next_order_ == itr->first_mkt_order_) {
+                    break;
+                }
+            }
+            if (qty != itr->total_qty_ || num_orders != itr->num_orders_) {
+                FATAL("Level aggregates do not match its orders qty:" + common::QtyToString(qty) +
+                      " orders:" + std::to_string(num_orders) + " itr:" + itr->ToString());
+            }
+
             if ((side == common::Side::SELL && last_price >= itr->price_) ||
                 (side == common::Side::BUY && last_price <= itr->price_)) {
                 FATAL("Bids/Asks not sorted by ascending/descending prices last:" + common::PriceToString(last_price) +
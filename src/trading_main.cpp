@@ -1,5 +1,6 @@
 #include <csignal>
 
+#include "common/latency_histogram.hpp"
 #include "logging/logger.hpp"
 #include "market_data/market_data_consumer.hpp"
 #include "order_gateway/gateway_client.hpp"
@@ -7,24 +8,52 @@
 
 // Main components.
 common::Logger *logger = nullptr;
+common::LatencyReporter *latency_reporter = nullptr;
 trading::TradingEngine *trading_engine = nullptr;
 trading::MarketDataConsumer *market_data_consumer = nullptr;
 trading::GatewayClient *order_gateway = nullptr;
 
 // ./trading_main CLIENT_ID ALGO_TYPE [CLIP_1 THRESH_1 MAX_ORDER_SIZE_1 MAX_POS_1 MAX_LOSS_1] [CLIP_2 THRESH_2
-// MAX_ORDER_SIZE_2 MAX_POS_2 MAX_LOSS_2] ...
+// MAX_ORDER_SIZE_2 MAX_POS_2 MAX_LOSS_2] ... [WAIT_POLICY]
+// WAIT_POLICY is how the trade engine, order gateway and market data consumer wait for work: BUSY_SPIN (the default),
+// YIELD or PARK. Running several clients on the same machine as the exchange calls for YIELD or PARK.
+// If the THREAD_LAYOUT environment variable names a thread layout file (see runtime/thread_layout.hpp), the threads it
+// lists get its cores, scheduling, NUMA nodes and wait policies, overriding WAIT_POLICY. Its thread names are
+// Trading/TradeEngine, Trading/OrderGateway, Trading/MarketDataConsumer, common/LatencyReporter and
+// common/Logger/<LOG_FILE>.
+// The latency percentiles of every START_MEASURE/END_MEASURE tag are written to trading_latencies_<CLIENT_ID>.txt
+// every 10 seconds and at exit.
+// With the TRANSPORT environment variable set to SHM, the client connects to an exchange on the same host, started
+// with TRANSPORT=SHM as well, over shared memory and reads the incremental market data from it (see
+// network/shm_transport.hpp). Snapshots for recovery still come over multicast. It defaults to SOCKET, for TCP and
+// multicast.
+// With the LOG_FORMAT environment variable set to BINARY, every log is written as binary records to <LOG_FILE>.bin,
+// for log_decoder to turn into text later (see logging/log_record.hpp). It defaults to TEXT.
 auto main(int argc, char **argv) -> int {
-    if (argc < 3) {
+    // The ticker configurations come in groups of 5 arguments, so a single trailing one is the wait policy.
+    const auto has_wait_policy = (argc > 3 && (argc - 3) % 5 == 1);
+    const auto wait_policy =
+        (has_wait_policy ? common::StringToWaitPolicy(argv[argc - 1]) : common::WaitPolicy::BUSY_SPIN);
+    const auto transport = common::GetTransport();
+    if (transport == common::Transport::INVALID) {
+        FATAL("TRANSPORT must be SOCKET or SHM.");
+    }
+    if (argc < 3 || wait_policy == common::WaitPolicy::INVALID) {
         FATAL(
             "USAGE trading_main CLIENT_ID ALGO_TYPE [CLIP_1 THRESH_1 MAX_ORDER_SIZE_1 MAX_POS_1 MAX_LOSS_1] [CLIP_2 "
-            "THRESH_2 MAX_ORDER_SIZE_2 MAX_POS_2 MAX_LOSS_2] ...");
+            "THRESH_2 MAX_ORDER_SIZE_2 MAX_POS_2 MAX_LOSS_2] ... [BUSY_SPIN|YIELD|PARK]");
     }
+    const auto num_cfg_args = argc - (has_wait_policy ? 1 : 0);
 
     const common::ClientId client_id = atoi(argv[1]);
     srand(client_id);
 
     const auto algo_type = common::StringToAlgoType(argv[2]);
 
+    common::LoadThreadLayout();
+    common::CalibrateCycleClock();
+    latency_reporter = new common::LatencyReporter("trading_latencies_" + std::to_string(client_id) + ".txt");
+
     logger = new common::Logger("trading_main_" + std::to_string(client_id) + ".log");
 
     const int sleep_time = 20 * 1000;
@@ -43,7 +72,7 @@ auto main(int argc, char **argv) -> int {
     // [CLIP_1 THRESH_1 MAX_ORDER_SIZE_1 MAX_POS_1 MAX_LOSS_1] [CLIP_2 THRESH_2 MAX_ORDER_SIZE_2 MAX_POS_2 MAX_LOSS_2]
     // ...
     size_t next_ticker_id = 0;
-    for (int i = 3; i < argc; i += 5, ++next_ticker_id) {
+    for (int i = 3; i + 5 <= num_cfg_args; i += 5, ++next_ticker_id) {
         ticker_cfg.at(next_ticker_id) = {
             .clip_ = static_cast<common::Qty>(std::atoi(argv[i])),
             .threshold_ = std::atof(argv[i + 1]),
@@ -55,7 +84,7 @@ auto main(int argc, char **argv) -> int {
     logger->Log("%:% %() % Starting Trade Engine...\n", __FILE__, __LINE__, __FUNCTION__,
                 common::GetCurrentTimeStr(&time_str));
     trading_engine = new trading::TradingEngine(client_id, algo_type, ticker_cfg, &client_requests, &client_responses,
-                                              &market_updates);
+                                              &market_updates, wait_policy);
     trading_engine->Start();
 
     const std::string order_gw_ip = "127.0.0.1";
@@ -65,7 +94,7 @@ auto main(int argc, char **argv) -> int {
     logger->Log("%:% %() % Starting Order Gateway...\n", __FILE__, __LINE__, __FUNCTION__,
                 common::GetCurrentTimeStr(&time_str));
     order_gateway = new trading::GatewayClient(client_id, &client_requests, &client_responses, order_gw_ip,
-                                               order_gw_iface, order_gw_port);
+                                               order_gw_iface, order_gw_port, wait_policy, transport);
     order_gateway->Start();
 
     const std::string mkt_data_iface = "lo";
@@ -76,12 +105,11 @@ auto main(int argc, char **argv) -> int {
 
     logger->Log("%:% %() % Starting Market Data Consumer...\n", __FILE__, __LINE__, __FUNCTION__,
                 common::GetCurrentTimeStr(&time_str));
-    market_data_consumer = new trading::MarketDataConsumer(client_id, &market_updates, mkt_data_iface, snapshot_ip,
-                                                           snapshot_port, incremental_ip, incremental_port);
+    market_data_consumer =
+        new trading::MarketDataConsumer(client_id, &market_updates, mkt_data_iface, snapshot_ip, snapshot_port,
+                                        incremental_ip, incremental_port, wait_policy, transport);
     market_data_consumer->Start();
 
-    usleep(10 * 1000 * 1000);
-
     trading_engine->InitLastEventTime();
 
     // For the random trading algorithm, we simply implement it here instead of creating a new trading algorithm which
@@ -106,14 +134,14 @@ auto main(int argc, char **argv) -> int {
                                                   .side_ = side,
                                                   .price_ = price,
                                                   .qty_ = qty};
-            trading_engine->SendClientRequest(&new_request);
+            trading_engine->SendClientRequest(&new_request, logger, &time_str);
             usleep(sleep_time);
 
             client_requests_vec.push_back(new_request);
             const auto cxl_index = rand() % client_requests_vec.size();
             auto cxl_request = client_requests_vec[cxl_index];
             cxl_request.type_ = exchange::ClientRequestType::CANCEL;
-            trading_engine->SendClientRequest(&cxl_request);
+            trading_engine->SendClientRequest(&cxl_request, logger, &time_str);
             usleep(sleep_time);
 
             if (trading_engine->SilentSeconds() >= 60) {
@@ -130,16 +158,13 @@ auto main(int argc, char **argv) -> int {
                     __FUNCTION__, common::GetCurrentTimeStr(&time_str), trading_engine->SilentSeconds());
 
         using namespace std::literals::chrono_literals;
-        std::this_thread::sleep_for(30s);
+        std::this_thread::sleep_for(1s);
     }
 
     trading_engine->Stop();
     market_data_consumer->Stop();
     order_gateway->Stop();
 
-    using namespace std::literals::chrono_literals;
-    std::this_thread::sleep_for(10s);
-
     delete logger;
     logger = nullptr;
     delete trading_engine;
@@ -148,8 +173,8 @@ auto main(int argc, char **argv) -> int {
     market_data_consumer = nullptr;
     delete order_gateway;
     order_gateway = nullptr;
-
-    std::this_thread::sleep_for(10s);
+    delete latency_reporter;
+    latency_reporter = nullptr;
 
     exit(EXIT_SUCCESS);
 }